@@ -0,0 +1,121 @@
+// Compares ways of building a table from keys known to be unique: insert()
+// one by one, the range constructor, and insert_unique_range(); and of
+// merging per-thread partial tables: insert() of every entry, vs merge(),
+// into an empty and into a non-empty table.
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+using IntMap = FlatSmallHashMap<uint32_t, int, DefaultHashFn<uint32_t>,
+                                std::equal_to<uint32_t>, LargeSizePolicy>;
+
+using StringMap =
+    FlatSmallHashMap<std::string, int, DefaultHashFn<std::string>,
+                     std::equal_to<std::string>, LargeSizePolicy>;
+
+template <typename Map>
+typename Map::value_type entry(uint32_t i);
+
+template <>
+IntMap::value_type entry<IntMap>(uint32_t i) {
+  return {fmix32(i), (int)i};
+}
+
+template <>
+StringMap::value_type entry<StringMap>(uint32_t i) {
+  return {"sensor/" + std::to_string(i) + "/value", (int)i};
+}
+
+template <typename Map>
+std::vector<typename Map::value_type> entries(uint32_t begin, uint32_t end) {
+  std::vector<typename Map::value_type> result;
+  for (uint32_t i = begin; i < end; ++i) result.push_back(entry<Map>(i));
+  return result;
+}
+
+template <typename Map>
+void BM_BuildInsert(benchmark::State& state) {
+  auto source = entries<Map>(0, state.range(0));
+  for (auto _ : state) {
+    Map map;
+    for (const auto& e : source) map.insert(e);
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * source.size());
+}
+
+template <typename Map>
+void BM_BuildRangeConstructor(benchmark::State& state) {
+  auto source = entries<Map>(0, state.range(0));
+  for (auto _ : state) {
+    Map map(source.begin(), source.end());
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * source.size());
+}
+
+template <typename Map>
+void BM_BuildUniqueRange(benchmark::State& state) {
+  auto source = entries<Map>(0, state.range(0));
+  for (auto _ : state) {
+    Map map;
+    map.insert_unique_range(source.begin(), source.end());
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * source.size());
+}
+
+// Merges 4 disjoint partial tables, of range(0) / 4 entries each, into
+// one. Building the partial tables is not timed.
+template <typename Map, bool kMerge>
+void BM_MergeParts(benchmark::State& state) {
+  constexpr int kParts = 4;
+  uint32_t part_size = state.range(0) / kParts;
+  std::vector<Map> parts(kParts);
+  for (int p = 0; p < kParts; ++p) {
+    auto source = entries<Map>(p * part_size, (p + 1) * part_size);
+    parts[p].insert_unique_range(source.begin(), source.end());
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Map> copies = parts;
+    state.ResumeTiming();
+    Map result;
+    for (Map& part : copies) {
+      if (kMerge) {
+        result.merge(std::move(part));
+      } else {
+        for (auto& e : part) result.insert(std::move(e));
+      }
+    }
+    benchmark::DoNotOptimize(result.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kParts * part_size);
+}
+
+void Sizes(benchmark::internal::Benchmark* b) {
+  for (int n : {64, 4096, 100000}) b->Arg(n);
+}
+
+BENCHMARK_TEMPLATE(BM_BuildInsert, IntMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_BuildRangeConstructor, IntMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_BuildUniqueRange, IntMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_BuildInsert, StringMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_BuildRangeConstructor, StringMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_BuildUniqueRange, StringMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_MergeParts, IntMap, false)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_MergeParts, IntMap, true)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_MergeParts, StringMap, false)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_MergeParts, StringMap, true)->Apply(Sizes);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,153 @@
+// Compares Radke prime capacities (with fastmod and quadratic probing) against
+// power-of-two capacities (with Fibonacci hashing and triangular probing), for
+// lookups and inserts of integer and string keys, with single-slot and group
+// probing. Integer keys use the identity hash; the "Strided" variants use
+// keys that differ only in their upper bits, which defeat a plain mask.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_set.h"
+
+namespace roo_collections {
+namespace {
+
+template <typename Policy>
+using IntSet = FlatSmallHashSet<uint32_t, DefaultHashFn<uint32_t>,
+                                std::equal_to<uint32_t>, Policy>;
+
+template <typename Policy>
+using StringSet = FlatSmallHashSet<std::string, DefaultHashFn<std::string>,
+                                   std::equal_to<std::string>, Policy>;
+
+using Radke = LargeSizePolicy;
+using PowerOfTwo = PowerOfTwoCapacity<LargeSizePolicy>;
+using GroupRadke = GroupProbing<LargeSizePolicy>;
+using GroupPowerOfTwo = PowerOfTwoCapacity<GroupProbing<LargeSizePolicy>>;
+
+// Random keys; odd keys are inserted, and even keys are guaranteed misses.
+std::vector<uint32_t> randomKeys(size_t count, bool present) {
+  std::mt19937 rng(count);
+  std::vector<uint32_t> keys(count);
+  for (uint32_t& k : keys) k = (rng() | 1) ^ (present ? 0 : 1);
+  return keys;
+}
+
+// Multiples of 4096, shuffled; the misses are offset by half a stride.
+std::vector<uint32_t> stridedKeys(size_t count, bool present) {
+  std::vector<uint32_t> keys(count);
+  for (size_t i = 0; i < count; ++i) {
+    keys[i] = (uint32_t)i * 4096 + (present ? 0 : 2048);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(count));
+  return keys;
+}
+
+std::vector<std::string> stringKeys(const std::vector<uint32_t>& keys) {
+  std::vector<std::string> result;
+  for (uint32_t k : keys) {
+    result.push_back("/devices/sensor/" + std::to_string(k) + "/value");
+  }
+  return result;
+}
+
+template <typename Set, typename K>
+void BM_Find(benchmark::State& state, const std::vector<K>& present,
+             const std::vector<K>& queries) {
+  Set set;
+  for (const K& k : present) set.insert(k);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(queries[i]));
+    if (++i == queries.size()) i = 0;
+  }
+  state.counters["avg_probe"] = set.stats().avg_hit_probe_length;
+}
+
+template <typename Policy>
+void BM_IntFindHit(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(state.range(0), true);
+  BM_Find<IntSet<Policy>>(state, keys, keys);
+}
+
+template <typename Policy>
+void BM_IntFindMiss(benchmark::State& state) {
+  BM_Find<IntSet<Policy>>(state, randomKeys(state.range(0), true),
+                          randomKeys(state.range(0), false));
+}
+
+template <typename Policy>
+void BM_StridedFindHit(benchmark::State& state) {
+  std::vector<uint32_t> keys = stridedKeys(state.range(0), true);
+  BM_Find<IntSet<Policy>>(state, keys, keys);
+}
+
+template <typename Policy>
+void BM_StridedFindMiss(benchmark::State& state) {
+  BM_Find<IntSet<Policy>>(state, stridedKeys(state.range(0), true),
+                          stridedKeys(state.range(0), false));
+}
+
+template <typename Policy>
+void BM_StringFindHit(benchmark::State& state) {
+  std::vector<std::string> keys = stringKeys(randomKeys(state.range(0), true));
+  BM_Find<StringSet<Policy>>(state, keys, keys);
+}
+
+template <typename Policy>
+void BM_StringFindMiss(benchmark::State& state) {
+  BM_Find<StringSet<Policy>>(state,
+                             stringKeys(randomKeys(state.range(0), true)),
+                             stringKeys(randomKeys(state.range(0), false)));
+}
+
+template <typename Policy>
+void BM_IntInsert(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(state.range(0), true);
+  for (auto _ : state) {
+    IntSet<Policy> set;
+    for (uint32_t k : keys) set.insert(k);
+    benchmark::DoNotOptimize(set.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template <typename Policy>
+void BM_StringInsert(benchmark::State& state) {
+  std::vector<std::string> keys = stringKeys(randomKeys(state.range(0), true));
+  for (auto _ : state) {
+    StringSet<Policy> set;
+    for (const std::string& k : keys) set.insert(k);
+    benchmark::DoNotOptimize(set.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Sizes just below the resize thresholds of either capacity sequence, where
+// its probe sequences are the longest.
+void Sizes(benchmark::internal::Benchmark* b) {
+  for (int n : {740, 5970, 11900, 47800, 382000}) b->Arg(n);
+}
+
+#define CAPACITY_BENCHMARK(name)                               \
+  BENCHMARK_TEMPLATE(name, Radke)->Apply(Sizes);               \
+  BENCHMARK_TEMPLATE(name, PowerOfTwo)->Apply(Sizes);          \
+  BENCHMARK_TEMPLATE(name, GroupRadke)->Apply(Sizes);          \
+  BENCHMARK_TEMPLATE(name, GroupPowerOfTwo)->Apply(Sizes)
+
+CAPACITY_BENCHMARK(BM_IntFindHit);
+CAPACITY_BENCHMARK(BM_IntFindMiss);
+CAPACITY_BENCHMARK(BM_StridedFindHit);
+CAPACITY_BENCHMARK(BM_StridedFindMiss);
+CAPACITY_BENCHMARK(BM_StringFindHit);
+CAPACITY_BENCHMARK(BM_StringFindMiss);
+CAPACITY_BENCHMARK(BM_IntInsert);
+CAPACITY_BENCHMARK(BM_StringInsert);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,145 @@
+// Measures the read throughput of a config-style table shared by many
+// threads: a FlatSmallHashMap behind a std::mutex or a std::shared_mutex, vs a
+// ReadMostlyFlatHashMap. Run with --benchmark_counters_tabular=true; the
+// items_per_second counter is the aggregate over all threads, and should grow
+// with the thread count for ReadMostlyFlatHashMap, up to the number of cores.
+//
+// The *WithWriter variants replace the table in a background thread every
+// millisecond while the readers run.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/read_mostly_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+constexpr int kSize = 1000;
+
+using Map = FlatSmallHashMap<int, int>;
+
+Map makeMap() {
+  Map map;
+  for (int i = 0; i < kSize; ++i) map[i * 7] = i;
+  return map;
+}
+
+struct MutexMap {
+  Map map = makeMap();
+  std::mutex mutex;
+
+  bool contains(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return map.contains(key);
+  }
+
+  void update(int version) {
+    std::lock_guard<std::mutex> lock(mutex);
+    map[0] = version;
+  }
+};
+
+struct SharedMutexMap {
+  Map map = makeMap();
+  std::shared_mutex mutex;
+
+  bool contains(int key) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return map.contains(key);
+  }
+
+  void update(int version) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    map[0] = version;
+  }
+};
+
+struct ReadMostlyMap {
+  ReadMostlyFlatHashMap<int, int> map{makeMap()};
+
+  bool contains(int key) { return map.contains(key); }
+
+  void update(int version) {
+    map.update([&](Map& m) { m[0] = version; });
+  }
+};
+
+// Updates the map every millisecond, for as long as it exists.
+template <typename Container>
+class Writer {
+ public:
+  explicit Writer(Container& container)
+      : done_(false), thread_([this, &container] {
+          for (int version = 0; !done_.load(); ++version) {
+            container.update(version);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+        }) {}
+
+  ~Writer() {
+    done_ = true;
+    thread_.join();
+  }
+
+ private:
+  std::atomic<bool> done_;
+  std::thread thread_;
+};
+
+// Shared by the threads of a benchmark run. Thread 0 sets it up and tears it
+// down; the others wait at the start and end of the timed loop.
+template <typename Container>
+Container* container;
+
+template <typename Container>
+Writer<Container>* writer;
+
+template <typename Container, bool kWithWriter>
+void BM_Find(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    container<Container> = new Container();
+    if (kWithWriter) {
+      writer<Container> = new Writer<Container>(*container<Container>);
+    }
+  }
+  uint32_t key = state.thread_index() * 7 * 113;
+  for (auto _ : state) {
+    // Half of the keys are present.
+    benchmark::DoNotOptimize(
+        container<Container>->contains(key % (kSize * 14)));
+    key += 7;
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete writer<Container>;
+    writer<Container> = nullptr;
+    delete container<Container>;
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_Find, MutexMap, false)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Find, SharedMutexMap, false)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Find, ReadMostlyMap, false)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Find, MutexMap, true)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Find, ReadMostlyMap, true)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,391 @@
+// Compares FlatSmallHashMap and FlatSmallHashSet against std::unordered_map,
+// std::unordered_set, and a sorted vector, across the common operations,
+// key types, and sizes from 1 to 60k elements.
+//
+// Benchmark names have the form BM_<Operation><Container<Key>>/<size>. For
+// machine-readable output, run with --benchmark_format=json, or with
+// --benchmark_out=<file> --benchmark_out_format=json to also get the console
+// report.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/flat_small_hash_set.h"
+#include "roo_collections/small_string.h"
+
+namespace roo_collections {
+namespace {
+
+// Keys.
+
+std::string keyName(uint32_t id) {
+  return "sensor/" + std::to_string(id) + "/value";
+}
+
+// Distinct keys of type K. Owns the strings that string_view keys refer to.
+template <typename K>
+class KeyPool {
+ public:
+  // Generates `count` keys. Pools with different `present` flags never
+  // share a key.
+  KeyPool(size_t count, bool present) {
+    std::mt19937 rng(count);
+    for (size_t i = 0; i < count; ++i) {
+      keys_.push_back(makeKey((rng() | 1) ^ (present ? 0 : 1)));
+    }
+  }
+
+  KeyPool(const KeyPool&) = delete;
+  KeyPool& operator=(const KeyPool&) = delete;
+
+  const std::vector<K>& keys() const { return keys_; }
+
+ private:
+  K makeKey(uint32_t id);
+
+  std::deque<std::string> storage_;
+  std::vector<K> keys_;
+};
+
+template <>
+int KeyPool<int>::makeKey(uint32_t id) {
+  return (int)id;
+}
+
+template <>
+std::string KeyPool<std::string>::makeKey(uint32_t id) {
+  return keyName(id);
+}
+
+template <>
+roo::string_view KeyPool<roo::string_view>::makeKey(uint32_t id) {
+  storage_.push_back(keyName(id));
+  return roo::string_view(storage_.back());
+}
+
+template <>
+SmallString<32> KeyPool<SmallString<32>>::makeKey(uint32_t id) {
+  return SmallString<32>(keyName(id));
+}
+
+// Orders keys of all supported types; SmallString has no operator<.
+struct KeyLess {
+  bool operator()(int a, int b) const { return a < b; }
+
+  template <typename K>
+  bool operator()(const K& a, const K& b) const {
+    return roo::string_view(a) < roo::string_view(b);
+  }
+};
+
+// Containers, adapted to a common interface.
+
+template <typename Map>
+class HashMapAdapter {
+ public:
+  using Key = typename Map::key_type;
+
+  void insert(const Key& key, int value) { map_[key] = value; }
+  bool contains(const Key& key) const { return map_.find(key) != map_.end(); }
+  bool erase(const Key& key) { return map_.erase(key) != 0; }
+  size_t size() const { return map_.size(); }
+
+  long sum() const {
+    long sum = 0;
+    for (const auto& e : map_) sum += e.second;
+    return sum;
+  }
+
+  void compact() { compactMap(map_); }
+
+ private:
+  template <typename K>
+  static void compactMap(FlatSmallHashMap<K, int>& map) {
+    map.compact();
+  }
+
+  template <typename K>
+  static void compactMap(std::unordered_map<K, int, DefaultHashFn<K>>& map) {
+    map.rehash(0);
+  }
+
+  Map map_;
+};
+
+template <typename Set>
+class HashSetAdapter {
+ public:
+  using Key = typename Set::key_type;
+
+  void insert(const Key& key, int) { set_.insert(key); }
+  bool contains(const Key& key) const { return set_.find(key) != set_.end(); }
+  bool erase(const Key& key) { return set_.erase(key) != 0; }
+  size_t size() const { return set_.size(); }
+
+  long sum() const {
+    long sum = 0;
+    for (const auto& e : set_) {
+      benchmark::DoNotOptimize(e);
+      ++sum;
+    }
+    return sum;
+  }
+
+  void compact() { compactSet(set_); }
+
+ private:
+  template <typename K>
+  static void compactSet(FlatSmallHashSet<K>& set) {
+    set.compact();
+  }
+
+  template <typename K>
+  static void compactSet(std::unordered_set<K, DefaultHashFn<K>>& set) {
+    set.rehash(0);
+  }
+
+  Set set_;
+};
+
+// Map kept as a vector of entries, sorted by key.
+template <typename K>
+class SortedVectorMap {
+ public:
+  using Key = K;
+
+  void insert(const Key& key, int value) {
+    auto it = lowerBound(key);
+    if (it != entries_.end() && !KeyLess()(key, it->first)) {
+      it->second = value;
+    } else {
+      entries_.emplace(it, key, value);
+    }
+  }
+
+  bool contains(const Key& key) const {
+    auto it = lowerBound(key);
+    return it != entries_.end() && !KeyLess()(key, it->first);
+  }
+
+  bool erase(const Key& key) {
+    auto it = lowerBound(key);
+    if (it == entries_.end() || KeyLess()(key, it->first)) return false;
+    entries_.erase(it);
+    return true;
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  long sum() const {
+    long sum = 0;
+    for (const auto& e : entries_) sum += e.second;
+    return sum;
+  }
+
+  void compact() { entries_.shrink_to_fit(); }
+
+ private:
+  using Entries = std::vector<std::pair<K, int>>;
+
+  typename Entries::iterator lowerBound(const Key& key) {
+    return std::lower_bound(
+        entries_.begin(), entries_.end(), key,
+        [](const std::pair<K, int>& e, const K& k) {
+          return KeyLess()(e.first, k);
+        });
+  }
+
+  typename Entries::const_iterator lowerBound(const Key& key) const {
+    return std::lower_bound(
+        entries_.begin(), entries_.end(), key,
+        [](const std::pair<K, int>& e, const K& k) {
+          return KeyLess()(e.first, k);
+        });
+  }
+
+  Entries entries_;
+};
+
+template <typename K>
+using FlatMap = HashMapAdapter<FlatSmallHashMap<K, int>>;
+
+template <typename K>
+using StdMap = HashMapAdapter<std::unordered_map<K, int, DefaultHashFn<K>>>;
+
+template <typename K>
+using SortedVector = SortedVectorMap<K>;
+
+template <typename K>
+using FlatSet = HashSetAdapter<FlatSmallHashSet<K>>;
+
+template <typename K>
+using StdSet = HashSetAdapter<std::unordered_set<K, DefaultHashFn<K>>>;
+
+template <typename C>
+void fill(C& container, const std::vector<typename C::Key>& keys) {
+  int i = 0;
+  for (const auto& k : keys) container.insert(k, i++);
+}
+
+// Benchmarks. Each reports items per second, where an item is one element
+// inserted, looked up, erased, visited, or copied.
+
+// Builds a container from empty.
+template <typename C>
+void BM_Insert(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  for (auto _ : state) {
+    C container;
+    fill(container, pool.keys());
+    benchmark::DoNotOptimize(container.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename C>
+void BM_FindHit(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  C container;
+  fill(container, pool.keys());
+  const auto& keys = pool.keys();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(container.contains(keys[i]));
+    if (++i == keys.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename C>
+void BM_FindMiss(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  KeyPool<typename C::Key> misses(state.range(0), false);
+  C container;
+  fill(container, pool.keys());
+  const auto& keys = misses.keys();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(container.contains(keys[i]));
+    if (++i == keys.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Erases all elements, one by one. Refilling the container between
+// iterations is not timed, but the pause itself adds some fixed overhead,
+// visible at the smallest sizes.
+template <typename C>
+void BM_Erase(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  C full;
+  fill(full, pool.keys());
+  for (auto _ : state) {
+    state.PauseTiming();
+    C container = full;
+    state.ResumeTiming();
+    for (const auto& k : pool.keys()) container.erase(k);
+    benchmark::DoNotOptimize(container.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Keeps the container at a steady size while replacing its keys; each
+// iteration erases the oldest key and inserts a new one.
+template <typename C>
+void BM_Churn(benchmark::State& state) {
+  size_t size = state.range(0);
+  KeyPool<typename C::Key> pool(2 * size, true);
+  const auto& keys = pool.keys();
+  C container;
+  for (size_t i = 0; i < size; ++i) container.insert(keys[i], i);
+  size_t i = 0;
+  for (auto _ : state) {
+    container.erase(keys[i]);
+    container.insert(keys[(i + size) % keys.size()], i);
+    if (++i == keys.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename C>
+void BM_Iterate(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  C container;
+  fill(container, pool.keys());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(container.sum());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename C>
+void BM_Copy(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  C container;
+  fill(container, pool.keys());
+  for (auto _ : state) {
+    C copy = container;
+    benchmark::DoNotOptimize(copy.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Compacts a container from which every other element has been erased.
+// Preparing the container is not timed.
+template <typename C>
+void BM_Compact(benchmark::State& state) {
+  KeyPool<typename C::Key> pool(state.range(0), true);
+  const auto& keys = pool.keys();
+  C sparse;
+  fill(sparse, keys);
+  for (size_t i = 0; i < keys.size(); i += 2) sparse.erase(keys[i]);
+  for (auto _ : state) {
+    state.PauseTiming();
+    C container = sparse;
+    state.ResumeTiming();
+    container.compact();
+    benchmark::DoNotOptimize(container.size());
+  }
+  state.SetItemsProcessed(state.iterations() * sparse.size());
+}
+
+void Sizes(benchmark::internal::Benchmark* b) {
+  for (int n : {1, 8, 64, 512, 4096, 60000}) b->Arg(n);
+}
+
+#define CONTAINER_BENCHMARKS(C)                      \
+  BENCHMARK_TEMPLATE(BM_Insert, C)->Apply(Sizes);    \
+  BENCHMARK_TEMPLATE(BM_FindHit, C)->Apply(Sizes);   \
+  BENCHMARK_TEMPLATE(BM_FindMiss, C)->Apply(Sizes);  \
+  BENCHMARK_TEMPLATE(BM_Erase, C)->Apply(Sizes);     \
+  BENCHMARK_TEMPLATE(BM_Churn, C)->Apply(Sizes);     \
+  BENCHMARK_TEMPLATE(BM_Iterate, C)->Apply(Sizes);   \
+  BENCHMARK_TEMPLATE(BM_Copy, C)->Apply(Sizes);      \
+  BENCHMARK_TEMPLATE(BM_Compact, C)->Apply(Sizes)
+
+#define KEY_BENCHMARKS(K)                \
+  CONTAINER_BENCHMARKS(FlatMap<K>);      \
+  CONTAINER_BENCHMARKS(StdMap<K>);       \
+  CONTAINER_BENCHMARKS(SortedVector<K>); \
+  CONTAINER_BENCHMARKS(FlatSet<K>);      \
+  CONTAINER_BENCHMARKS(StdSet<K>)
+
+using SmallString32 = SmallString<32>;
+
+KEY_BENCHMARKS(int);
+KEY_BENCHMARKS(std::string);
+KEY_BENCHMARKS(roo::string_view);
+KEY_BENCHMARKS(SmallString32);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,177 @@
+// Compares DenseFlatHashMap against FlatSmallHashMap, with the default and the
+// SplitKeyValue layouts, for maps from integer keys to 64-byte values:
+// lookups, iteration, churn (erase one entry, insert another), and memory.
+// The "bytes_per_entry" counter reports the heap allocated by each map, via a
+// counting allocator, divided by the number of entries.
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/dense_flat_hash_map.h"
+#include "roo_collections/flat_small_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+struct Config {
+  uint32_t id;
+  char payload[60];
+};
+
+using Entry = std::pair<uint32_t, Config>;
+
+// Bytes currently allocated by all CountingAllocators.
+size_t allocated_bytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    allocated_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    allocated_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U>&) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const CountingAllocator<U>&) const {
+    return false;
+  }
+};
+
+using Flat = FlatSmallHashMap<uint32_t, Config, DefaultHashFn<uint32_t>,
+                              std::equal_to<uint32_t>,
+                              GroupProbing<LargeSizePolicy>,
+                              CountingAllocator<Entry>>;
+
+using Split =
+    FlatSmallHashMap<uint32_t, Config, DefaultHashFn<uint32_t>,
+                     std::equal_to<uint32_t>,
+                     SplitKeyValue<GroupProbing<LargeSizePolicy>>,
+                     CountingAllocator<Entry>>;
+
+using Dense = DenseFlatHashMap<uint32_t, Config, DefaultHashFn<uint32_t>,
+                               std::equal_to<uint32_t>,
+                               GroupProbing<LargeSizePolicy>,
+                               CountingAllocator<Entry>>;
+
+// Random keys; odd keys are inserted, and even keys are guaranteed misses.
+std::vector<uint32_t> randomKeys(size_t count, bool present) {
+  std::mt19937 rng(count);
+  std::vector<uint32_t> keys(count);
+  for (uint32_t& k : keys) k = (rng() | 1) ^ (present ? 0 : 1);
+  return keys;
+}
+
+template <typename Map>
+void fill(Map& map, const std::vector<uint32_t>& keys) {
+  for (uint32_t k : keys) map.try_emplace(k, Config{k, {}});
+}
+
+template <typename Map>
+void BM_FindHit(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(state.range(0), true);
+  Map map;
+  fill(map, keys);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize((*map.find(keys[i])).second.id);
+    if (++i == keys.size()) i = 0;
+  }
+}
+
+template <typename Map>
+void BM_FindMiss(benchmark::State& state) {
+  Map map;
+  fill(map, randomKeys(state.range(0), true));
+  std::vector<uint32_t> queries = randomKeys(state.range(0), false);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.contains(queries[i]));
+    if (++i == queries.size()) i = 0;
+  }
+}
+
+template <typename Map>
+void BM_Iterate(benchmark::State& state) {
+  Map map;
+  fill(map, randomKeys(state.range(0), true));
+  for (auto _ : state) {
+    uint32_t sum = 0;
+    for (const auto& e : map) sum += e.second.id;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * map.size());
+}
+
+// Erases the oldest key and inserts a new one, at a steady size.
+template <typename Map>
+void BM_Churn(benchmark::State& state) {
+  size_t n = state.range(0);
+  std::vector<uint32_t> keys = randomKeys(4 * n, true);
+  Map map;
+  for (size_t i = 0; i < n; ++i) map.try_emplace(keys[i], Config{});
+  size_t i = n;
+  for (auto _ : state) {
+    map.erase(keys[i - n]);
+    map.try_emplace(keys[i], Config{});
+    if (++i == keys.size()) {
+      state.PauseTiming();
+      map = Map();
+      for (i = 0; i < n; ++i) map.try_emplace(keys[i], Config{});
+      state.ResumeTiming();
+    }
+  }
+}
+
+template <typename Map>
+void BM_Memory(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(state.range(0), true);
+  size_t bytes = 0;
+  for (auto _ : state) {
+    size_t before = allocated_bytes;
+    Map map;
+    fill(map, keys);
+    bytes = allocated_bytes - before;
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.counters["bytes_per_entry"] = (double)bytes / keys.size();
+}
+
+// From a table that fits in L1 to one well beyond the last-level cache; the
+// middle size is just past a resize threshold, where the slot arrays are the
+// emptiest.
+void Sizes(benchmark::internal::Benchmark* b) {
+  for (int n : {500, 24000, 1000000}) b->Arg(n);
+}
+
+#define DENSE_BENCHMARK(name)                  \
+  BENCHMARK_TEMPLATE(name, Flat)->Apply(Sizes);  \
+  BENCHMARK_TEMPLATE(name, Split)->Apply(Sizes); \
+  BENCHMARK_TEMPLATE(name, Dense)->Apply(Sizes)
+
+DENSE_BENCHMARK(BM_FindHit);
+DENSE_BENCHMARK(BM_FindMiss);
+DENSE_BENCHMARK(BM_Iterate);
+DENSE_BENCHMARK(BM_Churn);
+DENSE_BENCHMARK(BM_Memory);
+
+}  // namespace
+}  // namespace roo_collections
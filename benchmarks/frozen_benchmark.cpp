@@ -0,0 +1,137 @@
+// Compares FrozenFlatHashMap, built at compile time, with a FlatSmallHashMap
+// built at run time from the same entries: the cost of building the latter,
+// which the former does not pay at all, and the cost of lookups in both.
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/frozen_flat_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+constexpr std::pair<roo::string_view, int> kTopicEntries[] = {
+    {"home/livingroom/temperature", 0}, {"home/livingroom/humidity", 1},
+    {"home/livingroom/light", 2},       {"home/livingroom/motion", 3},
+    {"home/kitchen/temperature", 4},    {"home/kitchen/humidity", 5},
+    {"home/kitchen/light", 6},          {"home/kitchen/motion", 7},
+    {"home/bedroom/temperature", 8},    {"home/bedroom/humidity", 9},
+    {"home/bedroom/light", 10},         {"home/bedroom/motion", 11},
+    {"home/bathroom/temperature", 12},  {"home/bathroom/humidity", 13},
+    {"home/bathroom/light", 14},        {"home/bathroom/motion", 15},
+    {"home/garage/door", 16},           {"home/garage/light", 17},
+    {"home/garden/sprinkler", 18},      {"home/garden/soil", 19},
+    {"home/boiler/pressure", 20},       {"home/boiler/flow", 21},
+    {"home/boiler/return", 22},         {"home/boiler/status", 23},
+    {"system/uptime", 24},              {"system/heap", 25},
+    {"system/wifi/rssi", 26},           {"system/wifi/ip", 27},
+    {"system/ota/status", 28},          {"system/ota/progress", 29},
+    {"system/reboot", 30},              {"system/config", 31},
+};
+
+constexpr FrozenFlatHashMap<roo::string_view, int, 32> kFrozenTopics(
+    kTopicEntries);
+
+struct IntEntries {
+  std::pair<int, int> entries[256];
+
+  constexpr IntEntries() : entries() {
+    for (int i = 0; i < 256; ++i) {
+      entries[i].first = i * 2654435761u;
+      entries[i].second = i;
+    }
+  }
+};
+
+constexpr IntEntries kIntEntries;
+constexpr FrozenFlatHashMap<int, int, 256> kFrozenInts(kIntEntries.entries);
+
+// Lookup keys, as they would arrive, e.g., in MQTT messages: in separate
+// buffers, half of them absent.
+std::vector<std::string> topicQueries() {
+  std::vector<std::string> queries;
+  for (const auto& e : kTopicEntries) {
+    queries.emplace_back(e.first);
+    queries.emplace_back(std::string(e.first) + "/set");
+  }
+  return queries;
+}
+
+std::vector<int> intQueries() {
+  std::vector<int> queries;
+  for (const auto& e : kIntEntries.entries) {
+    queries.push_back(e.first);
+    queries.push_back(e.first + 1);
+  }
+  return queries;
+}
+
+template <typename Map, typename Entries>
+Map build(const Entries& entries) {
+  Map map;
+  for (const auto& e : entries) map.insert(e);
+  return map;
+}
+
+void BM_BuildFlatTopics(benchmark::State& state) {
+  for (auto _ : state) {
+    auto map = build<FlatSmallHashMap<roo::string_view, int>>(kTopicEntries);
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * 32);
+}
+
+void BM_BuildFlatInts(benchmark::State& state) {
+  for (auto _ : state) {
+    auto map = build<FlatSmallHashMap<int, int>>(kIntEntries.entries);
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * 256);
+}
+
+template <typename Map, typename Query>
+void lookups(benchmark::State& state, const Map& map,
+             const std::vector<Query>& queries) {
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.contains(queries[i]));
+    if (++i == queries.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FindFrozenTopics(benchmark::State& state) {
+  auto queries = topicQueries();
+  std::vector<roo::string_view> views(queries.begin(), queries.end());
+  lookups(state, kFrozenTopics, views);
+}
+
+void BM_FindFlatTopics(benchmark::State& state) {
+  auto queries = topicQueries();
+  auto map = build<FlatSmallHashMap<roo::string_view, int>>(kTopicEntries);
+  std::vector<roo::string_view> views(queries.begin(), queries.end());
+  lookups(state, map, views);
+}
+
+void BM_FindFrozenInts(benchmark::State& state) {
+  lookups(state, kFrozenInts, intQueries());
+}
+
+void BM_FindFlatInts(benchmark::State& state) {
+  auto map = build<FlatSmallHashMap<int, int>>(kIntEntries.entries);
+  lookups(state, map, intQueries());
+}
+
+BENCHMARK(BM_BuildFlatTopics);
+BENCHMARK(BM_BuildFlatInts);
+BENCHMARK(BM_FindFrozenTopics);
+BENCHMARK(BM_FindFlatTopics);
+BENCHMARK(BM_FindFrozenInts);
+BENCHMARK(BM_FindFlatInts);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,85 @@
+// Measures full scans of a FlatSmallHashMap whose slot array is mostly empty:
+// a table of about 64k slots, at 10%, 30%, and 70% load. Compares a loop over
+// the iterators against for_each(), with the default single-slot policy and
+// with GroupProbing, and measures begin() on a table whose only entry sits in
+// the last slots.
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+template <typename Policy>
+using Map = FlatSmallHashMap<uint32_t, uint32_t, DefaultHashFn<uint32_t>,
+                             std::equal_to<uint32_t>, Policy>;
+
+// Returns a map of about 64k slots, filled to the given percentage.
+template <typename Policy>
+Map<Policy> sparseMap(int load_percent) {
+  Map<Policy> map;
+  map.reserve(46000);
+  size_t count = (size_t)map.ht_len() * load_percent / 100;
+  std::mt19937 rng(load_percent);
+  while (map.size() < count) map.insert({rng(), 1});
+  return map;
+}
+
+template <typename Policy>
+void BM_IterateLoop(benchmark::State& state) {
+  Map<Policy> map = sparseMap<Policy>(state.range(0));
+  for (auto _ : state) {
+    uint32_t sum = 0;
+    for (const auto& e : map) sum += e.second;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * map.size());
+}
+
+template <typename Policy>
+void BM_IterateForEach(benchmark::State& state) {
+  Map<Policy> map = sparseMap<Policy>(state.range(0));
+  for (auto _ : state) {
+    uint32_t sum = 0;
+    map.for_each([&](const std::pair<uint32_t, uint32_t>& e) {
+      sum += e.second;
+    });
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * map.size());
+}
+
+// Finds the only entry left in a large table: the last one in iteration
+// order, after all the others have been erased.
+template <typename Policy>
+void BM_BeginOfSparse(benchmark::State& state) {
+  Map<Policy> map = sparseMap<Policy>(30);
+  std::vector<uint32_t> keys;
+  for (const auto& e : map) keys.push_back(e.first);
+  keys.pop_back();
+  for (uint32_t k : keys) map.erase(k);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.begin());
+  }
+}
+
+void Loads(benchmark::internal::Benchmark* b) {
+  for (int load : {10, 30, 70}) b->Arg(load);
+}
+
+BENCHMARK_TEMPLATE(BM_IterateLoop, SmallSizePolicy)->Apply(Loads);
+BENCHMARK_TEMPLATE(BM_IterateForEach, SmallSizePolicy)->Apply(Loads);
+BENCHMARK_TEMPLATE(BM_IterateLoop, GroupProbing<SmallSizePolicy>)
+    ->Apply(Loads);
+BENCHMARK_TEMPLATE(BM_IterateForEach, GroupProbing<SmallSizePolicy>)
+    ->Apply(Loads);
+BENCHMARK_TEMPLATE(BM_BeginOfSparse, SmallSizePolicy);
+BENCHMARK_TEMPLATE(BM_BeginOfSparse, GroupProbing<SmallSizePolicy>);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,104 @@
+// Compares the per-insert latency distribution of FlatSmallHashMap, which
+// rehashes all at once, with IncrementalFlatHashMap, which spreads the
+// rehashing over subsequent operations. Reports latency percentiles (in
+// nanoseconds) as counters. Expect the incremental map to have the lower
+// maximum, but the higher p99 and p99.9, since every operation during a
+// migration also moves a few entries.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/incremental_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+using OneShotMap =
+    FlatSmallHashMap<uint32_t, uint32_t, DefaultHashFn<uint32_t>,
+                     std::equal_to<uint32_t>, LargeSizePolicy>;
+
+using IncrementalMap =
+    IncrementalFlatHashMap<uint32_t, uint32_t, DefaultHashFn<uint32_t>,
+                           std::equal_to<uint32_t>, LargeSizePolicy>;
+
+void reportPercentiles(benchmark::State& state,
+                       std::vector<uint32_t>& latencies) {
+  std::sort(latencies.begin(), latencies.end());
+  auto at = [&](double q) {
+    return (double)latencies[(size_t)(q * (latencies.size() - 1))];
+  };
+  state.counters["p50_ns"] = at(0.5);
+  state.counters["p99_ns"] = at(0.99);
+  state.counters["p99.9_ns"] = at(0.999);
+  state.counters["p99.99_ns"] = at(0.9999);
+  state.counters["max_ns"] = latencies.back();
+}
+
+// Grows a map from empty to the given size, one timed insert at a time.
+template <typename Map>
+void BM_InsertLatency(benchmark::State& state) {
+  std::mt19937 rng(state.range(0));
+  std::vector<uint32_t> keys(state.range(0));
+  for (uint32_t& k : keys) k = rng();
+  std::vector<uint32_t> latencies;
+  latencies.reserve(keys.size() * 4);
+  for (auto _ : state) {
+    Map map;
+    for (uint32_t k : keys) {
+      auto start = std::chrono::steady_clock::now();
+      map[k] = k;
+      auto end = std::chrono::steady_clock::now();
+      latencies.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+              .count());
+    }
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  reportPercentiles(state, latencies);
+}
+
+// Keeps the map at a steady size while replacing its keys, one timed erase and
+// insert pair at a time. Tombstones build up and periodically force cleanup.
+template <typename Map>
+void BM_ChurnLatency(benchmark::State& state) {
+  size_t size = state.range(0);
+  std::mt19937 rng(size);
+  std::vector<uint32_t> keys(4 * size);
+  for (uint32_t& k : keys) k = rng();
+  Map map;
+  for (size_t i = 0; i < size; ++i) map[keys[i]] = i;
+  std::vector<uint32_t> latencies;
+  size_t i = 0;
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    map.erase(keys[i]);
+    map[keys[(i + size) % keys.size()]] = i;
+    auto end = std::chrono::steady_clock::now();
+    latencies.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+    if (++i == keys.size()) i = 0;
+  }
+  reportPercentiles(state, latencies);
+}
+
+BENCHMARK_TEMPLATE(BM_InsertLatency, OneShotMap)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_InsertLatency, IncrementalMap)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_ChurnLatency, OneShotMap)->Arg(100000)->Arg(1000000);
+BENCHMARK_TEMPLATE(BM_ChurnLatency, IncrementalMap)->Arg(100000)->Arg(1000000);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,217 @@
+// Compares single-slot probing against group probing, for successful and
+// unsuccessful lookups (one by one, and batched), inserts, and steady-size
+// churn at a range of table sizes.
+
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_small_hash_set.h"
+
+namespace roo_collections {
+namespace {
+
+using ScalarSet = FlatSmallHashSet<uint32_t, DefaultHashFn<uint32_t>,
+                                   std::equal_to<uint32_t>, LargeSizePolicy>;
+
+using GroupSet =
+    FlatSmallHashSet<uint32_t, DefaultHashFn<uint32_t>,
+                     std::equal_to<uint32_t>, GroupProbing<LargeSizePolicy>>;
+
+using PortableGroupSet = FlatSmallHashSet<
+    uint32_t, DefaultHashFn<uint32_t>, std::equal_to<uint32_t>,
+    GroupProbing<LargeSizePolicy, PortableControlGroup>>;
+
+using ScalarStringSet =
+    FlatSmallHashSet<std::string, DefaultHashFn<std::string>,
+                     std::equal_to<std::string>, LargeSizePolicy>;
+
+using GroupStringSet =
+    FlatSmallHashSet<std::string, DefaultHashFn<std::string>,
+                     std::equal_to<std::string>, GroupProbing<LargeSizePolicy>>;
+
+using StoredHashStringSet = FlatSmallHashSet<
+    std::string, DefaultHashFn<std::string>, std::equal_to<std::string>,
+    StoredHash<GroupProbing<LargeSizePolicy>>>;
+
+using SmallStringSet = FlatSmallHashSet<SmallString<32>>;
+
+// Random keys; odd keys are inserted, and even keys are guaranteed misses.
+std::vector<uint32_t> randomKeys(size_t count, bool present) {
+  std::mt19937 rng(count);
+  std::vector<uint32_t> keys(count);
+  for (uint32_t& k : keys) k = (rng() | 1) ^ (present ? 0 : 1);
+  return keys;
+}
+
+std::vector<std::string> stringKeys(const std::vector<uint32_t>& keys) {
+  std::vector<std::string> result;
+  for (uint32_t k : keys) {
+    result.push_back("/devices/sensor/" + std::to_string(k) + "/value");
+  }
+  return result;
+}
+
+// Inserts `count` keys, so that the table ends up filled close to its
+// resize threshold, which is where probe sequences are longest.
+template <typename Set, typename K>
+void fill(Set& set, const std::vector<K>& keys) {
+  for (const K& k : keys) set.insert(k);
+}
+
+template <typename Set>
+void BM_FindHit(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(state.range(0), true);
+  Set set;
+  fill(set, keys);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(keys[i]));
+    if (++i == keys.size()) i = 0;
+  }
+  state.counters["load"] = (double)set.size() / set.ht_len();
+}
+
+template <typename Set>
+void BM_FindMiss(benchmark::State& state) {
+  Set set;
+  fill(set, randomKeys(state.range(0), true));
+  std::vector<uint32_t> misses = randomKeys(state.range(0), false);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(misses[i]));
+    if (++i == misses.size()) i = 0;
+  }
+  state.counters["load"] = (double)set.size() / set.ht_len();
+}
+
+template <typename Set>
+void BM_FindStringMiss(benchmark::State& state) {
+  Set set;
+  fill(set, stringKeys(randomKeys(state.range(0), true)));
+  std::vector<std::string> misses =
+      stringKeys(randomKeys(state.range(0), false));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(misses[i]));
+    if (++i == misses.size()) i = 0;
+  }
+}
+
+// Successful lookups with keys of the set's own type, e.g. SmallString, which
+// hash and compare the stored strings directly.
+template <typename Set>
+void BM_FindStringHit(benchmark::State& state) {
+  std::vector<std::string> strings =
+      stringKeys(randomKeys(state.range(0), true));
+  std::vector<typename Set::value_type> keys(strings.begin(), strings.end());
+  Set set;
+  fill(set, keys);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(keys[i]));
+    if (++i == keys.size()) i = 0;
+  }
+}
+
+template <typename Set>
+void BM_InsertString(benchmark::State& state) {
+  std::vector<std::string> keys = stringKeys(randomKeys(state.range(0), true));
+  for (auto _ : state) {
+    Set set;
+    fill(set, keys);
+    benchmark::DoNotOptimize(set.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Looks up keys in bursts of 32, with contains() or contains_batch().
+template <typename Set, bool kBatched>
+void BM_FindBurst(benchmark::State& state) {
+  static constexpr size_t kBurst = 32;
+  Set set;
+  fill(set, randomKeys(state.range(0), true));
+  // All hits if the second argument is 1, all misses if it is 0.
+  std::vector<uint32_t> keys = randomKeys(state.range(0), state.range(1));
+  keys.resize(keys.size() / kBurst * kBurst);
+  bool results[kBurst];
+  size_t i = 0;
+  for (auto _ : state) {
+    if (kBatched) {
+      set.contains_batch(&keys[i], kBurst, results);
+    } else {
+      for (size_t j = 0; j < kBurst; ++j) {
+        results[j] = set.contains(keys[i + j]);
+      }
+    }
+    benchmark::DoNotOptimize(results);
+    i += kBurst;
+    if (i == keys.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations() * kBurst);
+}
+
+template <typename Set>
+void BM_Insert(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(state.range(0), true);
+  for (auto _ : state) {
+    Set set;
+    fill(set, keys);
+    benchmark::DoNotOptimize(set.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Erases the oldest key and inserts a new one, keeping the size constant, so
+// that tombstones keep building up and getting purged.
+template <typename Set>
+void BM_Churn(benchmark::State& state) {
+  std::vector<uint32_t> keys = randomKeys(2 * state.range(0), true);
+  size_t window = state.range(0);
+  Set set;
+  fill(set, std::vector<uint32_t>(keys.begin(), keys.begin() + window));
+  size_t i = 0;
+  for (auto _ : state) {
+    set.erase(keys[i]);
+    set.insert(keys[(i + window) % keys.size()]);
+    if (++i == keys.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Sizes just below the resize thresholds (0.73 of the Radke primes), to
+// exercise the longest probe sequences.
+void Sizes(benchmark::internal::Benchmark* b) {
+  for (int n : {740, 5970, 47800, 382000, 1530000}) b->Arg(n);
+}
+
+BENCHMARK_TEMPLATE(BM_FindHit, ScalarSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindHit, GroupSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindHit, PortableGroupSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindMiss, ScalarSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindMiss, GroupSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindMiss, PortableGroupSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindStringMiss, ScalarStringSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindStringMiss, GroupStringSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindStringMiss, StoredHashStringSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindStringHit, SmallStringSet)->Arg(740)->Arg(5970);
+BENCHMARK_TEMPLATE(BM_Insert, ScalarSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_Insert, GroupSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_InsertString, GroupStringSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_InsertString, StoredHashStringSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindBurst, ScalarSet, false)
+    ->ArgsProduct({{5970, 382000, 1530000}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_FindBurst, ScalarSet, true)
+    ->ArgsProduct({{5970, 382000, 1530000}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_FindBurst, GroupSet, false)
+    ->ArgsProduct({{5970, 382000, 1530000}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_FindBurst, GroupSet, true)
+    ->ArgsProduct({{5970, 382000, 1530000}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_Churn, ScalarSet)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_Churn, GroupSet)->Apply(Sizes);
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,97 @@
+// Measures the update throughput of shared per-flow counters: a
+// FlatSmallHashMap behind a single std::mutex, vs a ShardedFlatHashMap. Run
+// with --benchmark_counters_tabular=true; the items_per_second counter is the
+// aggregate over all threads, and should grow roughly linearly with the
+// thread count for ShardedFlatHashMap, up to the number of cores.
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/sharded_flat_hash_map.h"
+
+namespace roo_collections {
+namespace {
+
+constexpr uint32_t kFlows = 10000;
+
+struct SingleMutexMap {
+  FlatSmallHashMap<uint32_t, uint64_t> map;
+  std::mutex mutex;
+
+  void increment(uint32_t flow) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++map[flow];
+  }
+
+  bool contains(uint32_t flow) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return map.contains(flow);
+  }
+};
+
+struct ShardedMap {
+  ShardedFlatHashMap<uint32_t, uint64_t> map;
+
+  void increment(uint32_t flow) {
+    map.update(flow, [](uint64_t& count) { ++count; });
+  }
+
+  bool contains(uint32_t flow) { return map.contains(flow); }
+};
+
+// Shared by the threads of a benchmark run. Thread 0 sets it up and tears it
+// down; the others wait at the start and end of the timed loop.
+template <typename Container>
+Container* container;
+
+// Returns the ID of a random one of kFlows flows. Uses xorshift, so that
+// every thread touches the flows in a different order. The IDs are scattered
+// over the whole 32-bit range, like those derived from 5-tuples; with dense
+// small integers, the identity hash would make a single table unrealistically
+// free of collisions.
+inline uint32_t nextFlow(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return fmix32(state % kFlows);
+}
+
+template <typename Container>
+void BM_Increment(benchmark::State& state) {
+  if (state.thread_index() == 0) container<Container> = new Container();
+  uint32_t rng = 2463534242u + state.thread_index();
+  for (auto _ : state) {
+    container<Container>->increment(nextFlow(rng));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) delete container<Container>;
+}
+
+// Mostly lookups, with one update in 8 operations.
+template <typename Container>
+void BM_Mixed(benchmark::State& state) {
+  if (state.thread_index() == 0) container<Container> = new Container();
+  uint32_t rng = 2463534242u + state.thread_index();
+  uint32_t i = 0;
+  for (auto _ : state) {
+    if (++i % 8 == 0) {
+      container<Container>->increment(nextFlow(rng));
+    } else {
+      benchmark::DoNotOptimize(container<Container>->contains(nextFlow(rng)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) delete container<Container>;
+}
+
+BENCHMARK_TEMPLATE(BM_Increment, SingleMutexMap)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Increment, ShardedMap)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Mixed, SingleMutexMap)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Mixed, ShardedMap)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace
+}  // namespace roo_collections
@@ -0,0 +1,99 @@
+// Compares the cold start of a large read-only string dictionary: building a
+// FlatSmallHashMap from its entries, vs attaching a FlatSmallHashMapSnapshot
+// to a serialized image of it; and the cost of lookups in both.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "roo_collections/flat_hashtable_snapshot.h"
+
+namespace roo_collections {
+namespace {
+
+using Dict = FlatSmallHashMap<std::string, int, TransparentStringHashFn,
+                              TransparentEq, LargeSizePolicy>;
+using DictSnapshot =
+    FlatSmallHashMapSnapshot<std::string, int, TransparentStringHashFn,
+                             LargeSizePolicy>;
+
+std::vector<std::pair<std::string, int>> entries(int count) {
+  std::vector<std::pair<std::string, int>> result;
+  for (int i = 0; i < count; ++i) {
+    result.emplace_back("dictionary/word/" + std::to_string(i * 2654435761u),
+                        i);
+  }
+  return result;
+}
+
+// Lookup keys, half of them absent, in random order.
+std::vector<std::string> queries(
+    const std::vector<std::pair<std::string, int>>& entries) {
+  std::vector<std::string> result;
+  for (const auto& e : entries) {
+    result.push_back(e.first);
+    result.push_back(e.first + "/");
+  }
+  std::shuffle(result.begin(), result.end(), std::mt19937(42));
+  return result;
+}
+
+void BM_BuildMap(benchmark::State& state) {
+  auto source = entries(state.range(0));
+  for (auto _ : state) {
+    Dict dict(source.begin(), source.end());
+    benchmark::DoNotOptimize(dict.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_AttachSnapshot(benchmark::State& state) {
+  auto source = entries(state.range(0));
+  std::vector<char> image =
+      serializeSnapshot(Dict(source.begin(), source.end()));
+  for (auto _ : state) {
+    DictSnapshot snapshot;
+    benchmark::DoNotOptimize(snapshot.attach(image.data(), image.size()));
+    benchmark::DoNotOptimize(snapshot.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Container>
+void lookups(benchmark::State& state, const Container& container,
+             const std::vector<std::string>& queries) {
+  std::vector<roo::string_view> views(queries.begin(), queries.end());
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(container.contains(views[i]));
+    if (++i == views.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FindMap(benchmark::State& state) {
+  auto source = entries(state.range(0));
+  Dict dict(source.begin(), source.end());
+  lookups(state, dict, queries(source));
+}
+
+void BM_FindSnapshot(benchmark::State& state) {
+  auto source = entries(state.range(0));
+  std::vector<char> image =
+      serializeSnapshot(Dict(source.begin(), source.end()));
+  DictSnapshot snapshot;
+  snapshot.attach(image.data(), image.size());
+  lookups(state, snapshot, queries(source));
+}
+
+BENCHMARK(BM_BuildMap)->Arg(1000)->Arg(100000);
+BENCHMARK(BM_AttachSnapshot)->Arg(1000)->Arg(100000);
+BENCHMARK(BM_FindMap)->Arg(1000)->Arg(100000);
+BENCHMARK(BM_FindSnapshot)->Arg(1000)->Arg(100000);
+
+}  // namespace
+}  // namespace roo_collections
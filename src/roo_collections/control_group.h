@@ -0,0 +1,210 @@
+#pragma once
+
+/// @file
+/// @brief Control-byte groups used to probe several hashtable slots at once.
+/// @ingroup roo_collections
+
+#include <inttypes.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace roo_collections {
+
+// A group is a run of consecutive control bytes of a hashtable, starting at
+// an arbitrary slot, that can be matched against a given state all at once.
+// Empty slots are always marked with a zero control byte, and deleted slots
+// (tombstones) with one. Full slots, and only they, have the high bit set.
+
+/// @brief Bit mask of slots within a group, iterated from the lowest slot.
+///
+/// Each slot is represented by `2^Shift` consecutive bits, of which only the
+/// highest may be set.
+template <typename T, int Shift>
+class GroupMask {
+ public:
+  explicit GroupMask(T mask) : mask_(mask) {}
+
+  /// @brief Returns whether any slot is set.
+  explicit operator bool() const { return mask_ != 0; }
+
+  /// @brief Returns the offset of the lowest set slot. Requires a non-empty
+  /// mask.
+  int lowest() const {
+    return (sizeof(T) > 4 ? __builtin_ctzll(mask_) : __builtin_ctz(mask_)) >>
+           Shift;
+  }
+
+  /// @brief Removes the lowest set slot from the mask.
+  void clearLowest() { mask_ &= (mask_ - 1); }
+
+ private:
+  T mask_;
+};
+
+/// @brief Mask over a single slot.
+class SingleSlotMask {
+ public:
+  explicit SingleSlotMask(bool set) : set_(set) {}
+
+  explicit operator bool() const { return set_; }
+
+  int lowest() const { return 0; }
+
+  void clearLowest() { set_ = false; }
+
+ private:
+  bool set_;
+};
+
+/// @brief Degenerate group of a single control byte.
+///
+/// Probing with it is exactly the classic slot-at-a-time loop. This is what
+/// the default size policies use.
+class SingleSlotGroup {
+ public:
+  using Mask = SingleSlotMask;
+  static constexpr int kWidth = 1;
+
+  explicit SingleSlotGroup(const int8_t* ctrl) : ctrl_(*ctrl) {}
+
+  /// @brief Returns the slots whose control byte equals `state`.
+  Mask match(int8_t state) const { return Mask(ctrl_ == state); }
+
+  /// @brief Returns the empty slots.
+  Mask matchEmpty() const { return Mask(ctrl_ == 0); }
+
+  /// @brief Returns the empty and the deleted slots.
+  Mask matchEmptyOrDeleted() const { return Mask((uint8_t)ctrl_ <= 1); }
+
+  /// @brief Returns the full slots, i.e. those with the high bit set.
+  Mask matchFull() const { return Mask(ctrl_ < 0); }
+
+ private:
+  int8_t ctrl_;
+};
+
+/// @brief Portable group of 8 control bytes, compared in a 64-bit word.
+///
+/// Used where no SIMD instructions are available; works on any target.
+class PortableControlGroup {
+ public:
+  using Mask = GroupMask<uint64_t, 3>;
+  static constexpr int kWidth = 8;
+
+  explicit PortableControlGroup(const int8_t* ctrl) {
+    memcpy(&ctrl_, ctrl, sizeof(ctrl_));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // Keep the first slot in the lowest byte.
+    ctrl_ = __builtin_bswap64(ctrl_);
+#endif
+  }
+
+  Mask match(int8_t state) const {
+    return Mask(zeroBytes(ctrl_ ^ (kLsbs * (uint8_t)state)));
+  }
+
+  Mask matchEmpty() const { return Mask(zeroBytes(ctrl_)); }
+
+  Mask matchEmptyOrDeleted() const {
+    return Mask(zeroBytes(ctrl_) | zeroBytes(ctrl_ ^ kLsbs));
+  }
+
+  Mask matchFull() const { return Mask(ctrl_ & kMsbs); }
+
+ private:
+  static constexpr uint64_t kLsbs = 0x0101010101010101ULL;
+  static constexpr uint64_t kLow7 = 0x7F7F7F7F7F7F7F7FULL;
+  static constexpr uint64_t kMsbs = 0x8080808080808080ULL;
+
+  // Returns the high bit set in exactly those bytes of `x` that are zero. No
+  // borrows cross byte boundaries, so there are no false positives.
+  static uint64_t zeroBytes(uint64_t x) {
+    return ~(((x & kLow7) + kLow7) | x | kLow7);
+  }
+
+  uint64_t ctrl_;
+};
+
+#if defined(__SSE2__)
+
+/// @brief Group of 16 control bytes, compared with SSE2.
+class Sse2ControlGroup {
+ public:
+  using Mask = GroupMask<uint32_t, 0>;
+  static constexpr int kWidth = 16;
+
+  explicit Sse2ControlGroup(const int8_t* ctrl)
+      : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+  Mask match(int8_t state) const {
+    return Mask(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(state))));
+  }
+
+  Mask matchEmpty() const { return match(0); }
+
+  Mask matchEmptyOrDeleted() const {
+    return Mask(_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(ctrl_, _mm_setzero_si128()),
+                     _mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(1)))));
+  }
+
+  Mask matchFull() const { return Mask(_mm_movemask_epi8(ctrl_)); }
+
+ private:
+  __m128i ctrl_;
+};
+
+#endif
+
+#if defined(__AVX2__)
+
+/// @brief Group of 32 control bytes, compared with AVX2.
+class Avx2ControlGroup {
+ public:
+  using Mask = GroupMask<uint32_t, 0>;
+  static constexpr int kWidth = 32;
+
+  explicit Avx2ControlGroup(const int8_t* ctrl)
+      : ctrl_(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ctrl))) {}
+
+  Mask match(int8_t state) const {
+    return Mask((uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(ctrl_, _mm256_set1_epi8(state))));
+  }
+
+  Mask matchEmpty() const { return match(0); }
+
+  Mask matchEmptyOrDeleted() const {
+    return Mask((uint32_t)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(ctrl_, _mm256_setzero_si256()),
+                        _mm256_cmpeq_epi8(ctrl_, _mm256_set1_epi8(1)))));
+  }
+
+  Mask matchFull() const {
+    return Mask((uint32_t)_mm256_movemask_epi8(ctrl_));
+  }
+
+ private:
+  __m256i ctrl_;
+};
+
+#endif
+
+/// @brief The widest control group supported by the target.
+#if defined(__AVX2__)
+using ControlGroup = Avx2ControlGroup;
+#elif defined(__SSE2__)
+using ControlGroup = Sse2ControlGroup;
+#else
+using ControlGroup = PortableControlGroup;
+#endif
+
+}  // namespace roo_collections
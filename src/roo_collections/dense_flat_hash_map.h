@@ -0,0 +1,621 @@
+#pragma once
+
+/// @file
+/// @brief Hash map that keeps its entries packed in a vector, indexed by a
+/// flat table of slot indices.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "roo_collections/flat_small_hash_map.h"
+
+namespace roo_collections {
+
+/// @brief Hash map for heavy values, or for maps that are iterated often.
+///
+/// Keeps the entries contiguous, in insertion order, in a `std::vector`, and
+/// looks them up through a separate table of slots, each with a control byte
+/// (the same 7-bit tags as `FlatSmallHashtable`) and the index of an entry.
+/// An empty slot thus costs 3 bytes with `SmallSizePolicy`, and 5 with
+/// `LargeSizePolicy`, rather than `sizeof(std::pair<Key, Value>)`. Iterators
+/// are plain pointers into the vector, and iteration is a linear scan with no
+/// empty slots in between. The price is one more memory access per lookup,
+/// and, as with any vector, up to twice the size in spare capacity after
+/// growing, unless `reserve()`d up front.
+///
+/// `erase()` moves the last entry into the place of the erased one, and pops
+/// it (swap-and-pop), so it changes the order of the entries, and costs an
+/// extra probe to repoint the slot of the moved entry. Like a vector, any
+/// insert or erase may invalidate iterators and references to entries.
+/// Erasing while iterating is supported: `erase(it)` returns `it`, which then
+/// points to the moved entry, or `end()`.
+///
+/// The slot table is rebuilt from the keys when it grows, so the entries
+/// themselves never move then. Supports `GroupProbing` and
+/// `PowerOfTwoCapacity`, but neither `StoredHash` nor `FixedCapacity`.
+///
+/// @tparam Key Key type.
+/// @tparam Value Mapped value type.
+/// @tparam HashFn Hash function type.
+/// @tparam KeyCmpFn Key equality predicate type.
+/// @tparam SizePolicy Width of the slot indices, probing, and capacities; see
+/// `SmallSizePolicy` and `LargeSizePolicy`.
+/// @tparam Allocator Allocator of `std::pair<Key, Value>` entries. It is
+/// rebound to allocate the slot table too.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
+class DenseFlatHashMap {
+  static_assert(!SizePolicy::kStoreHash,
+                "DenseFlatHashMap does not support StoredHash");
+  static_assert(!SizePolicy::kFixedCapacity,
+                "DenseFlatHashMap does not support FixedCapacity");
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using size_type = typename SizePolicy::index_type;
+  using hasher = HashFn;
+  using key_equal = KeyCmpFn;
+  using allocator_type = Allocator;
+  using iterator = value_type*;
+  using const_iterator = const value_type*;
+
+  /// @brief Creates an empty map.
+  DenseFlatHashMap(HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : hash_fn_(hash_fn),
+        key_cmp_fn_(key_cmp_fn),
+        entries_(alloc),
+        states_(alloc),
+        indices_(alloc),
+        capacity_idx_(0),
+        erased_(0),
+        resize_threshold_(0) {}
+
+  /// @brief Creates an empty map that uses the given allocator.
+  explicit DenseFlatHashMap(const Allocator& alloc)
+      : DenseFlatHashMap(HashFn(), KeyCmpFn(), alloc) {}
+
+  /// @brief Creates a map with room for `size_hint` entries.
+  DenseFlatHashMap(size_type size_hint, HashFn hash_fn = HashFn(),
+                   KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : DenseFlatHashMap(hash_fn, key_cmp_fn, alloc) {
+    reserve(size_hint);
+  }
+
+  /// @brief Builds a map from an iterator range. Of entries with equal keys,
+  /// the first one wins.
+  template <typename InputIt>
+  DenseFlatHashMap(InputIt first, InputIt last, HashFn hash_fn = HashFn(),
+                   KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : DenseFlatHashMap(hash_fn, key_cmp_fn, alloc) {
+    reserveForRange(
+        first, last,
+        typename std::iterator_traits<InputIt>::iterator_category());
+    for (; first != last; ++first) insert(*first);
+  }
+
+  /// @brief Builds a map from an initializer list.
+  DenseFlatHashMap(std::initializer_list<value_type> init,
+                   HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : DenseFlatHashMap(init.begin(), init.end(), hash_fn, key_cmp_fn,
+                         alloc) {}
+
+  /// @brief Copy constructor.
+  DenseFlatHashMap(const DenseFlatHashMap& other) = default;
+
+  /// @brief Move constructor. Leaves `other` empty and reusable.
+  DenseFlatHashMap(DenseFlatHashMap&& other)
+      : hash_fn_(std::move(other.hash_fn_)),
+        key_cmp_fn_(std::move(other.key_cmp_fn_)),
+        entries_(std::move(other.entries_)),
+        states_(std::move(other.states_)),
+        indices_(std::move(other.indices_)),
+        capacity_idx_(other.capacity_idx_),
+        erased_(other.erased_),
+        resize_threshold_(other.resize_threshold_) {
+    other.resetToEmpty();
+  }
+
+  /// @brief Copy assignment.
+  DenseFlatHashMap& operator=(const DenseFlatHashMap& other) = default;
+
+  /// @brief Move assignment. Leaves `other` empty and reusable.
+  DenseFlatHashMap& operator=(DenseFlatHashMap&& other) {
+    if (this == &other) return *this;
+    hash_fn_ = std::move(other.hash_fn_);
+    key_cmp_fn_ = std::move(other.key_cmp_fn_);
+    entries_ = std::move(other.entries_);
+    states_ = std::move(other.states_);
+    indices_ = std::move(other.indices_);
+    capacity_idx_ = other.capacity_idx_;
+    erased_ = other.erased_;
+    resize_threshold_ = other.resize_threshold_;
+    other.resetToEmpty();
+    return *this;
+  }
+
+  /// @brief Returns a copy of the allocator.
+  allocator_type get_allocator() const { return entries_.get_allocator(); }
+
+  /// @brief Returns a pointer to the first entry.
+  iterator begin() { return entries_.data(); }
+  const_iterator begin() const { return entries_.data(); }
+
+  /// @brief Returns a pointer past the last entry.
+  iterator end() { return entries_.data() + entries_.size(); }
+  const_iterator end() const { return entries_.data() + entries_.size(); }
+
+  /// @brief Returns the number of entries.
+  size_type size() const { return entries_.size(); }
+
+  /// @brief Returns whether the map is empty.
+  bool empty() const { return entries_.empty(); }
+
+  /// @brief Returns the number of entries insertable before the slot table
+  /// grows.
+  size_type capacity() const { return resize_threshold_; }
+
+  /// @brief Returns the length of the slot table.
+  size_type ht_len() const {
+    return capacity_idx_ == 0 ? 0 : SizePolicy::htLen(capacity_idx_);
+  }
+
+  /// @brief Returns the number of tombstones in the slot table.
+  size_type tombstones() const { return erased_; }
+
+  /// @brief Finds `key` and returns a pointer to its entry, or `end()`.
+  iterator find(const Key& key) { return entryAt(findSlot(key)); }
+
+  /// @brief Heterogeneous lookup overload of `find`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  iterator find(const K& key) {
+    return entryAt(findSlot(key));
+  }
+
+  /// @brief Const overload of `find`.
+  const_iterator find(const Key& key) const { return entryAt(findSlot(key)); }
+
+  /// @brief Heterogeneous const overload of `find`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  const_iterator find(const K& key) const {
+    return entryAt(findSlot(key));
+  }
+
+  /// @brief Returns whether `key` is present.
+  bool contains(const Key& key) const { return findSlot(key) != kNone; }
+
+  /// @brief Heterogeneous key overload of `contains`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  bool contains(const K& key) const {
+    return findSlot(key) != kNone;
+  }
+
+  /// @brief Returns the value for `key`. Asserts in debug builds if `key` is
+  /// not present.
+  const Value& at(const Key& key) const {
+    auto it = find(key);
+    assert(it != end());
+    return it->second;
+  }
+
+  /// @brief Heterogeneous key overload of `at`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  const Value& at(const K& key) const {
+    auto it = find(key);
+    assert(it != end());
+    return it->second;
+  }
+
+  /// @brief Mutable overload of `at`.
+  Value& at(const Key& key) {
+    auto it = find(key);
+    assert(it != end());
+    return it->second;
+  }
+
+  /// @brief Heterogeneous mutable overload of `at`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  Value& at(const K& key) {
+    auto it = find(key);
+    assert(it != end());
+    return it->second;
+  }
+
+  /// @brief Returns the value for `key`, inserting a default-constructed one
+  /// if `key` is not present.
+  Value& operator[](const Key& key) { return try_emplace(key).first->second; }
+
+  /// @brief Heterogeneous key overload of `operator[]`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  Value& operator[](const K& key) {
+    return try_emplace(key).first->second;
+  }
+
+  /// @brief Appends a value constructed from `args` under `key`, if `key` is
+  /// not present. Nothing is constructed otherwise. If the map is full at
+  /// the largest capacity of its size policy, nothing is inserted, and the
+  /// result is `{end(), false}`.
+  /// @return Pair of iterator and insertion flag.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    return tryEmplace(key, std::piecewise_construct,
+                      std::forward_as_tuple(key),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Move-key overload of `try_emplace`. `key` is moved from only if
+  /// the entry gets inserted.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    return tryEmplace(key, std::piecewise_construct,
+                      std::forward_as_tuple(std::move(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Heterogeneous overload of `try_emplace`. The stored key is
+  /// converted from `key` only if the entry gets inserted.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>, typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return tryEmplace(key, std::piecewise_construct,
+                      std::forward_as_tuple(LazyKeyCovert<Key, K>{key}),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Appends a copy of `entry`, if its key is not present.
+  std::pair<iterator, bool> insert(const value_type& entry) {
+    return tryEmplace(entry.first, entry);
+  }
+
+  /// @brief Moves `entry` into the map, if its key is not present.
+  std::pair<iterator, bool> insert(value_type&& entry) {
+    return tryEmplace(entry.first, std::move(entry));
+  }
+
+  /// @brief Inserts `obj` under `key`, or assigns it to the existing value.
+  /// @return Pair of iterator and insertion flag.
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second && result.first != end()) {
+      result.first->second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  /// @brief Move-key overload of `insert_or_assign`.
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj) {
+    auto result = try_emplace(std::move(key), std::forward<M>(obj));
+    if (!result.second && result.first != end()) {
+      result.first->second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  /// @brief Removes the entry with `key`, moving the last entry into its
+  /// place. Returns whether it was present.
+  bool erase(const Key& key) {
+    size_type slot = findSlot(key);
+    if (slot == kNone) return false;
+    eraseSlot(slot);
+    return true;
+  }
+
+  /// @brief Heterogeneous key overload of `erase`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  bool erase(const K& key) {
+    size_type slot = findSlot(key);
+    if (slot == kNone) return false;
+    eraseSlot(slot);
+    return true;
+  }
+
+  /// @brief Removes the entry at `pos`, moving the last entry into its place.
+  /// Returns an iterator to the same position, which holds the moved entry,
+  /// or is `end()`.
+  iterator erase(const_iterator pos) {
+    size_type index = pos - begin();
+    eraseSlot(slotOf(index, hashAt(index)));
+    return begin() + index;
+  }
+
+  /// @brief Removes all entries. Keeps the slot table, and the capacity of
+  /// the vector.
+  void clear() {
+    entries_.clear();
+    std::fill(states_.begin(), states_.begin() + ht_len(), EMPTY);
+    erased_ = 0;
+  }
+
+  /// @brief Makes room for at least `n` entries, so that inserting up to that
+  /// many will neither grow the vector nor rebuild the slot table.
+  void reserve(size_type n) {
+    entries_.reserve(n);
+    if (n > resize_threshold_) rebuild(initialCapacityIdx<SizePolicy>(n));
+  }
+
+  /// @brief Shrinks the vector and the slot table to fit the current
+  /// entries, dropping tombstones.
+  void shrink_to_fit() {
+    entries_.shrink_to_fit();
+    rebuild(initialCapacityIdx<SizePolicy>(size()));
+  }
+
+  /// @brief Equality comparison by key/value content, regardless of order.
+  bool operator==(const DenseFlatHashMap& other) const {
+    if (other.size() != size()) return false;
+    for (const value_type& e : *this) {
+      auto it = other.find(e.first);
+      if (it == other.end() || it->second != e.second) return false;
+    }
+    return true;
+  }
+
+  bool operator!=(const DenseFlatHashMap& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  using Group = typename SizePolicy::group_type;
+  static constexpr int kGroupPadding = Group::kWidth - 1;
+
+  using ProbeSeq = typename SizePolicy::template probe_seq<Group::kWidth>;
+
+  // Control bytes, as in FlatSmallHashtable: full slots hold 0x80 + the
+  // 7-bit tag of the hash.
+  using State = int8_t;
+  static constexpr State EMPTY = 0;
+  static constexpr State DELETED = 1;
+  static constexpr State PADDING = 2;
+
+  static constexpr size_type kNone = (size_type)-1;
+
+  using AllocTraits = std::allocator_traits<Allocator>;
+  using StateVector =
+      std::vector<State, typename AllocTraits::template rebind_alloc<State>>;
+  using IndexVector =
+      std::vector<size_type,
+                  typename AllocTraits::template rebind_alloc<size_type>>;
+
+  static State fullState(size_t hash) {
+    return SizePolicy::hashTag(hash) | 0x80;
+  }
+
+  iterator entryAt(size_type slot) {
+    return slot == kNone ? end() : begin() + indices_[slot];
+  }
+
+  const_iterator entryAt(size_type slot) const {
+    return slot == kNone ? end() : begin() + indices_[slot];
+  }
+
+  size_t hashAt(size_type index) const {
+    return hash_fn_(entries_[index].first);
+  }
+
+  // Returns the slot that indexes the entry with the given key, or kNone.
+  template <typename K>
+  size_type findSlot(const K& key) const {
+    if (empty()) return kNone;
+    size_t hash = hash_fn_(key);
+    const State tag = fullState(hash);
+    ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len());
+    while (true) {
+      Group group(&states_[seq.pos()]);
+      for (typename Group::Mask match = group.match(tag); match;
+           match.clearLowest()) {
+        size_type p = seq.pos() + match.lowest();
+        if (key_cmp_fn_(entries_[indices_[p]].first, key)) return p;
+      }
+      if (group.matchEmpty()) return kNone;
+      seq.next();
+    }
+  }
+
+  // Returns the slot that indexes the entry at `index`, whose key has the
+  // given hash. Compares indices, rather than keys.
+  size_type slotOf(size_type index, size_t hash) const {
+    const State tag = fullState(hash);
+    ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len());
+    while (true) {
+      Group group(&states_[seq.pos()]);
+      for (typename Group::Mask match = group.match(tag); match;
+           match.clearLowest()) {
+        size_type p = seq.pos() + match.lowest();
+        if (indices_[p] == index) return p;
+      }
+      assert(!group.matchEmpty());
+      seq.next();
+    }
+  }
+
+  // Returns the first empty or deleted slot in the probe sequence of `hash`.
+  size_type findFreeSlot(size_t hash) const {
+    ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len());
+    while (true) {
+      typename Group::Mask candidates =
+          Group(&states_[seq.pos()]).matchEmptyOrDeleted();
+      if (candidates) return seq.pos() + candidates.lowest();
+      seq.next();
+    }
+  }
+
+  // Probes for `key`. If it is absent, appends an entry constructed from
+  // `args`, and points the first free slot on the probe sequence at it,
+  // making room in the slot table first if needed.
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> tryEmplace(const K& key, Args&&... args) {
+    size_t hash = hash_fn_(key);
+    size_type free = kNone;
+    if (capacity_idx_ > 0) {
+      const State tag = fullState(hash);
+      ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len());
+      while (true) {
+        Group group(&states_[seq.pos()]);
+        for (typename Group::Mask match = group.match(tag); match;
+             match.clearLowest()) {
+          size_type p = seq.pos() + match.lowest();
+          if (key_cmp_fn_(entries_[indices_[p]].first, key)) {
+            return std::make_pair(begin() + indices_[p], false);
+          }
+        }
+        if (free == kNone) {
+          typename Group::Mask candidates = group.matchEmptyOrDeleted();
+          if (candidates) free = seq.pos() + candidates.lowest();
+        }
+        if (group.matchEmpty()) break;
+        seq.next();
+      }
+    }
+    if (free == kNone ||
+        (states_[free] == EMPTY && size() + erased_ >= resize_threshold_)) {
+      if (erased_ == 0 && capacity_idx_ == SizePolicy::kMaxCapacityIdx) {
+        // Full, at the largest capacity of the size policy.
+        return std::make_pair(end(), false);
+      }
+      makeRoom();
+      free = findFreeSlot(hash);
+    }
+    size_type index = size();
+    entries_.emplace_back(std::forward<Args>(args)...);
+    if (states_[free] == DELETED) --erased_;
+    states_[free] = fullState(hash);
+    indices_[free] = index;
+    return std::make_pair(begin() + index, true);
+  }
+
+  // Marks the slot as deleted, and moves the last entry into the place of
+  // the one it indexed.
+  void eraseSlot(size_type slot) {
+    size_type index = indices_[slot];
+    size_type last = size() - 1;
+    if (index != last) {
+      indices_[slotOf(last, hashAt(last))] = index;
+      entries_[index] = std::move(entries_[last]);
+    }
+    entries_.pop_back();
+    if (empty()) {
+      clear();
+    } else {
+      states_[slot] = DELETED;
+      ++erased_;
+    }
+  }
+
+  // Called when an insert would take an empty slot past the resize
+  // threshold. As in FlatSmallHashtable, purges the tombstones if at least
+  // ~1/4 of the threshold would be free without them, and otherwise grows
+  // the slot table, or shrinks it, if it has become far too large.
+  void makeRoom() {
+    int capacity_idx = initialCapacityIdx<SizePolicy>(size() + 1);
+    if (capacity_idx + 1 < capacity_idx_) {
+      rebuild(capacity_idx + 1);
+    } else if (erased_ > 0 && ((uint64_t)size() * 32 <=
+                                   (uint64_t)resize_threshold_ * 25 ||
+                               capacity_idx_ == SizePolicy::kMaxCapacityIdx)) {
+      rebuild(capacity_idx_);
+    } else {
+      // Or, exceeded maximum hashtable size.
+      assert(capacity_idx_ < SizePolicy::kMaxCapacityIdx);
+      rebuild(std::max(capacity_idx, capacity_idx_ + 1));
+    }
+  }
+
+  // Releases the entries and the slot table, leaving the map as if newly
+  // constructed. The vectors may be left non-empty by a move, with
+  // allocators that do not propagate.
+  void resetToEmpty() {
+    entries_.clear();
+    states_ = StateVector(states_.get_allocator());
+    indices_ = IndexVector(indices_.get_allocator());
+    capacity_idx_ = 0;
+    erased_ = 0;
+    resize_threshold_ = 0;
+  }
+
+  // Reallocates the slot table at the given capacity index, and repopulates
+  // it from the keys of the entries. The entries stay in place.
+  void rebuild(int capacity_idx) {
+    capacity_idx_ = capacity_idx;
+    erased_ = 0;
+    resize_threshold_ = resizeThreshold<SizePolicy>(capacity_idx);
+    if (capacity_idx == 0) {
+      states_ = StateVector(states_.get_allocator());
+      indices_ = IndexVector(indices_.get_allocator());
+      return;
+    }
+    size_type len = SizePolicy::htLen(capacity_idx);
+    states_ = StateVector(len + kGroupPadding, EMPTY, states_.get_allocator());
+    std::fill(states_.begin() + len, states_.end(), PADDING);
+    indices_ = IndexVector(len, 0, indices_.get_allocator());
+    for (size_type i = 0; i < size(); ++i) {
+      size_t hash = hashAt(i);
+      size_type slot = findFreeSlot(hash);
+      states_[slot] = fullState(hash);
+      indices_[slot] = i;
+    }
+  }
+
+  template <typename InputIt>
+  void reserveForRange(InputIt first, InputIt last, std::input_iterator_tag) {}
+
+  template <typename ForwardIt>
+  void reserveForRange(ForwardIt first, ForwardIt last,
+                       std::forward_iterator_tag) {
+    uint64_t n = std::distance(first, last);
+    reserve((size_type)std::min<uint64_t>(n, SizePolicy::kMaxResizeThreshold));
+  }
+
+  HashFn hash_fn_;
+  KeyCmpFn key_cmp_fn_;
+  std::vector<value_type, Allocator> entries_;
+  // Control bytes of the slots, followed by kGroupPadding bytes of PADDING,
+  // so that a group can be loaded from any slot. Empty at capacity index 0.
+  StateVector states_;
+  // Indices into entries_, of the full slots.
+  IndexVector indices_;
+  int capacity_idx_;
+  size_type erased_;
+  size_type resize_threshold_;
+};
+
+#ifdef ROO_COLLECTIONS_HAS_PMR
+namespace pmr {
+
+/// @brief `DenseFlatHashMap` that allocates from a `std::pmr::memory_resource`.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy>
+using DenseFlatHashMap = ::roo_collections::DenseFlatHashMap<
+    Key, Value, HashFn, KeyCmpFn, SizePolicy,
+    std::pmr::polymorphic_allocator<std::pair<Key, Value>>>;
+
+}  // namespace pmr
+#endif
+
+}  // namespace roo_collections
@@ -0,0 +1,620 @@
+#pragma once
+
+/// @file
+/// @brief Position-independent binary images of flat hash tables, and
+/// read-only views that look up directly in them.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "roo_backport/string_view.h"
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/flat_small_hash_set.h"
+#include "roo_collections/small_string.h"
+
+namespace roo_collections {
+
+/// @brief Stored form of a string in a snapshot: a range of the string blob.
+struct SnapshotString {
+  uint32_t offset;
+  uint32_t size;
+};
+
+/// @brief Stored form of a pair in a snapshot. Unlike `std::pair`, trivially
+/// copyable whenever its members are.
+template <typename First, typename Second>
+struct SnapshotPair {
+  First first;
+  Second second;
+};
+
+/// @brief Converts values of type `T` to and from their stored form in a
+/// snapshot.
+///
+/// Each codec defines:
+/// - `stored_type`: trivially copyable and free of pointers, so that the
+///   image can be mapped at any address;
+/// - `view_type`: what lookups in the snapshot return;
+/// - `static stored_type encode(const T&, std::vector<char>& blob)`, which
+///   may append out-of-line data to the blob;
+/// - `static view_type decode(const stored_type&, const char* blob)`.
+///
+/// By default, a value is stored as is, which requires it to be trivially
+/// copyable and not a pointer. Strings are stored in the blob, and decoded as
+/// `roo::string_view`. Specialize for other types as needed.
+template <typename T>
+struct SnapshotCodec {
+  static_assert(std::is_trivially_copyable<T>::value &&
+                    !std::is_pointer<T>::value,
+                "Type can't be stored in a snapshot as is; specialize "
+                "SnapshotCodec for it");
+
+  using stored_type = T;
+  using view_type = T;
+
+  static stored_type encode(const T& val, std::vector<char>& /*blob*/) {
+    return val;
+  }
+
+  static view_type decode(const stored_type& val, const char* /*blob*/) {
+    return val;
+  }
+};
+
+/// @brief Codec of all supported string types, storing the characters in the
+/// blob.
+struct StringSnapshotCodec {
+  using stored_type = SnapshotString;
+  using view_type = ::roo::string_view;
+
+  static stored_type encode(::roo::string_view val, std::vector<char>& blob) {
+    assert(blob.size() + val.size() <= 0xFFFFFFFF);
+    stored_type stored{(uint32_t)blob.size(), (uint32_t)val.size()};
+    blob.insert(blob.end(), val.data(), val.data() + val.size());
+    return stored;
+  }
+
+  static view_type decode(const stored_type& val, const char* blob) {
+    return view_type(blob + val.offset, val.size);
+  }
+};
+
+template <>
+struct SnapshotCodec<std::string> : public StringSnapshotCodec {};
+
+template <>
+struct SnapshotCodec<::roo::string_view> : public StringSnapshotCodec {};
+
+template <>
+struct SnapshotCodec<const char*> : public StringSnapshotCodec {};
+
+template <size_t N>
+struct SnapshotCodec<SmallString<N>> : public StringSnapshotCodec {};
+
+#ifdef ARDUINO
+template <>
+struct SnapshotCodec<::String> : public StringSnapshotCodec {
+  static stored_type encode(const ::String& val, std::vector<char>& blob) {
+    return StringSnapshotCodec::encode(
+        ::roo::string_view(val.c_str(), val.length()), blob);
+  }
+};
+#endif
+
+template <typename First, typename Second>
+struct SnapshotCodec<std::pair<First, Second>> {
+  using stored_type =
+      SnapshotPair<typename SnapshotCodec<First>::stored_type,
+                   typename SnapshotCodec<Second>::stored_type>;
+  using view_type = std::pair<typename SnapshotCodec<First>::view_type,
+                              typename SnapshotCodec<Second>::view_type>;
+
+  static stored_type encode(const std::pair<First, Second>& val,
+                            std::vector<char>& blob) {
+    return stored_type{SnapshotCodec<First>::encode(val.first, blob),
+                       SnapshotCodec<Second>::encode(val.second, blob)};
+  }
+
+  static view_type decode(const stored_type& val, const char* blob) {
+    return view_type(SnapshotCodec<First>::decode(val.first, blob),
+                     SnapshotCodec<Second>::decode(val.second, blob));
+  }
+};
+
+/// @brief Header at the start of every snapshot image.
+///
+/// All offsets are in bytes, from the start of the image. The control bytes
+/// are a verbatim copy of those of the table (including group padding and
+/// stored hashes, if any). They are followed by the stored entries, one per
+/// slot, at the same positions as in the table, and then by the blob holding
+/// out-of-line data such as string contents.
+struct SnapshotHeader {
+  /// @brief "RCHT".
+  char magic[4];
+
+  /// @brief `kSnapshotByteOrder`, as written by the host that created the
+  /// image.
+  uint32_t byte_order;
+
+  /// @brief Format version; currently 1.
+  uint16_t version;
+
+  /// @brief `sizeof(SizePolicy::index_type)`.
+  uint8_t index_size;
+
+  /// @brief `SizePolicy::group_type::kWidth`.
+  uint8_t group_width;
+
+  /// @brief `SizePolicy::kStoreHash`.
+  uint8_t store_hash;
+
+  /// @brief `SizePolicy::kPowerOfTwo`.
+  uint8_t power_of_two;
+
+  uint8_t reserved[2];
+
+  /// @brief Index of the table capacity in the sequence of capacities of the
+  /// size policy.
+  int32_t capacity_idx;
+
+  /// @brief `sizeof` the stored entry.
+  uint32_t entry_size;
+
+  /// @brief Number of entries.
+  uint64_t size;
+
+  uint64_t control_offset;
+  uint64_t control_size;
+  uint64_t entries_offset;
+  uint64_t blob_offset;
+  uint64_t blob_size;
+};
+
+static constexpr char kSnapshotMagic[4] = {'R', 'C', 'H', 'T'};
+static constexpr uint32_t kSnapshotByteOrder = 0x01020304;
+static constexpr uint16_t kSnapshotVersion = 1;
+
+/// @brief Required alignment of snapshot images in memory. Buffers returned
+/// by `mmap()` and `operator new` are sufficiently aligned.
+static constexpr size_t kSnapshotAlignment = 8;
+
+namespace internal {
+
+struct SnapshotAccess {
+  template <typename Table>
+  static int capacityIdx(const Table& table) {
+    return table.capacity_idx_;
+  }
+
+  template <typename Table>
+  static const int8_t* states(const Table& table) {
+    return table.states_;
+  }
+
+  template <typename Table>
+  static typename Table::const_reference entry(const Table& table,
+                                               size_t pos) {
+    return table.slots_.at(pos);
+  }
+
+  template <typename Table>
+  static const uint32_t* storedHashes(const Table& table) {
+    return table.storedHashes();
+  }
+};
+
+inline uint64_t snapshotAlign(uint64_t offset) {
+  return (offset + kSnapshotAlignment - 1) & ~(uint64_t)(kSnapshotAlignment - 1);
+}
+
+// Fills in the layout-dependent fields of the header of a snapshot with the
+// given size policy and entry type. Returns the size of the image without the
+// blob.
+template <typename SizePolicy, typename StoredEntry>
+uint64_t snapshotLayout(int capacity_idx, SnapshotHeader& header) {
+  static_assert(alignof(StoredEntry) <= kSnapshotAlignment,
+                "Stored entries are overaligned");
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.byte_order = kSnapshotByteOrder;
+  header.version = kSnapshotVersion;
+  header.index_size = sizeof(typename SizePolicy::index_type);
+  header.group_width = SizePolicy::group_type::kWidth;
+  header.store_hash = SizePolicy::kStoreHash;
+  header.power_of_two = SizePolicy::kPowerOfTwo;
+  memset(header.reserved, 0, sizeof(header.reserved));
+  header.capacity_idx = capacity_idx;
+  header.entry_size = sizeof(StoredEntry);
+  header.control_offset = sizeof(SnapshotHeader);
+  header.control_size = controlWords<SizePolicy>(capacity_idx) * 4;
+  header.entries_offset =
+      snapshotAlign(header.control_offset + header.control_size);
+  return header.entries_offset +
+         (uint64_t)SizePolicy::htLen(capacity_idx) * sizeof(StoredEntry);
+}
+
+}  // namespace internal
+
+/// @brief Serializes a table into a snapshot image, which
+/// `FlatHashtableSnapshot` can look up in directly, e.g. after `mmap()`ing it
+/// from a file.
+///
+/// The image keeps the slot layout of the table, so that it never needs to be
+/// rehashed. It contains no pointers: strings are stored as offsets into a
+/// blob at its end (see `SnapshotCodec`). It can be read on any host with the
+/// same byte order and the same layout of the stored entries.
+///
+/// Tombstones are carried over; call `compact()` on the table first to get
+/// rid of them.
+template <typename Entry, typename Key, typename HashFn, typename KeyFn,
+          typename KeyCmpFn, typename SizePolicy, typename Allocator>
+std::vector<char> serializeSnapshot(
+    const FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn, SizePolicy,
+                             Allocator>& table) {
+  using Access = internal::SnapshotAccess;
+  using Codec = SnapshotCodec<Entry>;
+  using StoredEntry = typename Codec::stored_type;
+  int capacity_idx = Access::capacityIdx(table);
+  size_t len = SizePolicy::htLen(capacity_idx);
+  SnapshotHeader header;
+  uint64_t image_size =
+      internal::snapshotLayout<SizePolicy, StoredEntry>(capacity_idx, header);
+  header.size = table.size();
+  std::vector<char> image(image_size, 0);
+  std::vector<char> blob;
+  char* control = image.data() + header.control_offset;
+  char* entries = image.data() + header.entries_offset;
+  const int8_t* states = Access::states(table);
+  if (capacity_idx > 0) {
+    // Copies the padding too, but not the never-written bytes that round the
+    // control bytes up to whole words.
+    memcpy(control, states, len + SizePolicy::group_type::kWidth - 1);
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (states[i] >= 0) continue;
+    StoredEntry stored = Codec::encode(Access::entry(table, i), blob);
+    memcpy(entries + i * sizeof(StoredEntry), &stored, sizeof(StoredEntry));
+    if (SizePolicy::kStoreHash) {
+      memcpy(control + storedHashesOffset<SizePolicy>(len) +
+                 i * sizeof(uint32_t),
+             &Access::storedHashes(table)[i], sizeof(uint32_t));
+    }
+  }
+  header.blob_offset = image_size;
+  header.blob_size = blob.size();
+  memcpy(image.data(), &header, sizeof(header));
+  image.insert(image.end(), blob.begin(), blob.end());
+  return image;
+}
+
+/// @brief Read-only view of a snapshot image written by `serializeSnapshot()`.
+///
+/// Looks up keys directly in the image, with the same probing as
+/// `FlatSmallHashtable`, so that attaching to an image takes constant time
+/// regardless of its size: no copying, no parsing, and no rehashing. Keys and
+/// values are decoded on the fly as they are returned, strings as
+/// `roo::string_view` pointing into the image.
+///
+/// `HashFn` and `SizePolicy` must be those of the serialized table (or at
+/// least hash the same and have the same layout); `attach()` verifies the
+/// layout, but it can't tell hash functions apart. With a transparent hash,
+/// such as that of `FlatSmallStringHashMap`, strings can be looked up as
+/// `roo::string_view` or `const char*` without any copies.
+///
+/// The image must stay valid and unmodified for as long as the view is used.
+/// It is trusted: `attach()` checks its header, but not the contents.
+///
+/// Use `FlatSmallHashMapSnapshot` and `FlatSmallHashSetSnapshot` rather than
+/// this class.
+///
+/// @tparam Entry Entry type of the serialized table.
+/// @tparam Key Key type of the serialized table.
+/// @tparam HashFn Hash function of the serialized table.
+/// @tparam SizePolicy Size policy of the serialized table.
+template <typename Entry, typename Key, typename HashFn = DefaultHashFn<Key>,
+          typename SizePolicy = SmallSizePolicy>
+class FlatHashtableSnapshot {
+ public:
+  using size_type = typename SizePolicy::index_type;
+  using key_type = Key;
+  using hasher = HashFn;
+  using stored_type = typename SnapshotCodec<Entry>::stored_type;
+
+  /// @brief Decoded entry, as returned by lookups and iteration.
+  using value_type = typename SnapshotCodec<Entry>::view_type;
+
+  /// @brief Constant forward iterator. Dereferences to decoded entries, by
+  /// value.
+  class ConstIterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename FlatHashtableSnapshot::value_type;
+    using reference = value_type;
+
+    struct pointer {
+      value_type value;
+      const value_type* operator->() const { return &value; }
+    };
+
+    ConstIterator() : ConstIterator(nullptr, 0) {}
+
+    value_type operator*() const { return snapshot_->entryAt(pos_); }
+    pointer operator->() const { return pointer{**this}; }
+
+    ConstIterator& operator++() {
+      do {
+        ++pos_;
+      } while (pos_ < snapshot_->ht_len_ && snapshot_->states_[pos_] >= 0);
+      return *this;
+    }
+
+    ConstIterator operator++(int n) {
+      ConstIterator itr = *this;
+      operator++();
+      return itr;
+    }
+
+    bool operator==(const ConstIterator& other) const {
+      return snapshot_ == other.snapshot_ && pos_ == other.pos_;
+    }
+
+    bool operator!=(const ConstIterator& other) const {
+      return snapshot_ != other.snapshot_ || pos_ != other.pos_;
+    }
+
+   private:
+    friend class FlatHashtableSnapshot;
+
+    ConstIterator(const FlatHashtableSnapshot* snapshot, size_type pos)
+        : snapshot_(snapshot), pos_(pos) {}
+
+    const FlatHashtableSnapshot* snapshot_;
+    size_type pos_;
+  };
+
+  using iterator = ConstIterator;
+  using const_iterator = ConstIterator;
+
+  /// @brief Constructs an empty view, not attached to any image.
+  FlatHashtableSnapshot(HashFn hash_fn = HashFn())
+      : hash_fn_(hash_fn),
+        capacity_idx_(0),
+        size_(0),
+        ht_len_(1),
+        states_(emptyStates()),
+        entries_(nullptr),
+        blob_(nullptr) {}
+
+  /// @brief Attaches the view to the image of `size` bytes at `data`.
+  ///
+  /// Returns false, leaving the view unchanged, if the image is malformed,
+  /// misaligned, or was written for a different entry layout, size policy,
+  /// or byte order.
+  bool attach(const void* data, size_t size) {
+    const char* image = static_cast<const char*>(data);
+    SnapshotHeader header;
+    if ((uintptr_t)image % kSnapshotAlignment != 0) return false;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 ||
+        header.byte_order != kSnapshotByteOrder ||
+        header.version != kSnapshotVersion ||
+        header.capacity_idx < 0 ||
+        header.capacity_idx > SizePolicy::kMaxCapacityIdx) {
+      return false;
+    }
+    SnapshotHeader expected;
+    uint64_t blob_offset =
+        internal::snapshotLayout<SizePolicy, stored_type>(header.capacity_idx,
+                                                          expected);
+    if (header.index_size != expected.index_size ||
+        header.group_width != expected.group_width ||
+        header.store_hash != expected.store_hash ||
+        header.power_of_two != expected.power_of_two ||
+        header.entry_size != expected.entry_size ||
+        header.control_offset != expected.control_offset ||
+        header.control_size != expected.control_size ||
+        header.entries_offset != expected.entries_offset ||
+        header.blob_offset != blob_offset ||
+        blob_offset > size || header.blob_size > size - blob_offset ||
+        header.size > SizePolicy::htLen(header.capacity_idx)) {
+      return false;
+    }
+    capacity_idx_ = header.capacity_idx;
+    size_ = header.size;
+    ht_len_ = SizePolicy::htLen(capacity_idx_);
+    states_ = reinterpret_cast<const int8_t*>(image + header.control_offset);
+    entries_ = reinterpret_cast<const stored_type*>(image + header.entries_offset);
+    blob_ = image + header.blob_offset;
+    return true;
+  }
+
+  /// @brief Returns the number of entries.
+  size_type size() const { return size_; }
+
+  /// @brief Returns whether there are no entries.
+  bool empty() const { return size_ == 0; }
+
+  /// @brief Returns the slot array length.
+  size_type ht_len() const { return ht_len_; }
+
+  /// @brief Returns an iterator to the first entry.
+  const_iterator begin() const {
+    if (empty()) return end();
+    size_type pos = 0;
+    while (states_[pos] >= 0) ++pos;
+    return ConstIterator(this, pos);
+  }
+
+  /// @brief Returns the end iterator.
+  const_iterator end() const { return ConstIterator(this, ht_len_); }
+
+  /// @brief Returns an iterator to the entry with `key`, or `end()`.
+  const_iterator find(const Key& key) const {
+    return ConstIterator(this, findPos(key));
+  }
+
+  /// @brief Heterogeneous key overload of `find`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>>
+  const_iterator find(const K& key) const {
+    return ConstIterator(this, findPos(key));
+  }
+
+  /// @brief Returns whether `key` is present.
+  bool contains(const Key& key) const { return findPos(key) != ht_len_; }
+
+  /// @brief Heterogeneous key overload of `contains`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>>
+  bool contains(const K& key) const {
+    return findPos(key) != ht_len_;
+  }
+
+ protected:
+  using Group = typename SizePolicy::group_type;
+  using ProbeSeq = typename SizePolicy::template probe_seq<Group::kWidth>;
+
+  const stored_type& storedAt(size_type pos) const { return entries_[pos]; }
+  const char* blob() const { return blob_; }
+
+  // Returns the slot holding the entry with the given key, or ht_len() if
+  // there is no such entry. Same as FlatSmallHashtable::findPos().
+  template <typename K>
+  size_type findPos(const K& key) const {
+    size_t hash = hash_fn_(key);
+    const int8_t tag = SizePolicy::hashTag(hash) | 0x80;
+    ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len_);
+    while (true) {
+      Group group(&states_[seq.pos()]);
+      for (typename Group::Mask match = group.match(tag); match;
+           match.clearLowest()) {
+        size_type p = seq.pos() + match.lowest();
+        if ((!SizePolicy::kStoreHash || storedHashes()[p] == (uint32_t)hash) &&
+            keyAt(p) == key) {
+          return p;
+        }
+      }
+      if (group.matchEmpty()) return ht_len_;
+      seq.next();
+    }
+  }
+
+ private:
+  using KeyCodec = SnapshotCodec<Key>;
+
+  value_type entryAt(size_type pos) const {
+    return SnapshotCodec<Entry>::decode(entries_[pos], blob_);
+  }
+
+  typename KeyCodec::view_type keyAt(size_type pos) const {
+    return KeyCodec::decode(storedKey(entries_[pos], std::is_same<Entry, Key>()),
+                            blob_);
+  }
+
+  // Sets store keys; maps store pairs.
+  static const stored_type& storedKey(const stored_type& stored,
+                                      std::true_type) {
+    return stored;
+  }
+
+  static const typename KeyCodec::stored_type& storedKey(
+      const stored_type& stored, std::false_type) {
+    return stored.first;
+  }
+
+  const uint32_t* storedHashes() const {
+    return reinterpret_cast<const uint32_t*>(
+        states_ + storedHashesOffset<SizePolicy>(ht_len_));
+  }
+
+  // Control bytes of the view that isn't attached to any image.
+  static const int8_t* emptyStates() {
+    static const int8_t states[Group::kWidth] = {};
+    return states;
+  }
+
+  HashFn hash_fn_;
+  int capacity_idx_;
+  size_type size_;
+  size_type ht_len_;
+  const int8_t* states_;
+  const stored_type* entries_;
+  const char* blob_;
+};
+
+/// @brief Read-only view of a snapshot of a `FlatSmallHashMap`, e.g.:
+///
+/// @code
+/// // At build time:
+/// FlatSmallStringHashMap<int> dict = ...;
+/// std::vector<char> image = serializeSnapshot(dict);
+/// // Write the image to a file.
+///
+/// // At startup:
+/// // Map the file into memory, at `data`.
+/// FlatSmallStringHashMapSnapshot<int> snapshot;
+/// if (!snapshot.attach(data, size)) { /* wrong file. */ }
+/// int id = snapshot.at("key");
+/// @endcode
+///
+/// See `FlatHashtableSnapshot`.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename SizePolicy = SmallSizePolicy>
+class FlatSmallHashMapSnapshot
+    : public FlatHashtableSnapshot<std::pair<Key, Value>, Key, HashFn,
+                                   SizePolicy> {
+ public:
+  using Base =
+      FlatHashtableSnapshot<std::pair<Key, Value>, Key, HashFn, SizePolicy>;
+
+  /// @brief Decoded value, as returned by `at()`.
+  using mapped_type = typename SnapshotCodec<Value>::view_type;
+
+  using Base::Base;
+
+  /// @brief Returns the value for `key`.
+  ///
+  /// Asserts in debug builds if `key` is not present.
+  mapped_type at(const Key& key) const { return valueAt(this->findPos(key)); }
+
+  /// @brief Heterogeneous key overload of `at`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>>
+  mapped_type at(const K& key) const {
+    return valueAt(this->findPos(key));
+  }
+
+ private:
+  mapped_type valueAt(typename Base::size_type pos) const {
+    assert(pos != this->ht_len());
+    return SnapshotCodec<Value>::decode(this->storedAt(pos).second,
+                                        this->blob());
+  }
+};
+
+/// @brief Read-only view of a snapshot of a `FlatSmallHashSet`. See
+/// `FlatHashtableSnapshot`.
+template <typename Key, typename HashFn = DefaultHashFn<Key>,
+          typename SizePolicy = SmallSizePolicy>
+using FlatSmallHashSetSnapshot =
+    FlatHashtableSnapshot<Key, Key, HashFn, SizePolicy>;
+
+/// @brief Read-only view of a snapshot of a `FlatSmallStringHashMap`, with
+/// heterogeneous lookup.
+template <typename Value>
+using FlatSmallStringHashMapSnapshot =
+    FlatSmallHashMapSnapshot<std::string, Value, TransparentStringHashFn>;
+
+/// @brief Read-only view of a snapshot of a `FlatSmallStringHashSet`, with
+/// heterogeneous lookup.
+using FlatSmallStringHashSetSnapshot =
+    FlatSmallHashSetSnapshot<std::string, TransparentStringHashFn>;
+
+}  // namespace roo_collections
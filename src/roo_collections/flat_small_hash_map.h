@@ -5,6 +5,8 @@
 /// @ingroup roo_collections
 
 #include <functional>
+#include <tuple>
+#include <utility>
 
 #include "roo_collections/flat_small_hashtable.h"
 
@@ -12,7 +14,7 @@ namespace roo_collections {
 
 template <typename Key, typename Value>
 struct MapKeyFn {
-  const Key& operator()(const std::pair<Key, Value>& entry) const {
+  constexpr const Key& operator()(const std::pair<Key, Value>& entry) const {
     return entry.first;
   }
 };
@@ -29,6 +31,14 @@ struct KeyCovert<std::string, ::roo::string_view> {
   }
 };
 
+// Converts a lookup key to the stored key type only when an entry actually
+// gets constructed from it (used in piecewise construction of map entries).
+template <typename Key, typename K>
+struct LazyKeyCovert {
+  const K& val;
+  operator Key() const { return KeyCovert<Key, K>()(val); }
+};
+
 /// @brief Flat, memory-conscious hash map optimized for small collections.
 ///
 /// Uses `FlatSmallHashtable` as the underlying storage and provides a map-like
@@ -38,49 +48,81 @@ struct KeyCovert<std::string, ::roo::string_view> {
 /// @tparam Value Mapped value type.
 /// @tparam HashFn Hash function type.
 /// @tparam KeyCmpFn Key equality predicate type.
+/// @tparam SizePolicy Width of indices; see `SmallSizePolicy` and
+/// `LargeSizePolicy`.
+/// @tparam Allocator Allocator of `std::pair<Key, Value>` entries.
 template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
-          typename KeyCmpFn = std::equal_to<Key>>
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
 class FlatSmallHashMap
     : public FlatSmallHashtable<std::pair<Key, Value>, Key, HashFn,
-                                MapKeyFn<Key, Value>, KeyCmpFn> {
+                                MapKeyFn<Key, Value>, KeyCmpFn, SizePolicy,
+                                Allocator> {
  public:
   using mapped_type = Value;
 
   using Base = FlatSmallHashtable<std::pair<Key, Value>, Key, HashFn,
-                                  MapKeyFn<Key, Value>, KeyCmpFn>;
+                                  MapKeyFn<Key, Value>, KeyCmpFn, SizePolicy,
+                                  Allocator>;
 
+  using size_type = typename Base::size_type;
   using key_type = typename Base::key_type;
   using value_type = typename Base::value_type;
   using hasher = typename Base::hasher;
   using key_equal = typename Base::key_equal;
+  using allocator_type = typename Base::allocator_type;
   using iterator = typename Base::iterator;
   using const_iterator = typename Base::const_iterator;
 
   /// @brief Creates an empty hash map.
-  FlatSmallHashMap(HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : Base(hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn) {}
+  FlatSmallHashMap(HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : Base(hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn, alloc) {}
+
+  /// @brief Creates an empty hash map that uses the given allocator.
+  explicit FlatSmallHashMap(const Allocator& alloc)
+      : Base(HashFn(), MapKeyFn<Key, Value>(), KeyCmpFn(), alloc) {}
 
   /// @brief Creates a hash map with capacity for approximately `size_hint`
   /// elements without rehashing.
   /// @param size_hint Expected number of inserted items.
-  FlatSmallHashMap(uint16_t size_hint, HashFn hash_fn = HashFn(),
-                   KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : Base(size_hint, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn) {}
+  FlatSmallHashMap(size_type size_hint, HashFn hash_fn = HashFn(),
+                   KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : Base(size_hint, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn, alloc) {}
 
   /// @brief Builds a map from an iterator range.
   template <typename InputIt>
   FlatSmallHashMap(InputIt first, InputIt last, HashFn hash_fn = HashFn(),
-                   KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : Base(first, last, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn) {}
+                   KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : Base(first, last, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn,
+             alloc) {}
 
   /// @brief Builds a map from an initializer list.
   FlatSmallHashMap(std::initializer_list<value_type> init,
-                   HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : Base(init, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn) {}
+                   HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                   const Allocator& alloc = Allocator())
+      : Base(init, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn, alloc) {}
 
   /// @brief Copy constructor.
   FlatSmallHashMap(const FlatSmallHashMap& other) : Base(other) {}
 
+  /// @brief Copy constructor with an explicit allocator.
+  FlatSmallHashMap(const FlatSmallHashMap& other, const Allocator& alloc)
+      : Base(other, alloc) {}
+
+  /// @brief Move constructor.
+  FlatSmallHashMap(FlatSmallHashMap&& other) : Base(std::move(other)) {}
+
+  /// @brief Move constructor with an explicit allocator.
+  FlatSmallHashMap(FlatSmallHashMap&& other, const Allocator& alloc)
+      : Base(std::move(other), alloc) {}
+
+  FlatSmallHashMap& operator=(const FlatSmallHashMap& other) = default;
+  FlatSmallHashMap& operator=(FlatSmallHashMap&& other) = default;
+
   /// @brief Returns a const reference to the mapped value for `key`.
   ///
   /// Asserts in debug builds if `key` is not present.
@@ -144,6 +186,62 @@ class FlatSmallHashMap
     return Base::find(key);
   }
 
+  /// @brief Finds `key`, given its hash, and returns an iterator to the
+  /// entry, or `end()`.
+  ///
+  /// See `FlatSmallHashtable::find_with_hash`.
+  iterator find_with_hash(const Key& key, size_t hash) {
+    return this->lookupWithHash(key, hash);
+  }
+
+  /// @brief Heterogeneous lookup overload of `find_with_hash`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  iterator find_with_hash(const K& key, size_t hash) {
+    return this->lookupWithHash(key, hash);
+  }
+
+  /// @brief Const overload of `find_with_hash`.
+  const_iterator find_with_hash(const Key& key, size_t hash) const {
+    return Base::find_with_hash(key, hash);
+  }
+
+  /// @brief Heterogeneous const overload of `find_with_hash`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  const_iterator find_with_hash(const K& key, size_t hash) const {
+    return Base::find_with_hash(key, hash);
+  }
+
+  /// @brief Looks up `count` keys at once, storing an iterator to the entry
+  /// for each of `keys`, or `end()`, at the same index of `results`.
+  ///
+  /// See `FlatSmallHashtable::find_batch`.
+  void find_batch(const Key* keys, size_t count, iterator* results) {
+    this->lookupBatch(keys, count, results);
+  }
+
+  /// @brief Heterogeneous lookup overload of `find_batch`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  void find_batch(const K* keys, size_t count, iterator* results) {
+    this->lookupBatch(keys, count, results);
+  }
+
+  /// @brief Const overload of `find_batch`.
+  void find_batch(const Key* keys, size_t count,
+                  const_iterator* results) const {
+    Base::find_batch(keys, count, results);
+  }
+
+  /// @brief Heterogeneous const overload of `find_batch`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  void find_batch(const K* keys, size_t count,
+                  const_iterator* results) const {
+    Base::find_batch(keys, count, results);
+  }
+
   /// @brief Returns a const reference to the value for `key`.
   const Value& operator[](const Key& key) const { return at(key); }
 
@@ -156,30 +254,115 @@ class FlatSmallHashMap
 
   /// @brief Returns a mutable reference to the value for `key`.
   ///
-  /// Inserts a default-constructed value when `key` is not present.
+  /// Inserts a default-constructed value when `key` is not present. Must not
+  /// be used to insert into a map that is full at the largest capacity of its
+  /// `SizePolicy`, where `try_emplace()` would return `{end(), false}`.
   Value& operator[](const Key& key) {
-    auto it = this->lookup(key);
-    if (it == this->end()) {
-      return (*this->insert(std::make_pair(key, Value())).first).second;
-    } else {
-      return (*it).second;
-    }
+    auto result = try_emplace(key);
+    assert(result.first != this->end());
+    return (*result.first).second;
   }
 
   /// @brief Heterogeneous mutable overload of `operator[]`.
   ///
-  /// Inserts a default-constructed value when `key` is not present.
+  /// Inserts a default-constructed value when `key` is not present. Has the
+  /// same precondition as the non-template overload.
   template <typename K, typename = has_is_transparent_t<HashFn, K>,
             typename = has_is_transparent_t<KeyCmpFn, K>>
   Value& operator[](const K& key) {
-    auto it = this->lookup(key);
-    if (it == this->end()) {
-      return (*this->insert(std::make_pair(KeyCovert<Key, K>()(key), Value()))
-                   .first)
-          .second;
-    } else {
-      return (*it).second;
+    auto result = try_emplace(key);
+    assert(result.first != this->end());
+    return (*result.first).second;
+  }
+
+  /// @brief Inserts a value constructed from `args` if `key` is not present.
+  ///
+  /// The key is hashed and probed first; the entry is constructed in place
+  /// only if a free slot is found. When `key` is already present, neither the
+  /// key nor `args` are touched.
+  /// @return Pair of iterator and insertion flag.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    return this->tryEmplace(key, std::piecewise_construct,
+                            std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Move-key overload of `try_emplace`.
+  ///
+  /// `key` is moved from only if the entry gets inserted.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    return this->tryEmplace(key, std::piecewise_construct,
+                            std::forward_as_tuple(std::move(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Heterogeneous overload of `try_emplace`.
+  ///
+  /// The stored key is converted from `key` only if the entry gets inserted.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>, typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return this->tryEmplace(key, std::piecewise_construct,
+                            std::forward_as_tuple(LazyKeyCovert<Key, K>{key}),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief As `try_emplace`, given the hash of `key`. See
+  /// `FlatSmallHashtable::find_with_hash`.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace_with_hash(const Key& key, size_t hash,
+                                                  Args&&... args) {
+    assert(hash == this->hash_function()(key));
+    return this->tryEmplaceWithHash(
+        key, hash, std::piecewise_construct, std::forward_as_tuple(key),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Heterogeneous overload of `try_emplace_with_hash`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>, typename... Args>
+  std::pair<iterator, bool> try_emplace_with_hash(const K& key, size_t hash,
+                                                  Args&&... args) {
+    assert(hash == this->hash_function()(key));
+    return this->tryEmplaceWithHash(
+        key, hash, std::piecewise_construct,
+        std::forward_as_tuple(LazyKeyCovert<Key, K>{key}),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  /// @brief Inserts `obj` under `key`, or assigns it to the existing value.
+  /// @return Pair of iterator and insertion flag.
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second && result.first != this->end()) {
+      (*result.first).second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  /// @brief Move-key overload of `insert_or_assign`.
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj) {
+    auto result = try_emplace(std::move(key), std::forward<M>(obj));
+    if (!result.second && result.first != this->end()) {
+      (*result.first).second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  /// @brief Heterogeneous overload of `insert_or_assign`.
+  template <typename K, typename M,
+            typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  std::pair<iterator, bool> insert_or_assign(const K& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second && result.first != this->end()) {
+      (*result.first).second = std::forward<M>(obj);
     }
+    return result;
   }
 };
 
@@ -187,9 +370,30 @@ class FlatSmallHashMap
 ///
 /// Accepts `std::string`, `const char*`, `roo::string_view`, and Arduino
 /// `String` (when available) for lookup operations.
-template <typename Value>
+template <typename Value,
+          typename Allocator = std::allocator<std::pair<std::string, Value>>>
 using FlatSmallStringHashMap =
     FlatSmallHashMap<std::string, Value, TransparentStringHashFn,
-                     TransparentEq>;
+                     TransparentEq, SmallSizePolicy, Allocator>;
+
+#ifdef ROO_COLLECTIONS_HAS_PMR
+namespace pmr {
+
+/// @brief `FlatSmallHashMap` that allocates from a `std::pmr::memory_resource`.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy>
+using FlatSmallHashMap = ::roo_collections::FlatSmallHashMap<
+    Key, Value, HashFn, KeyCmpFn, SizePolicy,
+    std::pmr::polymorphic_allocator<std::pair<Key, Value>>>;
+
+/// @brief `FlatSmallStringHashMap` that allocates from a
+/// `std::pmr::memory_resource`.
+template <typename Value>
+using FlatSmallStringHashMap = ::roo_collections::FlatSmallStringHashMap<
+    Value, std::pmr::polymorphic_allocator<std::pair<std::string, Value>>>;
+
+}  // namespace pmr
+#endif
 
 }  // namespace roo_collections
@@ -18,10 +18,15 @@ namespace roo_collections {
 /// @tparam Key Stored key type.
 /// @tparam HashFn Hash function type.
 /// @tparam KeyCmpFn Equality predicate type.
+/// @tparam SizePolicy Width of indices; see `SmallSizePolicy` and
+/// `LargeSizePolicy`.
+/// @tparam Allocator Allocator of keys.
 template <typename Key, typename HashFn = DefaultHashFn<Key>,
-          typename KeyCmpFn = std::equal_to<Key>>
-using FlatSmallHashSet =
-    FlatSmallHashtable<Key, Key, HashFn, DefaultKeyFn<Key>, KeyCmpFn>;
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy,
+          typename Allocator = std::allocator<Key>>
+using FlatSmallHashSet = FlatSmallHashtable<Key, Key, HashFn, DefaultKeyFn<Key>,
+                                            KeyCmpFn, SizePolicy, Allocator>;
 
 /// @brief String-specialized flat hash set with heterogeneous lookup support.
 ///
@@ -31,4 +36,30 @@ using FlatSmallStringHashSet =
     FlatSmallHashtable<std::string, std::string, TransparentStringHashFn,
                        DefaultKeyFn<std::string>, TransparentEq>;
 
+/// @brief `FlatSmallStringHashSet` with a custom allocator.
+template <typename Allocator>
+using BasicFlatSmallStringHashSet =
+    FlatSmallHashtable<std::string, std::string, TransparentStringHashFn,
+                       DefaultKeyFn<std::string>, TransparentEq,
+                       SmallSizePolicy, Allocator>;
+
+#ifdef ROO_COLLECTIONS_HAS_PMR
+namespace pmr {
+
+/// @brief `FlatSmallHashSet` that allocates from a `std::pmr::memory_resource`.
+template <typename Key, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy>
+using FlatSmallHashSet =
+    ::roo_collections::FlatSmallHashSet<Key, HashFn, KeyCmpFn, SizePolicy,
+                                        std::pmr::polymorphic_allocator<Key>>;
+
+/// @brief `FlatSmallStringHashSet` that allocates from a
+/// `std::pmr::memory_resource`.
+using FlatSmallStringHashSet = ::roo_collections::BasicFlatSmallStringHashSet<
+    std::pmr::polymorphic_allocator<std::string>>;
+
+}  // namespace pmr
+#endif
+
 }  // namespace roo_collections
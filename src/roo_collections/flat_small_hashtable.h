@@ -7,16 +7,31 @@
 #include <assert.h>
 #include <inttypes.h>
 
+#include <algorithm>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #include "roo_backport.h"
 #include "roo_backport/string_view.h"
+#include "roo_collections/control_group.h"
 #include "roo_collections/hash.h"
+#include "roo_collections/slot_layout.h"
 #include "roo_collections/small_string.h"
 
+// Polymorphic allocators are missing from some embedded toolchains.
+#if defined(__has_include)
+#if __has_include(<memory_resource>) && __cplusplus >= 201703L
+#include <memory_resource>
+#define ROO_COLLECTIONS_HAS_PMR 1
+#endif
+#endif
+
 #ifdef ARDUINO
 #include <WString.h>
 
@@ -36,6 +51,10 @@ namespace roo_collections {
 // small hashtable (with ht_len 11) can hold 8 elements.
 static constexpr float kMaxFillRatio = 0.73;
 
+// kMaxFillRatio in units of 2^-16, the way tables store their maximum load
+// factor.
+static constexpr uint16_t kDefaultMaxLoad = (uint16_t)(kMaxFillRatio * 65536);
+
 // Sequence of the largest primes of the format 4n+3, less than 2^k,
 // for k = 2 ... 16. When used as hash map capacities, they are known to
 // enable quadratic residue search to visit the entire array. Additionally,
@@ -55,47 +74,436 @@ static constexpr uint64_t kRadkePrimeInverts[] = {
     0x800400201,       0x401506e65,      0x200c44b25,      0x100110122};
 
 // Returns n % kRadkePrimes[idx].
-inline uint16_t fastmod(uint32_t n, int idx) {
+constexpr uint16_t fastmod(uint32_t n, int idx) {
   uint64_t lowbits = (kRadkePrimeInverts[idx] * n) & 0x0000FFFFFFFFFFFF;
   return (lowbits * kRadkePrimes[idx]) >> 48;
 }
 
-inline int initialCapacityIdx(uint16_t size_hint) {
-  uint32_t ht_len = (uint32_t)(((float)size_hint) / kMaxFillRatio) + 1;
-  for (int radkeIdx = 0; radkeIdx < 15; ++radkeIdx) {
-    if (kRadkePrimes[radkeIdx] >= ht_len) return radkeIdx;
+// Extension of kRadkePrimes for k = 2 ... 32, used by tables with 32-bit
+// indices. The first 16 entries are the same as in kRadkePrimes.
+static constexpr uint32_t kLargeRadkePrimes[] = {
+    0x1,        0x3,        0x7,        0xb,        0x1f,       0x3b,
+    0x7f,       0xfb,       0x1f7,      0x3fb,      0x7f7,      0xffb,
+    0x1fff,     0x3feb,     0x7fcf,     0xffef,     0x1ffff,    0x3fffb,
+    0x7ffff,    0xffffb,    0x1ffff7,   0x3fffef,   0x7fffeb,   0xffffef,
+    0x1ffffcf,  0x3fffffb,  0x7ffff0f,  0xfffffc7,  0x1fffffdf, 0x3fffffd7,
+    0x7fffffff, 0xfffffffb};
+
+// These are precalculated (2^64 - 1) / the corresponding large radke prime + 1
+// (mod 2^64), i.e. the 64-bit variant of kRadkePrimeInverts.
+static constexpr uint64_t kLargeRadkePrimeInverts[] = {
+    0x0,                0x5555555555555556, 0x2492492492492493,
+    0x1745d1745d1745d2, 0x842108421084211,  0x456c797dd49c342,
+    0x204081020408103,  0x105197f7d734042,  0x824a4e60b3262c,
+    0x4050647d9d0446,   0x202428adc37bec,   0x100501907d271d,
+    0x8004002001001,    0x401506e6438e3,    0x200c44b24c414,
+    0x1001101211333,    0x800040002001,     0x400050006401,
+    0x200004000081,     0x100005000191,     0x800024000a3,
+    0x40001100049,      0x2000054000e,      0x10000110002,
+    0x80000c4002,       0x4000005001,       0x200003c401,
+    0x1000003901,       0x800000841,        0x400000291,
+    0x200000005,        0x100000006};
+
+// Returns n % kLargeRadkePrimes[idx].
+constexpr uint32_t largeFastmod(uint32_t n, int idx) {
+  uint64_t lowbits = kLargeRadkePrimeInverts[idx] * n;
+  uint64_t d = kLargeRadkePrimes[idx];
+  // High 64 bits of the 128-bit product lowbits * d, computed with 64-bit
+  // arithmetic only, so that it also works on 32-bit targets.
+  return (uint32_t)(((((lowbits & 0xFFFFFFFF) * d) >> 32) +
+                     (lowbits >> 32) * d) >>
+                    32);
+}
+
+// Radke's quadratic residue probe sequence over an array of length `cap`,
+// starting at `home`. When the length is a prime of the form 4n+3, it visits
+// every position exactly once.
+template <typename Index>
+class QuadraticProbeSeq {
+ public:
+  constexpr QuadraticProbeSeq(Index home, Index cap)
+      : pos_(home), cap_(cap), j_(-(SignedWideIndex)cap) {}
+
+  constexpr Index pos() const { return pos_; }
+
+  constexpr void next() {
+    j_ += 2;
+    assert(j_ < cap_);
+    WideIndex p = (WideIndex)pos_ + (j_ >= 0 ? j_ : -j_);
+    if (p >= cap_) p -= cap_;
+    pos_ = p;
+  }
+
+ private:
+  // Wide enough to hold probe positions up to 2 * cap without overflow.
+  using WideIndex =
+      typename std::conditional<sizeof(Index) < 4, uint32_t, uint64_t>::type;
+  using SignedWideIndex = typename std::make_signed<WideIndex>::type;
+
+  Index pos_;
+  Index cap_;
+  SignedWideIndex j_;
+};
+
+// Triangular probe sequence over an array of length `cap`, a power of two,
+// starting at `home`. Advances by 1, 2, 3, ... strides, which visits every
+// stride-aligned position exactly once. The stride is the group width (or
+// the whole array, if smaller), and the start is aligned down to it, so that
+// the groups tile the array without overlapping or reaching past its end.
+template <typename Index, int kGroupWidth>
+class TriangularProbeSeq {
+ public:
+  constexpr TriangularProbeSeq(Index home, Index cap)
+      : pos_(home & ~(stride(cap) - 1)),
+        mask_(cap - 1),
+        stride_(stride(cap)),
+        step_(0) {}
+
+  constexpr Index pos() const { return pos_; }
+
+  constexpr void next() {
+    step_ += stride_;
+    assert(step_ <= mask_);
+    pos_ = (pos_ + step_) & mask_;
+  }
+
+ private:
+  static constexpr Index stride(Index cap) {
+    return cap < (Index)kGroupWidth ? cap : (Index)kGroupWidth;
+  }
+
+  Index pos_;
+  Index mask_;
+  Index stride_;
+  Index step_;
+};
+
+/// @brief Size policy for tables of up to ~64k elements.
+///
+/// Uses 16-bit slot indices and counters, which keeps both the table and its
+/// iterators as compact as possible. This is the default.
+struct SmallSizePolicy {
+  using index_type = uint16_t;
+
+  // Probes one slot at a time.
+  using group_type = SingleSlotGroup;
+
+  // Recomputes hashes when needed, rather than storing them.
+  static constexpr bool kStoreHash = false;
+
+  // Grows and shrinks with the number of elements.
+  static constexpr bool kFixedCapacity = false;
+
+  // Index of the largest capacity in the sequence of Radke primes.
+  static constexpr int kMaxCapacityIdx = 15;
+
+  // Resize threshold at the largest capacity, which can't grow any further.
+  static constexpr index_type kMaxResizeThreshold = 64000;
+
+  // Capacities are Radke primes, rather than powers of two.
+  static constexpr bool kPowerOfTwo = false;
+
+  // Returns the slot array length for the given capacity index.
+  static constexpr index_type htLen(int idx) { return kRadkePrimes[idx]; }
+
+  // Maps a hash to its home slot in the array of the given capacity index.
+  static constexpr index_type homeSlot(uint32_t hash, int idx) {
+    return fastmod(hash, idx);
+  }
+
+  // Returns the 7-bit tag that marks the control byte of a slot holding an
+  // entry with this hash.
+  static constexpr uint8_t hashTag(uint32_t hash) { return hash & 0x7F; }
+
+  // Probes with Radke's quadratic residue sequence, regardless of the width
+  // of the groups.
+  template <int kGroupWidth>
+  using probe_seq = QuadraticProbeSeq<index_type>;
+
+  // Stores each entry in one piece, in a single slot array.
+  template <typename Entry, typename Allocator>
+  using slots = internal::InterleavedSlots<Entry, Allocator>;
+};
+
+/// @brief Size policy for tables of up to ~4 billion elements.
+///
+/// Uses 32-bit slot indices and counters, for host-side tables that outgrow
+/// `SmallSizePolicy`.
+struct LargeSizePolicy {
+  using index_type = uint32_t;
+
+  using group_type = SingleSlotGroup;
+
+  static constexpr bool kStoreHash = false;
+
+  static constexpr bool kFixedCapacity = false;
+
+  static constexpr int kMaxCapacityIdx = 31;
+
+  static constexpr index_type kMaxResizeThreshold = 4200000000u;
+
+  static constexpr bool kPowerOfTwo = false;
+
+  static constexpr index_type htLen(int idx) {
+    return kLargeRadkePrimes[idx];
+  }
+
+  static constexpr index_type homeSlot(uint32_t hash, int idx) {
+    return largeFastmod(hash, idx);
+  }
+
+  static constexpr uint8_t hashTag(uint32_t hash) { return hash & 0x7F; }
+
+  template <int kGroupWidth>
+  using probe_seq = QuadraticProbeSeq<index_type>;
+
+  template <typename Entry, typename Allocator>
+  using slots = internal::InterleavedSlots<Entry, Allocator>;
+};
+
+/// @brief Size policy adapter that probes a whole group of slots at a time.
+///
+/// At every step of the probe sequence, compares `Group::kWidth` consecutive
+/// control bytes (16 with SSE2, 32 with AVX2, 8 with the portable fallback)
+/// against the 7-bit hash tag at once, and stops at the first group that has
+/// an empty slot. This sharply cuts the number of probe steps, especially for
+/// unsuccessful lookups in large, well-filled tables, at the cost of
+/// `Group::kWidth - 1` padding bytes per table. Best suited for host-side
+/// tables; on small embedded tables, the default single-slot probing is
+/// usually as fast and leaner.
+///
+/// Example: `FlatSmallHashSet<int, DefaultHashFn<int>, std::equal_to<int>,
+/// GroupProbing<LargeSizePolicy>>`.
+template <typename SizePolicy, typename Group = ControlGroup>
+struct GroupProbing : public SizePolicy {
+  using group_type = Group;
+};
+
+/// @brief Size policy adapter that stores the full 32-bit hash of each entry.
+///
+/// The hashes are kept in an array parallel to the control bytes, costing 4
+/// bytes per slot. In exchange, growing and purging tombstones never call the
+/// hash function again, and candidate slots whose 7-bit tag matches are
+/// rejected on the full hash before the keys are compared. Pays off for keys
+/// that are expensive to hash or compare, such as strings.
+///
+/// Composes with the other adapters, e.g.
+/// `StoredHash<GroupProbing<LargeSizePolicy>>`.
+template <typename SizePolicy>
+struct StoredHash : public SizePolicy {
+  static constexpr bool kStoreHash = true;
+};
+
+/// @brief Size policy adapter that never reallocates the table.
+///
+/// The table keeps the capacity it was constructed with. Erased slots are
+/// purged in place, and inserting a new key into a full table fails, returning
+/// `{end(), false}`. `compact()` only purges tombstones. Used by
+/// `InlineFlatHashMap` to stay within its inline storage.
+template <typename SizePolicy>
+struct FixedCapacity : public SizePolicy {
+  static constexpr bool kFixedCapacity = true;
+};
+
+/// @brief Size policy adapter that uses power-of-two capacities, instead of
+/// Radke primes.
+///
+/// The hash is then multiplied by 2^64 / phi (Fibonacci hashing): the home
+/// slot is taken from the upper bits of the product, and the 7-bit tag from
+/// bits below them. Probing follows the triangular sequence, in strides of
+/// the group width. This replaces the two `fastmod` multiplications by a
+/// single one and a shift, which is cheaper on 64-bit hosts with fast
+/// hashes. The multiplication also mixes weak hashes, such as the identity
+/// hash of integers, so that keys that differ only in their upper bits still
+/// spread over the table, and get distinct tags. The price is a coarser set
+/// of capacities (twice the previous one at every step), and a maximum
+/// capacity of half that of the underlying policy.
+///
+/// Composes with the other adapters, e.g.
+/// `PowerOfTwoCapacity<GroupProbing<LargeSizePolicy>>`.
+template <typename SizePolicy>
+struct PowerOfTwoCapacity : public SizePolicy {
+  using index_type = typename SizePolicy::index_type;
+
+  static constexpr bool kPowerOfTwo = true;
+
+  // The largest power of two that fits in index_type is 2^(bits - 1), at
+  // index bits - 2.
+  static constexpr int kMaxCapacityIdx = sizeof(index_type) * 8 - 2;
+
+  static constexpr index_type kMaxResizeThreshold =
+      ((index_type)1 << (kMaxCapacityIdx + 1)) / 32 * 31;
+
+  // Base-2 logarithm of the slot array length. Index 0 is the sentinel
+  // length 1; the next ones are 4, 8, 16, ...
+  static constexpr int log2HtLen(int idx) { return idx == 0 ? 0 : idx + 1; }
+
+  static constexpr index_type htLen(int idx) {
+    return (index_type)1 << log2HtLen(idx);
+  }
+
+  static constexpr uint64_t mix(uint32_t hash) {
+    return hash * 0x9E3779B97F4A7C15ull;
+  }
+
+  // Bits 33 and up of the product. (Shifted in two steps, since index 0
+  // takes none of them.)
+  static constexpr index_type homeSlot(uint32_t hash, int idx) {
+    return (index_type)((mix(hash) >> (63 - log2HtLen(idx))) >> 1);
+  }
+
+  // Bits 25 to 31 of the product, which depend on all the bits of the hash
+  // up to bit 31, and are disjoint from the home slot bits.
+  static constexpr uint8_t hashTag(uint32_t hash) {
+    return (mix(hash) >> 25) & 0x7F;
+  }
+
+  template <int kGroupWidth>
+  using probe_seq = TriangularProbeSeq<index_type, kGroupWidth>;
+};
+
+/// @brief Size policy adapter that stores the keys and the values of map
+/// entries in two separate, parallel arrays, instead of one array of pairs.
+///
+/// Probing compares keys only, so it then never reads the values. With
+/// values much larger than the keys, many more keys share a cache line, and
+/// lookups that probe several slots, or miss, touch a fraction of the memory;
+/// the value is read only on a hit. Empty slots still take up room for a
+/// value. Iterators return pairs of references, `std::pair<const Key&,
+/// Value&>`, rather than references to `std::pair<Key, Value>`; `(*it).second`
+/// and `it->second` work as usual, but `auto&` cannot bind to `*it`. Only
+/// applies to maps.
+///
+/// Composes with the other adapters, e.g.
+/// `SplitKeyValue<GroupProbing<LargeSizePolicy>>`.
+template <typename SizePolicy>
+struct SplitKeyValue : public SizePolicy {
+  template <typename Entry, typename Allocator>
+  using slots = internal::SplitSlots<Entry, Allocator>;
+};
+
+// Returns the number of elements that a table of the given capacity index
+// holds before it grows, given the maximum load factor in units of 2^-16.
+// At the largest capacity, which can't grow any further, that is
+// SizePolicy::kMaxResizeThreshold instead.
+template <typename SizePolicy = SmallSizePolicy>
+constexpr typename SizePolicy::index_type resizeThreshold(
+    int capacity_idx, uint16_t max_load = kDefaultMaxLoad) {
+  return capacity_idx == SizePolicy::kMaxCapacityIdx
+             ? SizePolicy::kMaxResizeThreshold
+             : (typename SizePolicy::index_type)(
+                   ((uint64_t)SizePolicy::htLen(capacity_idx) * max_load) >>
+                   16);
+}
+
+// Returns the smallest capacity index whose resize threshold is at least
+// `size_hint`.
+template <typename SizePolicy = SmallSizePolicy>
+constexpr int initialCapacityIdx(typename SizePolicy::index_type size_hint,
+                                 uint16_t max_load = kDefaultMaxLoad) {
+  for (int idx = 0; idx < SizePolicy::kMaxCapacityIdx; ++idx) {
+    if (resizeThreshold<SizePolicy>(idx, max_load) >= size_hint) return idx;
   }
-  return 15;
+  return SizePolicy::kMaxCapacityIdx;
+}
+
+// Offset of the stored hashes from the start of the control bytes, for a
+// table of the given length: past the group padding, and aligned for
+// uint32_t.
+template <typename SizePolicy>
+constexpr size_t storedHashesOffset(size_t len) {
+  return (len + SizePolicy::group_type::kWidth - 1 + 3) & ~(size_t)3;
+}
+
+// Returns the number of 32-bit words holding the control bytes for the given
+// capacity, followed by padding that lets a group be loaded from any slot,
+// and then by the stored hashes, if any.
+template <typename SizePolicy>
+constexpr size_t controlWords(int capacity_idx) {
+  return ((SizePolicy::kStoreHash
+               ? storedHashesOffset<SizePolicy>(
+                     SizePolicy::htLen(capacity_idx)) +
+                     SizePolicy::htLen(capacity_idx) * sizeof(uint32_t)
+               : SizePolicy::htLen(capacity_idx) +
+                     SizePolicy::group_type::kWidth - 1) +
+          3) /
+         4;
 }
 
-template <typename InputIt>
-inline uint16_t initialCapacityHint(InputIt first, InputIt last,
-                                    std::input_iterator_tag) {
+template <typename SizePolicy, typename InputIt>
+inline typename SizePolicy::index_type initialCapacityHint(
+    InputIt first, InputIt last, std::input_iterator_tag) {
   return 8;
 }
 
-template <typename ForwardIt>
-inline uint16_t initialCapacityHint(ForwardIt first, ForwardIt last,
-                                    std::forward_iterator_tag) {
+template <typename SizePolicy, typename ForwardIt>
+inline typename SizePolicy::index_type initialCapacityHint(
+    ForwardIt first, ForwardIt last, std::forward_iterator_tag) {
+  using index_type = typename SizePolicy::index_type;
   size_t count = std::distance(first, last);
-  if (count > 65535) count = 65535;
+  if (count > std::numeric_limits<index_type>::max()) {
+    count = std::numeric_limits<index_type>::max();
+  }
   if (count < 8) count = 8;
   return count;
 }
 
-template <typename InputIt>
-inline uint16_t initialCapacityHint(InputIt first, InputIt last) {
-  return initialCapacityHint(
+template <typename SizePolicy = SmallSizePolicy, typename InputIt>
+inline typename SizePolicy::index_type initialCapacityHint(InputIt first,
+                                                           InputIt last) {
+  return initialCapacityHint<SizePolicy>(
       first, last, typename std::iterator_traits<InputIt>::iterator_category());
 }
 
+// Hints the CPU to start loading the cache line at `addr`.
+inline void prefetch(const void* addr) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(addr);
+#endif
+}
+
 template <typename Key>
 struct DefaultHashFn : public std::hash<Key> {};
 
+/// @brief String hash based on `murmur3_32`. Compact and fast enough on
+/// 32-bit microcontrollers; the default.
+struct Murmur3StringHash {
+  inline size_t operator()(::roo::string_view val) const {
+    return murmur3_32(val.data(), val.size(), 0x92F4E42BUL);
+  }
+};
+
+/// @brief String hash based on `wyhash64`. The fastest choice on 64-bit
+/// hosts, particularly for keys longer than a few bytes.
+struct WyStringHash {
+  inline size_t operator()(::roo::string_view val) const {
+    return (size_t)wyhash64(val.data(), val.size(), 0x92F4E42BUL);
+  }
+};
+
+/// @brief String hash based on `crc32c`, followed by a finalizer that spreads
+/// the checksum over all bits. Fast on targets where `kHardwareCrc32c` is
+/// true, and very slow otherwise.
+struct Crc32cStringHash {
+  inline size_t operator()(::roo::string_view val) const {
+    return fmix32(crc32c(val.data(), val.size(), 0x92F4E42BUL));
+  }
+};
+
+// To change the hash used for all strings by default, define
+// ROO_COLLECTIONS_STRING_HASH (e.g. as ::roo_collections::WyStringHash) in the
+// build flags. Individual containers can instead pick the hash explicitly,
+// via BasicTransparentStringHashFn.
+#ifndef ROO_COLLECTIONS_STRING_HASH
+#define ROO_COLLECTIONS_STRING_HASH ::roo_collections::Murmur3StringHash
+#endif
+
+using DefaultStringHash = ROO_COLLECTIONS_STRING_HASH;
+
 template <>
 struct DefaultHashFn<::roo::string_view> {
   inline size_t operator()(::roo::string_view val) const {
-    return murmur3_32(val.data(), val.size(), 0x92F4E42BUL);
+    return DefaultStringHash()(val);
   }
 };
 
@@ -130,7 +538,10 @@ struct DefaultHashFn<::String> {
 };
 #endif
 
-struct TransparentStringHashFn {
+/// @brief Transparent hash over all supported string types, computed with
+/// the given string hash.
+template <typename StringHash = DefaultStringHash>
+struct BasicTransparentStringHashFn {
   // Required to denote a transparent hash.
   using is_transparent = void;
 
@@ -138,32 +549,34 @@ struct TransparentStringHashFn {
   // a == b => hash(a) == hash(b).
 
   inline size_t operator()(const std::string& val) const {
-    return DefaultHashFn<std::string>()(val);
+    return StringHash()(::roo::string_view(val));
   }
   inline size_t operator()(const char* val) const {
-    return DefaultHashFn<const char*>()(val);
+    return StringHash()(::roo::string_view(val));
   }
   inline size_t operator()(::roo::string_view val) const {
-    return DefaultHashFn<::roo::string_view>()(val);
+    return StringHash()(val);
   }
   template <size_t N>
   inline size_t operator()(const SmallString<N>& val) const {
-    return DefaultHashFn<::roo::string_view>()(val);
+    return StringHash()(val);
   }
 
 #ifdef ARDUINO
-  inline size_t operator()(::String val) const {
-    return DefaultHashFn<::String>()(val);
+  inline size_t operator()(const ::String& val) const {
+    return StringHash()(::roo::string_view(val.c_str(), val.length()));
   }
 #endif
 };
 
+using TransparentStringHashFn = BasicTransparentStringHashFn<>;
+
 struct TransparentEq {
   // Required to denote a transparent comparator.
   using is_transparent = void;
 
   template <typename X, typename Y>
-  inline bool operator()(const X& x, const Y& y) const {
+  constexpr bool operator()(const X& x, const Y& y) const {
     return x == y;
   }
 };
@@ -184,44 +597,128 @@ using has_is_transparent_t =
 // For maps, where Key == Entry.
 template <typename Entry>
 struct DefaultKeyFn {
-  const Entry& operator()(const Entry& entry) const { return entry; }
+  constexpr const Entry& operator()(const Entry& entry) const { return entry; }
+};
+
+/// @brief Snapshot of the internal state of a hashtable, for diagnosing slow
+/// lookups. See `FlatSmallHashtable::stats()`.
+///
+/// Probe lengths count the groups of control bytes inspected by a lookup;
+/// with the default single-slot probing, that is the number of slots. A
+/// lookup that ends in the home group has length 1.
+struct HashtableStats {
+  /// @brief Number of buckets of `probe_length_histogram`.
+  static constexpr int kHistogramSize = 16;
+
+  /// @brief Number of stored elements.
+  size_t size;
+
+  /// @brief Length of the slot array.
+  size_t ht_len;
+
+  /// @brief Number of tombstones left behind by erased entries.
+  size_t tombstones;
+
+  /// @brief `size / ht_len`.
+  float load_factor;
+
+  /// @brief `tombstones / ht_len`.
+  float tombstone_ratio;
+
+  /// @brief Average probe length of lookups that find their key, over all
+  /// stored elements.
+  float avg_hit_probe_length;
+
+  /// @brief Longest probe length of lookups that find their key.
+  size_t max_hit_probe_length;
+
+  /// @brief Average probe length of lookups of absent keys, over all home
+  /// slots.
+  float avg_miss_probe_length;
+
+  /// @brief Longest probe length of lookups of absent keys.
+  size_t max_miss_probe_length;
+
+  /// @brief Number of stored elements by probe length: element `i` counts
+  /// those found with probe length `i + 1`. The last bucket also counts all
+  /// longer probes.
+  size_t probe_length_histogram[kHistogramSize];
+
+  /// @brief Number of slots, since construction or the last `reset_stats()`,
+  /// whose 7-bit tag matched the looked-up key, and which were therefore
+  /// compared against it.
+  ///
+  /// Collected only when compiled with `ROO_COLLECTIONS_HASHTABLE_STATS`
+  /// defined; zero otherwise.
+  uint64_t tag_matches;
+
+  /// @brief Number of those tag matches where the key did not match after
+  /// all. A high ratio to `tag_matches` points to a poor hash function.
+  ///
+  /// Collected only when compiled with `ROO_COLLECTIONS_HASHTABLE_STATS`
+  /// defined; zero otherwise.
+  uint64_t tag_false_positives;
 };
 
+namespace internal {
+
+// Reads the slot arrays of a table, to serialize it. See
+// flat_hashtable_snapshot.h.
+struct SnapshotAccess;
+
+}  // namespace internal
+
 /// @brief Flat, memory-conscious hash table optimized for small collections.
 ///
 /// Uses open addressing with quadratic probing and stores entries in contiguous
-/// arrays for low overhead. Maximum supported size is approximately 64k
-/// elements.
+/// arrays for low overhead. With the default `SmallSizePolicy`, maximum
+/// supported size is approximately 64k elements; `LargeSizePolicy` lifts it to
+/// approximately 4 billion elements, at the cost of 32-bit counters and
+/// iterator positions.
 ///
 /// @tparam Entry Stored entry type.
 /// @tparam Key Key type used for lookup.
 /// @tparam HashFn Hash function.
 /// @tparam KeyFn Extracts a key from an entry.
 /// @tparam KeyCmpFn Key equality predicate.
+/// @tparam SizePolicy Width of indices and the matching capacity sequence.
+/// @tparam Allocator Allocator of entries, e.g. `std::pmr::polymorphic_allocator`.
+/// It is rebound to allocate the control bytes too. Its `pointer` type must be
+/// a raw pointer. Propagates on copy, move, and swap as dictated by
+/// `std::allocator_traits`.
 template <typename Entry, typename Key, typename HashFn = DefaultHashFn<Key>,
           typename KeyFn = DefaultKeyFn<Entry>,
-          typename KeyCmpFn = std::equal_to<Key>>
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy,
+          typename Allocator = std::allocator<Entry>>
 class FlatSmallHashtable {
+  static_assert(
+      std::is_same<typename Allocator::value_type, Entry>::value,
+      "Allocator::value_type must be the same as the entry type");
+
+  // Layout of the entries in the slot array.
+  using Slots = typename SizePolicy::template slots<Entry, Allocator>;
+
  public:
+  /// @brief Unsigned type of sizes, capacities and slot indices.
+  using size_type = typename SizePolicy::index_type;
+
   /// @brief Constant forward iterator.
   class ConstIterator {
    public:
     using iterator_category = std::forward_iterator_tag;
     using difference_type = std::ptrdiff_t;
     using value_type = const Entry;
-    using pointer = const Entry*;
-    using reference = const Entry&;
+    using pointer = typename Slots::const_pointer;
+    using reference = typename Slots::const_reference;
 
     ConstIterator() : ConstIterator(nullptr, 0) {}
 
-    const Entry& operator*() const { return ht_->buffer_[pos_]; }
-    const Entry* operator->() const { return &ht_->buffer_[pos_]; }
+    reference operator*() const { return ht_->slots_.at(pos_); }
+    pointer operator->() const { return ht_->slots_.constAddress(pos_); }
 
     ConstIterator& operator++() {
-      uint16_t ht_len = ht_->ht_len();
-      do {
-        ++pos_;
-      } while (pos_ < ht_len && ht_->states_[pos_] >= 0);
+      pos_ = ht_->nextFull(pos_ + 1);
       return *this;
     }
 
@@ -242,13 +739,11 @@ class FlatSmallHashtable {
    private:
     friend class FlatSmallHashtable;
 
-    ConstIterator(
-        const FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn>* ht,
-        uint16_t pos)
+    ConstIterator(const FlatSmallHashtable* ht, size_type pos)
         : ht_(ht), pos_(pos) {}
 
-    const FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn>* ht_;
-    uint16_t pos_;
+    const FlatSmallHashtable* ht_;
+    size_type pos_;
   };
 
   /// @brief Mutable forward iterator.
@@ -257,21 +752,18 @@ class FlatSmallHashtable {
     using iterator_category = std::forward_iterator_tag;
     using difference_type = std::ptrdiff_t;
     using value_type = Entry;
-    using pointer = Entry*;
-    using reference = Entry&;
+    using pointer = typename Slots::pointer;
+    using reference = typename Slots::reference;
 
     Iterator() : Iterator(nullptr, 0) {}
 
-    Entry& operator*() { return ht_->buffer_[pos_]; }
-    Entry* operator->() { return &ht_->buffer_[pos_]; }
+    reference operator*() { return ht_->slots_.at(pos_); }
+    pointer operator->() { return ht_->slots_.address(pos_); }
 
     operator ConstIterator() const { return ConstIterator(ht_, pos_); }
 
     Iterator& operator++() {
-      uint16_t ht_len = ht_->ht_len();
-      do {
-        ++pos_;
-      } while (pos_ < ht_len && ht_->states_[pos_] >= 0);
+      pos_ = ht_->nextFull(pos_ + 1);
       return *this;
     }
 
@@ -292,27 +784,29 @@ class FlatSmallHashtable {
    private:
     friend class FlatSmallHashtable;
 
-    Iterator(FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn>* ht,
-             uint16_t pos)
-        : ht_(ht), pos_(pos) {}
+    Iterator(FlatSmallHashtable* ht, size_type pos) : ht_(ht), pos_(pos) {}
 
-    FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn>* ht_;
-    uint16_t pos_;
+    FlatSmallHashtable* ht_;
+    size_type pos_;
   };
 
   using key_type = Key;
   using value_type = Entry;
+  using reference = typename Slots::reference;
+  using const_reference = typename Slots::const_reference;
   using hasher = HashFn;
   using key_equal = KeyCmpFn;
+  using allocator_type = Allocator;
   using iterator = Iterator;
   using const_iterator = ConstIterator;
 
   /// @brief Constructs a table from an iterator range.
   template <typename InputIt>
   FlatSmallHashtable(InputIt first, InputIt last, HashFn hash_fn = HashFn(),
-                     KeyFn key_fn = KeyFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : FlatSmallHashtable(initialCapacityHint(first, last), hash_fn, key_fn,
-                           key_cmp_fn) {
+                     KeyFn key_fn = KeyFn(), KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                     const Allocator& alloc = Allocator())
+      : FlatSmallHashtable(initialCapacityHint<SizePolicy>(first, last),
+                           hash_fn, key_fn, key_cmp_fn, alloc) {
     for (auto it = first; it != last; ++it) {
       insert(*it);
     }
@@ -321,136 +815,162 @@ class FlatSmallHashtable {
   /// @brief Constructs a table from an initializer list.
   FlatSmallHashtable(std::initializer_list<Entry> init,
                      HashFn hash_fn = HashFn(), KeyFn key_fn = KeyFn(),
-                     KeyCmpFn key_cmp_fn = KeyCmpFn())
+                     KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                     const Allocator& alloc = Allocator())
       : FlatSmallHashtable(init.begin(), init.end(), hash_fn, key_fn,
-                           key_cmp_fn) {}
+                           key_cmp_fn, alloc) {}
 
   /// @brief Constructs an empty table with default initial capacity.
   FlatSmallHashtable(HashFn hash_fn = HashFn(), KeyFn key_fn = KeyFn(),
-                     KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : FlatSmallHashtable(8, hash_fn, key_fn, key_cmp_fn) {}
+                     KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                     const Allocator& alloc = Allocator())
+      : FlatSmallHashtable(8, hash_fn, key_fn, key_cmp_fn, alloc) {}
+
+  /// @brief Constructs an empty table with default initial capacity, using
+  /// the given allocator.
+  explicit FlatSmallHashtable(const Allocator& alloc)
+      : FlatSmallHashtable(8, HashFn(), KeyFn(), KeyCmpFn(), alloc) {}
 
   /// @brief Constructs an empty table sized for `size_hint` elements.
   /// @param size_hint Expected number of items.
-  FlatSmallHashtable(uint16_t size_hint, HashFn hash_fn = HashFn(),
-                     KeyFn key_fn = KeyFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
-      : hash_fn_(hash_fn),
-        key_fn_(key_fn),
-        key_cmp_fn_(key_cmp_fn),
-        capacity_idx_(initialCapacityIdx(size_hint)),
-        used_(0),
-        erased_(0),
-        resize_threshold_(
-            capacity_idx_ == 15
-                ? 64000
-                : (uint16_t)(((float)kRadkePrimes[capacity_idx_]) *
-                             kMaxFillRatio)),
-        buffer_(capacity_idx_ > 0 ? new Entry[kRadkePrimes[capacity_idx_]]
-                                  : nullptr),
-        states_(capacity_idx_ > 0 ? new State[kRadkePrimes[capacity_idx_]]
-                                  : &dummy_empty_state_) {
-    std::fill(&states_[0], &states_[kRadkePrimes[capacity_idx_]], EMPTY);
-  }
+  FlatSmallHashtable(size_type size_hint, HashFn hash_fn = HashFn(),
+                     KeyFn key_fn = KeyFn(), KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                     const Allocator& alloc = Allocator())
+      : FlatSmallHashtable(
+            CapacityIdx{initialCapacityIdx<SizePolicy>(size_hint)},
+            kDefaultMaxLoad, hash_fn, key_fn, key_cmp_fn, alloc) {}
 
   /// @brief Move constructor.
   FlatSmallHashtable(FlatSmallHashtable&& other)
       : hash_fn_(std::move(other.hash_fn_)),
         key_fn_(std::move(other.key_fn_)),
         key_cmp_fn_(std::move(other.key_cmp_fn_)),
+        alloc_(std::move(other.alloc_)),
         capacity_idx_(other.capacity_idx_),
         used_(other.used_),
         erased_(other.erased_),
         resize_threshold_(other.resize_threshold_),
-        buffer_(other.buffer_),
-        states_(nullptr),
-        dummy_empty_state_(EMPTY) {
-    states_ = capacity_idx_ > 0 ? other.states_ : &dummy_empty_state_;
+        max_load_(other.max_load_),
+        slots_(other.slots_),
+        states_(other.states_) {
     other.resetToEmptySentinel();
   }
 
+  /// @brief Move constructor with an explicit allocator. If it differs from
+  /// the allocator of `other`, the entries are moved one by one.
+  FlatSmallHashtable(FlatSmallHashtable&& other, const Allocator& alloc)
+      : hash_fn_(std::move(other.hash_fn_)),
+        key_fn_(std::move(other.key_fn_)),
+        key_cmp_fn_(std::move(other.key_cmp_fn_)),
+        alloc_(alloc),
+        capacity_idx_(other.capacity_idx_),
+        used_(other.used_),
+        erased_(other.erased_),
+        resize_threshold_(other.resize_threshold_),
+        max_load_(other.max_load_) {
+    if (alloc_ == other.alloc_) {
+      slots_ = other.slots_;
+      states_ = other.states_;
+      other.resetToEmptySentinel();
+    } else {
+      slots_ = allocateSlots(capacity_idx_);
+      states_ = allocateStates(capacity_idx_);
+      transferEntriesFrom<true>(other);
+    }
+  }
+
   /// @brief Copy constructor.
   FlatSmallHashtable(const FlatSmallHashtable& other)
+      : FlatSmallHashtable(
+            other, AllocTraits::select_on_container_copy_construction(
+                       other.alloc_)) {}
+
+  /// @brief Copy constructor with an explicit allocator.
+  FlatSmallHashtable(const FlatSmallHashtable& other, const Allocator& alloc)
       : hash_fn_(other.hash_fn_),
         key_fn_(other.key_fn_),
         key_cmp_fn_(other.key_cmp_fn_),
+        alloc_(alloc),
         capacity_idx_(other.capacity_idx_),
         used_(other.used_),
         erased_(other.erased_),
         resize_threshold_(other.resize_threshold_),
-        buffer_(capacity_idx_ > 0 ? new Entry[kRadkePrimes[capacity_idx_]]
-                                  : nullptr),
-        states_(capacity_idx_ > 0 ? new State[kRadkePrimes[capacity_idx_]]
-                                  : &dummy_empty_state_) {
-    if (other.buffer_ != nullptr) {
-      std::copy(&other.buffer_[0], &other.buffer_[kRadkePrimes[capacity_idx_]],
-                &buffer_[0]);
-    }
-    std::copy(&other.states_[0], &other.states_[kRadkePrimes[capacity_idx_]],
-              &states_[0]);
+        max_load_(other.max_load_),
+        slots_(allocateSlots(capacity_idx_)),
+        states_(allocateStates(capacity_idx_)) {
+    transferEntriesFrom<false>(other);
   }
 
   /// @brief Destructor.
-  ~FlatSmallHashtable() {
-    if (capacity_idx_ > 0) delete[] states_;
-    delete[] buffer_;
-  }
+  ~FlatSmallHashtable() { releaseStorage(); }
 
   /// @brief Move assignment.
+  ///
+  /// Takes over the storage of `other`, unless the allocator does not
+  /// propagate on move assignment and differs from that of `other`; then,
+  /// the entries are moved one by one into storage from this allocator.
   FlatSmallHashtable& operator=(FlatSmallHashtable&& other) {
-    if (this != &other) {
-      if (capacity_idx_ > 0) delete[] states_;
-      delete[] buffer_;
-      hash_fn_ = std::move(other.hash_fn_);
-      key_fn_ = std::move(other.key_fn_);
-      key_cmp_fn_ = std::move(other.key_cmp_fn_);
-      capacity_idx_ = other.capacity_idx_;
-      used_ = other.used_;
-      erased_ = other.erased_;
-      resize_threshold_ = other.resize_threshold_;
-      buffer_ = other.buffer_;
-      dummy_empty_state_ = EMPTY;
-      states_ = capacity_idx_ > 0 ? other.states_ : &dummy_empty_state_;
-      other.resetToEmptySentinel();
+    if (this == &other) return *this;
+    releaseStorage();
+    hash_fn_ = std::move(other.hash_fn_);
+    key_fn_ = std::move(other.key_fn_);
+    key_cmp_fn_ = std::move(other.key_cmp_fn_);
+    capacity_idx_ = other.capacity_idx_;
+    used_ = other.used_;
+    erased_ = other.erased_;
+    resize_threshold_ = other.resize_threshold_;
+    max_load_ = other.max_load_;
+    if (AllocTraits::propagate_on_container_move_assignment::value) {
+      assignAllocator(
+          other.alloc_,
+          typename AllocTraits::propagate_on_container_move_assignment());
+    } else if (!(alloc_ == other.alloc_)) {
+      slots_ = allocateSlots(capacity_idx_);
+      states_ = allocateStates(capacity_idx_);
+      transferEntriesFrom<true>(other);
+      return *this;
     }
+    slots_ = other.slots_;
+    states_ = other.states_;
+    other.resetToEmptySentinel();
     return *this;
   }
 
   /// @brief Copy assignment.
   FlatSmallHashtable& operator=(const FlatSmallHashtable& other) {
     if (this != &other) {
-      if (capacity_idx_ > 0) delete[] states_;
-      delete[] buffer_;
+      releaseStorage();
       hash_fn_ = other.hash_fn_;
       key_fn_ = other.key_fn_;
       key_cmp_fn_ = other.key_cmp_fn_;
+      assignAllocator(
+          other.alloc_,
+          typename AllocTraits::propagate_on_container_copy_assignment());
       capacity_idx_ = other.capacity_idx_;
       used_ = other.used_;
       erased_ = other.erased_;
       resize_threshold_ = other.resize_threshold_;
-      buffer_ =
-          capacity_idx_ > 0 ? new Entry[kRadkePrimes[capacity_idx_]] : nullptr;
-      states_ = capacity_idx_ > 0 ? new State[kRadkePrimes[capacity_idx_]]
-                                  : &dummy_empty_state_;
-      if (other.buffer_ != nullptr) {
-        std::copy(&other.buffer_[0],
-                  &other.buffer_[kRadkePrimes[capacity_idx_]], &buffer_[0]);
-      }
-      std::copy(&other.states_[0], &other.states_[kRadkePrimes[capacity_idx_]],
-                &states_[0]);
+      max_load_ = other.max_load_;
+      slots_ = allocateSlots(capacity_idx_);
+      states_ = allocateStates(capacity_idx_);
+      transferEntriesFrom<false>(other);
     }
     return *this;
   }
 
+  /// @brief Returns a copy of the allocator.
+  allocator_type get_allocator() const { return alloc_; }
+
   /// @brief Equality comparison by key/value content.
   bool operator==(const FlatSmallHashtable& other) const {
     if (other.size() != size()) return false;
     // Note: maps with different capacities or different insert/erase history
     // may have different iteration order, thus we need to use lookup on one of
     // them.
-    for (const auto& e : *this) {
-      auto itr = other.find(key_fn_(e));
+    for (ConstIterator it = begin(); it != end(); ++it) {
+      auto itr = other.find(keyAt(it.pos_));
       if (itr == other.end()) return false;
-      if (*itr != e) return false;
+      if (*itr != *it) return false;
     }
     return true;
   }
@@ -460,26 +980,38 @@ class FlatSmallHashtable {
   }
 
   /// @brief Returns the internal bucket array length.
-  uint16_t ht_len() const { return kRadkePrimes[capacity_idx_]; }
+  size_type ht_len() const { return SizePolicy::htLen(capacity_idx_); }
 
   /// @brief Returns an iterator to the first element.
-  ConstIterator begin() const {
-    uint16_t cap = ht_len();
-    uint16_t pos = 0;
-    for (; pos < cap; ++pos) {
-      if (states_[pos] < 0) break;
-    }
-    return ConstIterator(this, pos);
-  }
+  ConstIterator begin() const { return ConstIterator(this, nextFull(0)); }
 
   /// @brief Returns a mutable iterator to the first element.
-  Iterator begin() {
-    uint16_t cap = ht_len();
-    uint16_t pos = 0;
-    for (; pos < cap; ++pos) {
-      if (states_[pos] < 0) break;
-    }
-    return Iterator(this, pos);
+  Iterator begin() { return Iterator(this, nextFull(0)); }
+
+  /// @brief Calls `fn(entry)` for every entry, in iteration order.
+  ///
+  /// Faster than a loop over the iterators for full-table scans: it reads
+  /// the table bounds once, and stops right after the last entry. `fn` must
+  /// not insert or erase entries.
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    forEachFullSlot([&](size_type pos) {
+      const_reference entry = slots_.at(pos);
+      fn(entry);
+    });
+  }
+
+  /// @brief Calls `fn(entry)` for every entry, in iteration order, with
+  /// mutable access.
+  ///
+  /// `fn` may modify the entries, but not their keys, and must not insert or
+  /// erase entries.
+  template <typename Fn>
+  void for_each(Fn&& fn) {
+    forEachFullSlot([&](size_type pos) {
+      reference entry = slots_.at(pos);
+      fn(entry);
+    });
   }
 
   /// @brief Returns iterator past the end.
@@ -489,39 +1021,89 @@ class FlatSmallHashtable {
   ConstIterator end() const { return ConstIterator(this, ht_len()); }
 
   /// @brief Returns the number of stored elements.
-  uint16_t size() const { return used_ - erased_; }
+  size_type size() const { return used_ - erased_; }
 
   /// @brief Returns whether the table is empty.
   bool empty() const { return used_ == erased_; }
 
   /// @brief Returns the number of elements insertable before rehashing.
-  uint16_t capacity() const { return resize_threshold_; }
+  size_type capacity() const { return resize_threshold_; }
+
+  /// @brief Returns the number of tombstones left behind by erased entries.
+  ///
+  /// Inserts reuse tombstones on their probe paths, and the rest are purged in
+  /// place once they crowd out the empty slots.
+  size_type tombstones() const { return erased_; }
+
+  /// @brief Returns the hash function.
+  ///
+  /// Tables of the same key type that share a hash function can be probed
+  /// with one precomputed hash, via the `*_with_hash` methods.
+  hasher hash_function() const { return hash_fn_; }
+
+  /// @brief Returns probe length, tombstone, and load statistics.
+  ///
+  /// Replays the probe sequence of every element, and of a lookup miss from
+  /// every slot, so it takes time proportional to `ht_len()` times the
+  /// average probe length, and rehashes all keys unless the hashes are
+  /// stored. Meant for diagnostics, not for frequent calls.
+  ///
+  /// The tag match counters are only collected when compiled with
+  /// `ROO_COLLECTIONS_HASHTABLE_STATS` defined. They then make every lookup
+  /// write to the table, so concurrent const lookups are no longer safe.
+  HashtableStats stats() const {
+    HashtableStats stats;
+    size_type len = ht_len();
+    stats.size = size();
+    stats.ht_len = len;
+    stats.tombstones = erased_;
+    stats.load_factor = (float)size() / len;
+    stats.tombstone_ratio = (float)erased_ / len;
+    std::fill(&stats.probe_length_histogram[0],
+              &stats.probe_length_histogram[HashtableStats::kHistogramSize],
+              0);
+    size_t total = 0;
+    size_t max = 0;
+    forEachFullSlot([&](size_type pos) {
+      size_t length = hitProbeLength(pos);
+      total += length;
+      if (length > max) max = length;
+      size_t bucket = std::min<size_t>(length, HashtableStats::kHistogramSize);
+      ++stats.probe_length_histogram[bucket - 1];
+    });
+    stats.avg_hit_probe_length = size() == 0 ? 0 : (float)total / size();
+    stats.max_hit_probe_length = max;
+    total = 0;
+    max = 0;
+    for (size_type i = 0; i < len; ++i) {
+      size_t length = missProbeLength(i);
+      total += length;
+      if (length > max) max = length;
+    }
+    stats.avg_miss_probe_length = (float)total / len;
+    stats.max_miss_probe_length = max;
+#ifdef ROO_COLLECTIONS_HASHTABLE_STATS
+    stats.tag_matches = tag_matches_;
+    stats.tag_false_positives = tag_false_positives_;
+#else
+    stats.tag_matches = 0;
+    stats.tag_false_positives = 0;
+#endif
+    return stats;
+  }
+
+#ifdef ROO_COLLECTIONS_HASHTABLE_STATS
+  /// @brief Resets the tag match counters reported by `stats()`.
+  void reset_stats() {
+    tag_matches_ = 0;
+    tag_false_positives_ = 0;
+  }
+#endif
 
   /// @brief Finds `key` and returns a const iterator to the matching entry.
   /// @return `end()` when not found.
   ConstIterator find(const Key& key) const {
-    size_t hash = hash_fn_(key);
-    const uint16_t pos = fastmod(hash, capacity_idx_);
-    if (states_[pos] == EMPTY) return end();
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      return ConstIterator(this, pos);
-    }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
-    while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) return end();
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        return ConstIterator(this, p);
-      }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
-    }
+    return ConstIterator(this, findPos(key, hash_fn_(key)));
   }
 
   /// @brief Heterogeneous lookup overload of `find`.
@@ -529,69 +1111,72 @@ class FlatSmallHashtable {
   template <typename K, typename = has_is_transparent_t<HashFn, K>,
             typename = has_is_transparent_t<KeyCmpFn, K>>
   ConstIterator find(const K& key) const {
-    size_t hash = hash_fn_(key);
-    const uint16_t pos = fastmod(hash, capacity_idx_);
-    if (states_[pos] == EMPTY) return end();
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      return ConstIterator(this, pos);
-    }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
-    while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) return end();
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        return ConstIterator(this, p);
-      }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
-    }
+    return ConstIterator(this, findPos(key, hash_fn_(key)));
+  }
+
+  /// @brief Finds `key`, given its hash, and returns a const iterator to the
+  /// matching entry.
+  ///
+  /// `hash` must be equal to `hash_function()(key)`. Lets a key hashed once
+  /// be looked up in several tables that share the hash function.
+  /// @return `end()` when not found.
+  ConstIterator find_with_hash(const Key& key, size_t hash) const {
+    return ConstIterator(this, findPosWithHash(key, hash));
+  }
+
+  /// @brief Heterogeneous lookup overload of `find_with_hash`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  ConstIterator find_with_hash(const K& key, size_t hash) const {
+    return ConstIterator(this, findPosWithHash(key, hash));
+  }
+
+  /// @brief Looks up `count` keys at once, storing an iterator to the entry
+  /// for each of `keys`, or `end()`, at the same index of `results`.
+  ///
+  /// All keys of a batch are hashed, and their home slots prefetched, before
+  /// any of them is probed, so that the cache misses of many keys overlap.
+  /// Pays off for lookups of many keys in a table that does not fit in cache.
+  void find_batch(const Key* keys, size_t count,
+                  ConstIterator* results) const {
+    probeBatch(keys, count, [&](size_t i, size_type pos) {
+      results[i] = ConstIterator(this, pos);
+    });
+  }
+
+  /// @brief Heterogeneous lookup overload of `find_batch`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  void find_batch(const K* keys, size_t count, ConstIterator* results) const {
+    probeBatch(keys, count, [&](size_t i, size_type pos) {
+      results[i] = ConstIterator(this, pos);
+    });
+  }
+
+  /// @brief Checks `count` keys at once, storing whether each of `keys` is
+  /// present at the same index of `results`. See `find_batch`.
+  void contains_batch(const Key* keys, size_t count, bool* results) const {
+    probeBatch(keys, count, [&](size_t i, size_type pos) {
+      results[i] = (pos != ht_len());
+    });
+  }
+
+  /// @brief Heterogeneous key overload of `contains_batch`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  void contains_batch(const K* keys, size_t count, bool* results) const {
+    probeBatch(keys, count, [&](size_t i, size_type pos) {
+      results[i] = (pos != ht_len());
+    });
   }
 
   /// @brief Removes an entry by key.
   /// @return `true` if an entry was removed.
   bool erase(const Key& key) {
-    size_t hash = hash_fn_(key);
-    const uint16_t pos = fastmod(hash, capacity_idx_);
-    if (states_[pos] == EMPTY) return false;
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      buffer_[pos] = Entry();
-      if (used_ == 1 && erased_ == 0) {
-        // Fast path (fast-clear). It is safe to do because there was no
-        // rehashing. (It only works when used_ == 1, because otherwise the
-        // other items might have been rehashed away from this bucket).
-        states_[pos] = EMPTY;
-        --used_;
-      } else {
-        states_[pos] = DELETED;
-        ++erased_;
-      }
-      return true;
-    }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
-    while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) return false;
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        states_[p] = DELETED;
-        buffer_[p] = Entry();
-        ++erased_;
-        return true;
-      }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
-    }
+    size_type pos = findPos(key, hash_fn_(key));
+    if (pos == ht_len()) return false;
+    eraseAt(pos);
+    return true;
   }
 
   /// @brief Heterogeneous key overload of `erase`.
@@ -599,34 +1184,29 @@ class FlatSmallHashtable {
   template <typename K, typename = has_is_transparent_t<HashFn, K>,
             typename = has_is_transparent_t<KeyCmpFn, K>>
   bool erase(const K& key) {
-    size_t hash = hash_fn_(key);
-    const uint16_t pos = fastmod(hash, capacity_idx_);
-    if (states_[pos] == EMPTY) return false;
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      states_[pos] = DELETED;
-      buffer_[pos] = Entry();
-      ++erased_;
-      return true;
-    }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
-    while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) return false;
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        states_[p] = DELETED;
-        buffer_[p] = Entry();
-        ++erased_;
-        return true;
-      }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
-    }
+    size_type pos = findPos(key, hash_fn_(key));
+    if (pos == ht_len()) return false;
+    eraseAt(pos);
+    return true;
+  }
+
+  /// @brief Removes an entry by key, given its hash. See `find_with_hash`.
+  /// @return `true` if an entry was removed.
+  bool erase_with_hash(const Key& key, size_t hash) {
+    size_type pos = findPosWithHash(key, hash);
+    if (pos == ht_len()) return false;
+    eraseAt(pos);
+    return true;
+  }
+
+  /// @brief Heterogeneous key overload of `erase_with_hash`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  bool erase_with_hash(const K& key, size_t hash) {
+    size_type pos = findPosWithHash(key, hash);
+    if (pos == ht_len()) return false;
+    eraseAt(pos);
+    return true;
   }
 
   /// @brief Removes the entry at `itr` and returns iterator to the next entry.
@@ -634,34 +1214,69 @@ class FlatSmallHashtable {
     if (itr == end()) return end();
     Iterator next(this, itr.pos_);
     ++next;
-    erase(key_fn_(*itr));
+    eraseAt(itr.pos_);
     return next;
   }
 
   /// @brief Removes all entries while preserving current allocated capacity.
   void clear() {
     if (used_ == 0 && erased_ == 0) return;
-    std::fill(&states_[0], &states_[kRadkePrimes[capacity_idx_]], EMPTY);
-    for (size_t i = 0; i < kRadkePrimes[capacity_idx_]; ++i) {
-      buffer_[i] = Entry();
-    }
-    // Avoiding std::fill, because it doesn't work for non-copyable entries.
-    // std::fill(&buffer_[0], &buffer_[kRadkePrimes[capacity_idx_]], Entry());
+    destroyEntries();
+    std::fill(&states_[0], &states_[ht_len()], EMPTY);
     used_ = 0;
     erased_ = 0;
   }
 
   /// @brief Rebuilds the table to remove tombstones and shrink capacity.
+  ///
+  /// With a `FixedCapacity` policy, only purges the tombstones in place.
   void compact() {
-    int capacity_idx = initialCapacityIdx(size());
-    if (capacity_idx == capacity_idx_ && erased_ == 0) return;
-    assert(capacity_idx < 15);  // Or, exceeded maximum hashtable size.
-    FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn> newt(
-        size(), hash_fn_, key_fn_, key_cmp_fn_);
-    for (auto& e : *this) {
-      newt.insert(std::move(e));
+    rebuild(initialCapacityIdx<SizePolicy>(size(), max_load_));
+  }
+
+  /// @brief Same as `compact()`.
+  void shrink_to_fit() { compact(); }
+
+  /// @brief Makes room for at least `n` elements, so that inserting up to
+  /// that many will not rehash. Never shrinks the table.
+  ///
+  /// With a `FixedCapacity` policy, does nothing.
+  void reserve(size_type n) {
+    if (SizePolicy::kFixedCapacity || n <= resize_threshold_) return;
+    rebuild(initialCapacityIdx<SizePolicy>(n, max_load_));
+  }
+
+  /// @brief Rebuilds the table, dropping tombstones, with at least `n` slots,
+  /// and at least enough to hold `size()` elements. May shrink the table.
+  ///
+  /// With a `FixedCapacity` policy, only purges the tombstones in place.
+  void rehash(size_type n) {
+    int capacity_idx = initialCapacityIdx<SizePolicy>(size(), max_load_);
+    while (capacity_idx < SizePolicy::kMaxCapacityIdx &&
+           SizePolicy::htLen(capacity_idx) < n) {
+      ++capacity_idx;
     }
-    *this = std::move(newt);
+    rebuild(capacity_idx);
+  }
+
+  /// @brief Returns the fraction of slots that may be used before the table
+  /// grows. Defaults to 0.73.
+  float max_load_factor() const { return max_load_ / 65536.0f; }
+
+  /// @brief Sets the fraction of slots that may be used before the table
+  /// grows. Lower values trade memory for shorter probe sequences.
+  ///
+  /// Clamped to [0.05, 0.95]. Takes effect on the current capacity right
+  /// away, without rehashing: if the table is now over the new threshold, it
+  /// grows on the next insert that needs an empty slot, and if it has become
+  /// much too large, it shrinks on the next `compact()` or rehash. At the
+  /// largest capacity, the table always fills up to
+  /// `SizePolicy::kMaxResizeThreshold`.
+  void max_load_factor(float ml) {
+    if (ml < 0.05f) ml = 0.05f;
+    if (ml > 0.95f) ml = 0.95f;
+    max_load_ = (uint16_t)(ml * 65536);
+    resize_threshold_ = resizeThreshold<SizePolicy>(capacity_idx_, max_load_);
   }
 
   /// @brief Returns whether `key` exists in the table.
@@ -674,164 +1289,748 @@ class FlatSmallHashtable {
     return find(key).pos_ != ht_len();
   }
 
-  /// @brief Inserts `val` if key is not present.
+  /// @brief Returns whether `key` exists in the table, given its hash. See
+  /// `find_with_hash`.
+  bool contains_with_hash(const Key& key, size_t hash) const {
+    return findPosWithHash(key, hash) != ht_len();
+  }
+
+  /// @brief Heterogeneous key overload of `contains_with_hash`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  bool contains_with_hash(const K& key, size_t hash) const {
+    return findPosWithHash(key, hash) != ht_len();
+  }
+
+  /// @brief Inserts a copy of `val` if its key is not present.
+  ///
+  /// The entry is copied only if it actually gets inserted. If the table is
+  /// full and can't grow, because its capacity is fixed or already the
+  /// largest its size policy supports, nothing is inserted, and the result
+  /// is `{end(), false}`.
   /// @return Pair of iterator and insertion flag.
-  std::pair<Iterator, bool> insert(Entry val) {
-    Key key = key_fn_(val);
-    size_t hash = hash_fn_(key);
-    uint16_t pos = fastmod(hash, capacity_idx_);
-    // Fast path.
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      return std::make_pair(Iterator(this, pos), false);
+  std::pair<Iterator, bool> insert(const Entry& val) {
+    return tryEmplace(key_fn_(val), val);
+  }
+
+  /// @brief Moves `val` into the table if its key is not present.
+  /// @return Pair of iterator and insertion flag.
+  std::pair<Iterator, bool> insert(Entry&& val) {
+    return tryEmplace(key_fn_(val), std::move(val));
+  }
+
+  /// @brief Inserts a copy of `val`, given the hash of its key, if the key is
+  /// not present. See `find_with_hash`.
+  /// @return Pair of iterator and insertion flag.
+  std::pair<Iterator, bool> insert_with_hash(const Entry& val, size_t hash) {
+    assert(hash == hash_fn_(key_fn_(val)));
+    return tryEmplaceWithHash(key_fn_(val), hash, val);
+  }
+
+  /// @brief Moves `val` into the table, given the hash of its key, if the key
+  /// is not present. See `find_with_hash`.
+  /// @return Pair of iterator and insertion flag.
+  std::pair<Iterator, bool> insert_with_hash(Entry&& val, size_t hash) {
+    assert(hash == hash_fn_(key_fn_(val)));
+    return tryEmplaceWithHash(key_fn_(val), hash, std::move(val));
+  }
+
+  /// @brief Constructs an entry from `args` and inserts it if its key is not
+  /// present.
+  ///
+  /// Since the key is only known once the entry exists, the entry is built
+  /// up front, and discarded if the key is already present. Prefer
+  /// `try_emplace` on maps when the key is available separately.
+  /// @return Pair of iterator and insertion flag.
+  template <typename... Args>
+  std::pair<Iterator, bool> emplace(Args&&... args) {
+    Entry entry(std::forward<Args>(args)...);
+    return insert(std::move(entry));
+  }
+
+  /// @brief Inserts copies of the entries in [first, last), whose keys must
+  /// be distinct from each other and from the keys already present.
+  ///
+  /// Skips the duplicate checks of `insert()`: each entry goes straight to
+  /// the first free slot on its probe sequence, without comparing any keys.
+  /// With forward iterators, the table is sized once up front. Duplicate
+  /// keys are only caught by assertions in debug builds.
+  /// @return The number of entries inserted, which is less than the length
+  /// of the range only if the table runs out of room: a `FixedCapacity`
+  /// one, or one at the largest capacity of its size policy.
+  template <typename InputIt>
+  size_t insert_unique_range(InputIt first, InputIt last) {
+    reserveForRange(first, last,
+                    typename std::iterator_traits<InputIt>::iterator_category());
+    size_t count = 0;
+    for (; first != last; ++first) {
+      size_t hash = hash_fn_(key_fn_(*first));
+      assert(findPosWithHash(key_fn_(*first), hash) == ht_len());
+      if (!appendUnique(*first, hash)) break;
+      ++count;
     }
-    if (used_ >= resize_threshold_) {
-      if (empty() && erased_ > 0) {
-        // Clearing is faster than rehashing.
-        clear();
+    return count;
+  }
+
+  /// @brief Moves the entries of `other` whose keys are not present into
+  /// this table. Entries with keys already present stay in `other`.
+  ///
+  /// If this table is empty, no keys are compared at all: if the allocators
+  /// are equal and the function objects stateless, the storage of `other` is
+  /// taken over, and otherwise the table is sized once, and the entries are
+  /// moved in as by `insert_unique_range()`. Otherwise, the table is sized
+  /// up front for the combined size of both, as if the keys were disjoint.
+  /// Stateless hash functions are not called again if the hashes are stored.
+  /// If this table fills up at the largest capacity of its `SizePolicy`, the
+  /// entries not moved yet stay in `other`.
+  void merge(FlatSmallHashtable& other) {
+    if (&other == this) return;
+    if (empty() && std::is_empty<HashFn>::value &&
+        std::is_empty<KeyCmpFn>::value && alloc_ == other.alloc_) {
+      uint16_t max_load = max_load_;
+      *this = std::move(other);
+      max_load_ = max_load;
+      resize_threshold_ =
+          resizeThreshold<SizePolicy>(capacity_idx_, max_load_);
+      return;
+    }
+    const bool unique = empty();
+    reserve((size_type)std::min<uint64_t>((uint64_t)size() + other.size(),
+                                          SizePolicy::kMaxResizeThreshold));
+    const size_type len = other.ht_len();
+    for (size_type i = other.nextFull(0); i < len && !other.empty();
+         i = other.nextFull(i + 1)) {
+      size_t hash = std::is_empty<HashFn>::value ? other.hashAt(i)
+                                                 : hash_fn_(other.keyAt(i));
+      if (unique) {
+        if (!appendUnique(other.slots_.moved(i), hash)) break;
       } else {
-        // Before rehashing see if maybe the entry is already in the hashtable.
-        Iterator itr = lookup(key);
-        if (itr != end()) {
-          return std::make_pair(itr, false);
-        }
-        // Need to rehash.
-        FlatSmallHashtable<Entry, Key, HashFn, KeyFn, KeyCmpFn> newt(
-            size() + 1, hash_fn_, key_fn_, key_cmp_fn_);
-        // Check if we didn't exceed the maximum hashtable size.
-        assert(newt.capacity() >= size() + 1);
-        for (auto& e : *this) {
-          newt.insert(std::move(e));
-        }
-        if (newt.capacity() == capacity()) {
-          // In this case, prefer to reuse the old storage, and release the new
-          // storage, because doing otherwise thrashes the heap. (Experimentally
-          // observed on ESP32).
-          used_ = newt.used_;
-          erased_ = 0;
-          memcpy(states_, newt.states_,
-                 kRadkePrimes[capacity_idx_] * sizeof(State));
-          for (size_t i = 0; i < kRadkePrimes[capacity_idx_]; ++i) {
-            buffer_[i] = std::move(newt.buffer_[i]);
-          }
-        } else {
-          *this = std::move(newt);
+        auto result =
+            tryEmplaceWithHash(other.keyAt(i), hash, other.slots_.moved(i));
+        if (!result.second) {
+          // Either the key is already present, or this table is full.
+          if (result.first == end()) break;
+          continue;
         }
       }
-      pos = fastmod(hash, capacity_idx_);
+      other.eraseAt(i);
+    }
+    if (other.empty()) other.clear();
+  }
+
+  /// @brief Same as `merge(FlatSmallHashtable&)`.
+  void merge(FlatSmallHashtable&& other) { merge(other); }
+
+ protected:
+  Iterator lookup(const Key& key) {
+    return Iterator(this, findPos(key, hash_fn_(key)));
+  }
+
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  Iterator lookup(const K& key) {
+    return Iterator(this, findPos(key, hash_fn_(key)));
+  }
+
+  template <typename K>
+  Iterator lookupWithHash(const K& key, size_t hash) {
+    return Iterator(this, findPosWithHash(key, hash));
+  }
+
+  template <typename K>
+  void lookupBatch(const K* keys, size_t count, Iterator* results) {
+    probeBatch(keys, count, [&](size_t i, size_type pos) {
+      results[i] = Iterator(this, pos);
+    });
+  }
+
+  // Probes for `key`. If it is absent, constructs a new entry in place from
+  // `args`, only after a free slot has been found (growing the table if
+  // needed). Nothing is constructed when the key is already present.
+  template <typename K, typename... Args>
+  std::pair<Iterator, bool> tryEmplace(const K& key, Args&&... args) {
+    return tryEmplaceWithHash(key, hash_fn_(key), std::forward<Args>(args)...);
+  }
+
+  // As above, with the hash of `key` precomputed.
+  template <typename K, typename... Args>
+  std::pair<Iterator, bool> tryEmplaceWithHash(const K& key, size_t hash,
+                                               Args&&... args) {
+    std::pair<size_type, bool> slot = insertPos(key, hash);
+    if (slot.second || slot.first == ht_len()) {
+      // Already present, or no room in a table that can't grow.
+      return std::make_pair(Iterator(this, slot.first), false);
     }
-    // Fast path for not found.
-    if (states_[pos] == EMPTY) {
-      states_[pos] = (hash & 0x7F) | 0x80;
-      buffer_[pos] = std::move(val);
+    constructEntry(slot.first, std::forward<Args>(args)...);
+    if (states_[slot.first] == DELETED) {
+      --erased_;
+    } else {
       ++used_;
-      return std::make_pair(Iterator(this, pos), true);
     }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
+    setFull(slot.first, hash);
+    return std::make_pair(Iterator(this, slot.first), true);
+  }
+
+ private:
+  // Tags the private constructor that takes a capacity index directly.
+  struct CapacityIdx {
+    int value;
+  };
+
+  FlatSmallHashtable(CapacityIdx capacity_idx, uint16_t max_load,
+                     HashFn hash_fn, KeyFn key_fn, KeyCmpFn key_cmp_fn,
+                     const Allocator& alloc)
+      : hash_fn_(hash_fn),
+        key_fn_(key_fn),
+        key_cmp_fn_(key_cmp_fn),
+        alloc_(alloc),
+        capacity_idx_(capacity_idx.value),
+        used_(0),
+        erased_(0),
+        resize_threshold_(
+            resizeThreshold<SizePolicy>(capacity_idx_, max_load)),
+        max_load_(max_load),
+        slots_(allocateSlots(capacity_idx_)),
+        states_(allocateStates(capacity_idx_)) {
+    if (capacity_idx_ > 0) std::fill(&states_[0], &states_[ht_len()], EMPTY);
+  }
+
+  using Group = typename SizePolicy::group_type;
+  static constexpr int kGroupPadding = Group::kWidth - 1;
+
+  static constexpr bool kStoreHash = SizePolicy::kStoreHash;
+
+  using State = int8_t;
+  static constexpr State EMPTY = 0;
+  static constexpr State DELETED = 1;
+  // Fills the control bytes past the last slot. Never matches as empty or
+  // full, so probing in groups skips over it.
+  static constexpr State PADDING = 2;
+  // Full items are marked with a bit pattern of the form 0x80 + the 7-bit tag
+  // of the hash.
+
+  using ProbeSeq = typename SizePolicy::template probe_seq<Group::kWidth>;
+
+  // Returns the control byte of a full slot holding an entry with this hash.
+  static State fullState(size_t hash) {
+    return SizePolicy::hashTag(hash) | 0x80;
+  }
+
+  // Returns whether the slot at `pos` holds the entry with the given key.
+  template <typename K>
+  bool isMatch(size_type pos, const K& key, size_t hash) const {
+    return states_[pos] == fullState(hash) && keyMatches(pos, key, hash);
+  }
+
+  // Returns whether the full slot at `pos`, whose tag matches the hash, holds
+  // the entry with the given key. With stored hashes, compares the full hash
+  // first.
+  template <typename K>
+  bool keyMatches(size_type pos, const K& key, size_t hash) const {
+    bool match = (!kStoreHash || storedHashes()[pos] == (uint32_t)hash) &&
+                 key_cmp_fn_(keyAt(pos), key);
+#ifdef ROO_COLLECTIONS_HASHTABLE_STATS
+    ++tag_matches_;
+    if (!match) ++tag_false_positives_;
+#endif
+    return match;
+  }
+
+  // Marks the slot at `pos` as holding an entry with the given hash.
+  void setFull(size_type pos, size_t hash) {
+    states_[pos] = fullState(hash);
+    if (kStoreHash) storedHashes()[pos] = (uint32_t)hash;
+  }
+
+  // Returns the hash of the entry in the full slot at `pos`.
+  size_t hashAt(size_type pos) const {
+    return kStoreHash ? storedHashes()[pos] : hash_fn_(keyAt(pos));
+  }
+
+  // Returns the key of the entry in the full slot at `pos`.
+  decltype(auto) keyAt(size_type pos) const {
+    return slots_.key(pos, key_fn_);
+  }
+
+  // Scans the control bytes for full slots a whole group at a time, using
+  // the widest group of the target regardless of the one the policy probes
+  // with: full slots are exactly the bytes with the high bit set.
+  using ScanGroup = ControlGroup;
+
+  // Returns the first full slot at or after `pos`, or ht_len() if there is
+  // none.
+  size_type nextFull(size_type pos) const {
+    const size_type len = ht_len();
+    for (; len - pos >= ScanGroup::kWidth; pos += ScanGroup::kWidth) {
+      typename ScanGroup::Mask full = ScanGroup(&states_[pos]).matchFull();
+      if (full) return pos + full.lowest();
+    }
+    for (; pos < len; ++pos) {
+      if (states_[pos] < 0) break;
+    }
+    return pos;
+  }
+
+  // Calls `visit(pos)` for every full slot, in order. Reads the bounds once,
+  // and stops after the last entry. `visit` must not change the control
+  // bytes.
+  template <typename Visitor>
+  void forEachFullSlot(Visitor&& visit) const {
+    const size_type len = ht_len();
+    size_type remaining = size();
+    size_type pos = 0;
+    for (; remaining > 0 && len - pos >= ScanGroup::kWidth;
+         pos += ScanGroup::kWidth) {
+      for (typename ScanGroup::Mask full = ScanGroup(&states_[pos]).matchFull();
+           full; full.clearLowest()) {
+        visit((size_type)(pos + full.lowest()));
+        --remaining;
+      }
+    }
+    for (; remaining > 0; ++pos) {
+      if (states_[pos] >= 0) continue;
+      visit(pos);
+      --remaining;
+    }
+  }
+
+  // Returns the stored hashes, which follow the control bytes in the same
+  // allocation. Only valid with kStoreHash.
+  uint32_t* storedHashes() const {
+    return reinterpret_cast<uint32_t*>(states_ + hashesOffset(ht_len()));
+  }
+
+  // Offset of the stored hashes from the start of the control bytes.
+  static size_t hashesOffset(size_type len) {
+    return storedHashesOffset<SizePolicy>(len);
+  }
+
+  // As findPos(), for a caller-supplied hash. Checks that it is consistent
+  // with the hash function.
+  template <typename K>
+  size_type findPosWithHash(const K& key, size_t hash) const {
+    assert(hash == hash_fn_(key));
+    return findPos(key, hash);
+  }
+
+  // Returns the slot holding the entry with the given key, or ht_len() if
+  // there is no such entry.
+  //
+  // At each step of the probe sequence, all the slots of the group starting
+  // at that position are checked for a tag match. The first group containing
+  // an empty slot ends the search, since insertion would have used that slot.
+  // With the single-slot group, this is the classic slot-at-a-time probing.
+  template <typename K>
+  size_type findPos(const K& key, size_t hash) const {
+    const State tag = fullState(hash);
+    ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len());
     while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) {
-        // We can insert here.
-        states_[p] = (hash & 0x7F) | 0x80;
-        buffer_[p] = std::move(val);
-        ++used_;
-        return std::make_pair(Iterator(this, p), true);
+      Group group(&states_[seq.pos()]);
+      for (typename Group::Mask match = group.match(tag); match;
+           match.clearLowest()) {
+        size_type p = seq.pos() + match.lowest();
+        if (keyMatches(p, key, hash)) return p;
+      }
+      if (group.matchEmpty()) return ht_len();
+      seq.next();
+    }
+  }
+
+  // Returns the number of groups that findPos() inspects to find the entry in
+  // the full slot at `pos`.
+  size_t hitProbeLength(size_type pos) const {
+    ProbeSeq seq(SizePolicy::homeSlot(hashAt(pos), capacity_idx_), ht_len());
+    size_t length = 1;
+    while (pos < seq.pos() || pos >= seq.pos() + Group::kWidth) {
+      seq.next();
+      ++length;
+    }
+    return length;
+  }
+
+  // Returns the number of groups that findPos() inspects for an absent key
+  // whose home slot is `home`.
+  size_t missProbeLength(size_type home) const {
+    ProbeSeq seq(home, ht_len());
+    size_t length = 1;
+    while (!Group(&states_[seq.pos()]).matchEmpty()) {
+      seq.next();
+      ++length;
+    }
+    return length;
+  }
+
+  // Number of keys hashed and prefetched ahead of probing in find_batch().
+  // Enough to cover the memory latency, but not so many that the prefetched
+  // lines get evicted before use.
+  static constexpr size_t kBatchSize = 16;
+
+  // Calls visit(i, findPos(keys[i])) for each key, processing the keys in
+  // batches, in three passes: (1) hash all keys of the batch and prefetch
+  // their home control bytes; (2) match the tags in the home groups, and
+  // prefetch the entry of the first match, if any; (3) resolve the probes.
+  // Entries are only prefetched on a tag match, since for misses they would
+  // just waste memory bandwidth.
+  template <typename K, typename Visitor>
+  void probeBatch(const K* keys, size_t count, Visitor visit) const {
+    size_t hashes[kBatchSize];
+    size_type homes[kBatchSize];
+    for (size_t base = 0; base < count; base += kBatchSize) {
+      size_t n = count - base;
+      if (n > kBatchSize) n = kBatchSize;
+      for (size_t i = 0; i < n; ++i) {
+        hashes[i] = hash_fn_(keys[base + i]);
+        homes[i] = SizePolicy::homeSlot(hashes[i], capacity_idx_);
+        prefetch(&states_[homes[i]]);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        typename Group::Mask match =
+            Group(&states_[homes[i]]).match(fullState(hashes[i]));
+        if (match) prefetch(slots_.keyAddress(homes[i] + match.lowest()));
       }
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        return std::make_pair(Iterator(this, p), false);
+      for (size_t i = 0; i < n; ++i) {
+        visit(base + i, findPos(keys[base + i], hashes[i]));
       }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
     }
   }
 
- protected:
-  Iterator lookup(const Key& key) {
-    size_t hash = hash_fn_(key);
-    const uint16_t pos = fastmod(hash, capacity_idx_);
-    if (states_[pos] == EMPTY) return end();
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      return Iterator(this, pos);
-    }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
+  // Probes for the given key. Returns {slot, true} if the key is present, or
+  // {free slot where the key should go, false} otherwise. The free slot is the
+  // first empty or deleted one in the probe order, so that findPos() reaches
+  // it, and tombstones get reused. Only if the key would take up an empty
+  // slot past the resize threshold, room is made first (see makeRoom()). A
+  // table that is full, and can't grow (see cannotGrow()), returns
+  // {ht_len(), false} instead.
+  template <typename K>
+  std::pair<size_type, bool> insertPos(const K& key, size_t hash) {
+    size_type pos = SizePolicy::homeSlot(hash, capacity_idx_);
+    // Fast path.
+    if (isMatch(pos, key, hash)) return std::make_pair(pos, true);
+    const State tag = fullState(hash);
+    const size_type none = ht_len();
+    size_type free = none;
+    ProbeSeq seq(pos, ht_len());
     while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) return end();
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        return Iterator(this, p);
+      Group group(&states_[seq.pos()]);
+      for (typename Group::Mask match = group.match(tag); match;
+           match.clearLowest()) {
+        size_type p = seq.pos() + match.lowest();
+        if (keyMatches(p, key, hash)) return std::make_pair(p, true);
+      }
+      if (free == none) {
+        typename Group::Mask candidates = group.matchEmptyOrDeleted();
+        if (candidates) free = seq.pos() + candidates.lowest();
       }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
+      if (group.matchEmpty()) break;
+      seq.next();
     }
+    if (states_[free] == EMPTY && used_ >= resize_threshold_) {
+      if (cannotGrow()) return std::make_pair(none, false);
+      makeRoom();
+      free = findFreePos(hash);
+    }
+    return std::make_pair(free, false);
   }
 
-  template <typename K, typename = has_is_transparent_t<HashFn, K>,
-            typename = has_is_transparent_t<KeyCmpFn, K>>
-  Iterator lookup(const K& key) {
-    size_t hash = hash_fn_(key);
-    const uint16_t pos = fastmod(hash, capacity_idx_);
-    if (states_[pos] == EMPTY) return end();
-    if (states_[pos] < 0 && (states_[pos] & 0x7F) == (hash & 0x7F) &&
-        key_cmp_fn_(key_fn_(buffer_[pos]), key)) {
-      return Iterator(this, pos);
-    }
-    const uint16_t cap = ht_len();
-    uint32_t p = pos;
-    p += (cap - 2);
-    int32_t j = 2 - cap;
+  // Returns the first empty or deleted slot in the probe sequence of `hash`.
+  size_type findFreePos(size_t hash) const {
+    ProbeSeq seq(SizePolicy::homeSlot(hash, capacity_idx_), ht_len());
     while (true) {
-      if (p >= cap) p -= cap;
-      if (states_[p] == EMPTY) return end();
-      if (states_[p] < 0 && (states_[p] & 0x7F) == (hash & 0x7F) &&
-          key_cmp_fn_(key_fn_(buffer_[p]), key)) {
-        return Iterator(this, p);
+      typename Group::Mask candidates =
+          Group(&states_[seq.pos()]).matchEmptyOrDeleted();
+      if (candidates) return seq.pos() + candidates.lowest();
+      seq.next();
+    }
+  }
+
+  // Returns whether makeRoom() could neither purge tombstones, nor grow the
+  // table: there are no tombstones, and the capacity is fixed, or already
+  // the largest the policy supports.
+  bool cannotGrow() const {
+    return erased_ == 0 && (SizePolicy::kFixedCapacity ||
+                            capacity_idx_ == SizePolicy::kMaxCapacityIdx);
+  }
+
+  // Called when the table has run out of empty slots below the resize
+  // threshold. If at least ~1/4 of the threshold would be free without the
+  // tombstones, purges them in place; otherwise grows the table. Either way,
+  // the next call is at least that many inserts away, so churn costs O(1)
+  // amortized and never rebuilds the table every few operations. A table
+  // that has become far too large for its contents is shrunk instead.
+  void makeRoom() {
+    if (empty() && erased_ > 0) {
+      // Clearing is faster than rehashing.
+      clear();
+      return;
+    }
+    if (SizePolicy::kFixedCapacity) {
+      dropTombstones();
+      return;
+    }
+    int capacity_idx = initialCapacityIdx<SizePolicy>(size() + 1, max_load_);
+    if (capacity_idx + 1 < capacity_idx_) {
+      rehash(CapacityIdx{capacity_idx + 1});
+    } else if (erased_ > 0 && ((uint64_t)size() * 32 <=
+                                   (uint64_t)resize_threshold_ * 25 ||
+                               capacity_idx_ == SizePolicy::kMaxCapacityIdx)) {
+      dropTombstones();
+    } else {
+      // Or, exceeded maximum hashtable size.
+      assert(capacity_idx_ < SizePolicy::kMaxCapacityIdx);
+      rehash(CapacityIdx{std::max(capacity_idx, capacity_idx_ + 1)});
+    }
+  }
+
+  // Rebuilds the table at the given capacity index, unless it is already
+  // there, and has no tombstones. With a FixedCapacity policy, only purges
+  // the tombstones in place.
+  void rebuild(int capacity_idx) {
+    if (SizePolicy::kFixedCapacity) {
+      if (erased_ > 0) dropTombstones();
+      return;
+    }
+    if (capacity_idx == capacity_idx_ && erased_ == 0) return;
+    // Or, exceeded maximum hashtable size.
+    assert(capacity_idx <= SizePolicy::kMaxCapacityIdx);
+    rehash(CapacityIdx{capacity_idx});
+  }
+
+  // Rebuilds the table, dropping tombstones, at the given capacity index.
+  void rehash(CapacityIdx capacity_idx) {
+    FlatSmallHashtable newt(capacity_idx, max_load_, hash_fn_, key_fn_,
+                            key_cmp_fn_, alloc_);
+    forEachFullSlot([&](size_type pos) {
+      newt.insertUnique(slots_.moved(pos), hashAt(pos));
+    });
+    *this = std::move(newt);
+  }
+
+  // Moves `entry`, whose key must not be present, to the first free slot on
+  // the probe sequence of `hash`, without comparing any keys. Does not check
+  // the resize threshold; the caller must make sure there is room.
+  template <typename E>
+  void insertUnique(E&& entry, size_t hash) {
+    size_type pos = findFreePos(hash);
+    constructEntry(pos, std::forward<E>(entry));
+    if (states_[pos] == DELETED) {
+      --erased_;
+    } else {
+      ++used_;
+    }
+    setFull(pos, hash);
+  }
+
+  // As insertUnique(), but makes room first if the table has reached its
+  // resize threshold. Returns false, inserting nothing, if the table is full
+  // and can't grow.
+  template <typename E>
+  bool appendUnique(E&& entry, size_t hash) {
+    if (used_ >= resize_threshold_) {
+      if (cannotGrow()) return false;
+      makeRoom();
+    }
+    insertUnique(std::forward<E>(entry), hash);
+    return true;
+  }
+
+  template <typename InputIt>
+  void reserveForRange(InputIt first, InputIt last, std::input_iterator_tag) {}
+
+  template <typename ForwardIt>
+  void reserveForRange(ForwardIt first, ForwardIt last,
+                       std::forward_iterator_tag) {
+    uint64_t n = (uint64_t)size() + std::distance(first, last);
+    reserve((size_type)std::min<uint64_t>(n, SizePolicy::kMaxResizeThreshold));
+  }
+
+  // Turns all tombstones back into empty slots, rehashing the entries in
+  // place, without allocating. All full slots are first marked DELETED, which
+  // here means 'not yet placed', and tombstones become EMPTY. Then, each
+  // unplaced entry goes to the first empty or unplaced slot on its probe
+  // sequence, swapping places with the unplaced entry found there, if any.
+  // Every step places one entry for good, and entries only ever land where
+  // all the preceding probe groups are full, so lookups find them.
+  void dropTombstones() {
+    const size_type len = ht_len();
+    for (size_type i = 0; i < len; ++i) {
+      states_[i] = (states_[i] < 0) ? DELETED : EMPTY;
+    }
+    for (size_type i = 0; i < len; ++i) {
+      while (states_[i] == DELETED) {
+        size_t hash = hashAt(i);
+        size_type target = findFreePos(hash);
+        if (target != i) {
+          if (states_[target] == EMPTY) {
+            constructEntry(target, slots_.moved(i));
+            destroyEntry(i);
+            states_[i] = EMPTY;
+          } else {
+            Entry tmp(slots_.moved(target));
+            destroyEntry(target);
+            constructEntry(target, slots_.moved(i));
+            destroyEntry(i);
+            constructEntry(i, std::move(tmp));
+            if (kStoreHash) storedHashes()[i] = storedHashes()[target];
+          }
+        }
+        setFull(target, hash);
       }
-      j += 2;
-      assert(j < cap);
-      p += (j >= 0 ? j : -j);
     }
+    used_ -= erased_;
+    erased_ = 0;
+  }
+
+  // Destroys the entry at `pos` and releases its slot.
+  void eraseAt(size_type pos) {
+    destroyEntry(pos);
+    if (used_ == 1 && erased_ == 0) {
+      // Fast path (fast-clear). It is safe to do because there was no
+      // rehashing. (It only works when used_ == 1, because otherwise the
+      // other items might have been rehashed away from this bucket).
+      states_[pos] = EMPTY;
+      --used_;
+    } else {
+      states_[pos] = DELETED;
+      ++erased_;
+    }
+  }
+
+  using AllocTraits = std::allocator_traits<Allocator>;
+
+  // The control bytes are allocated in 32-bit words, which keeps the stored
+  // hashes aligned even with allocators that only align to the requested
+  // type, such as bump-pointer arenas.
+  using WordAllocator =
+      typename AllocTraits::template rebind_alloc<uint32_t>;
+  using WordAllocTraits = std::allocator_traits<WordAllocator>;
+
+  // Takes the allocator of another table, if the propagation trait is set.
+  // Allocators that never propagate may not be assignable at all.
+  void assignAllocator(const Allocator& other, std::true_type) {
+    alloc_ = other;
+  }
+  void assignAllocator(const Allocator&, std::false_type) {}
+
+  template <typename... Args>
+  void constructEntry(size_type pos, Args&&... args) {
+    slots_.construct(alloc_, pos, std::forward<Args>(args)...);
+  }
+
+  void destroyEntry(size_type pos) { slots_.destroy(alloc_, pos); }
+
+  // Slot storage is raw: entries are constructed in place on insert and
+  // destroyed on erase, so empty slots never hold a live Entry.
+  Slots allocateSlots(int capacity_idx) {
+    Slots slots;
+    if (capacity_idx > 0) {
+      slots.allocate(alloc_, SizePolicy::htLen(capacity_idx));
+    }
+    return slots;
+  }
+
+  // Allocates the control bytes for the given capacity (see controlWords()).
+  // The slots themselves are left uninitialized. The empty table shares a
+  // static, all-empty array.
+  State* allocateStates(int capacity_idx) {
+    if (capacity_idx == 0) return emptyStates();
+    size_t len = SizePolicy::htLen(capacity_idx);
+    WordAllocator words(alloc_);
+    State* states = reinterpret_cast<State*>(
+        WordAllocTraits::allocate(words, controlWords<SizePolicy>(capacity_idx)));
+    std::fill(states + len, states + len + kGroupPadding, PADDING);
+    return states;
+  }
+
+  // Control bytes of the empty table (with capacity index 0). Never written
+  // to, since the empty table grows before its first insert.
+  static State* emptyStates() {
+    static State states[Group::kWidth] = {};
+    return states;
+  }
+
+  // Destroys all live entries, leaving the states untouched. Stops as soon as
+  // size() entries have been visited.
+  void destroyEntries() {
+    if (std::is_trivially_destructible<Entry>::value) return;
+    forEachFullSlot([&](size_type pos) { destroyEntry(pos); });
+  }
+
+  // Destroys all live entries and releases both arrays. Leaves the object in
+  // an inconsistent state; the caller must reinitialize it.
+  void releaseStorage() {
+    destroyEntries();
+    if (capacity_idx_ > 0) {
+      WordAllocator words(alloc_);
+      WordAllocTraits::deallocate(words, reinterpret_cast<uint32_t*>(states_),
+                                  controlWords<SizePolicy>(capacity_idx_));
+      slots_.deallocate(alloc_, ht_len());
+    }
+  }
+
+  // Copies states and live entries from `other`, which must have the same
+  // capacity, moving the entries if kMove is set. Buffers must already be
+  // allocated.
+  template <bool kMove>
+  void transferEntriesFrom(const FlatSmallHashtable& other) {
+    if (capacity_idx_ == 0) return;
+    size_type len = ht_len();
+    std::copy(&other.states_[0], &other.states_[len], &states_[0]);
+    other.forEachFullSlot([&](size_type pos) {
+      constructEntry(pos, sourceEntry(other.slots_, pos,
+                                      std::integral_constant<bool, kMove>()));
+      if (kStoreHash) storedHashes()[pos] = other.storedHashes()[pos];
+    });
+  }
+
+  // Returns the entry at `pos` of `slots`, to move from, or to copy from.
+  static decltype(auto) sourceEntry(const Slots& slots, size_type pos,
+                                    std::true_type) {
+    return slots.moved(pos);
+  }
+
+  static const_reference sourceEntry(const Slots& slots, size_type pos,
+                                     std::false_type) {
+    return slots.at(pos);
   }
 
- private:
   void resetToEmptySentinel() {
     capacity_idx_ = 0;
     used_ = 0;
     erased_ = 0;
     resize_threshold_ = 0;
-    buffer_ = nullptr;
-    dummy_empty_state_ = EMPTY;
-    states_ = &dummy_empty_state_;
+    slots_ = Slots();
+    states_ = emptyStates();
   }
 
-  using State = int8_t;
-  static constexpr State EMPTY = 0;
-  static constexpr State DELETED = 1;
-  // Full items are marked with a bit pattern of the form 0x80 + (hash & 0x7F).
-
   friend class ConstIterator;
   friend class Iterator;
 
+  // Migrates entries between two tables slot by slot.
+  template <typename, typename, typename, typename, typename, typename>
+  friend class IncrementalFlatHashMap;
+
+  friend struct internal::SnapshotAccess;
+
   HashFn hash_fn_;
   KeyFn key_fn_;
   KeyCmpFn key_cmp_fn_;
+  // Stateless allocators fit in the padding before capacity_idx_, along with
+  // the (usually empty) function objects.
+  Allocator alloc_;
   int capacity_idx_;
-  uint16_t used_;
-  uint16_t erased_;
-  uint16_t resize_threshold_;
-  Entry* buffer_;
+  size_type used_;
+  size_type erased_;
+  size_type resize_threshold_;
+  // Maximum load factor, in units of 2^-16. Fits in the padding after the
+  // 16-bit counters of SmallSizePolicy.
+  uint16_t max_load_;
+  Slots slots_;
   State* states_;
-  State dummy_empty_state_;
+
+#ifdef ROO_COLLECTIONS_HASHTABLE_STATS
+  mutable uint64_t tag_matches_ = 0;
+  mutable uint64_t tag_false_positives_ = 0;
+#endif
 };
 
 }  // namespace roo_collections
@@ -0,0 +1,311 @@
+#pragma once
+
+/// @file
+/// @brief Immutable flat hash maps and sets, built at compile time.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "roo_backport/string_view.h"
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/hash.h"
+#include "roo_collections/small_string.h"
+
+namespace roo_collections {
+
+/// @brief Transparent hash that can be evaluated at compile time, over
+/// integers, enums, and all supported string types.
+///
+/// Integers and enums hash to their own value (the identity), which the
+/// Radke prime modulo spreads well, and strings hash as with
+/// `Murmur3StringHash`.
+struct FrozenHashFn {
+  // Required to denote a transparent hash.
+  using is_transparent = void;
+
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value ||
+                                        std::is_enum<T>::value,
+                                    int>::type = 0>
+  constexpr size_t operator()(T val) const {
+    return (size_t)val;
+  }
+
+  constexpr size_t operator()(::roo::string_view val) const {
+    return hashBytes(val.data(), val.size());
+  }
+
+  constexpr size_t operator()(const char* val) const {
+    size_t len = 0;
+    while (val[len] != 0) ++len;
+    return hashBytes(val, len);
+  }
+
+  size_t operator()(const std::string& val) const {
+    return Murmur3StringHash()(::roo::string_view(val));
+  }
+
+  template <size_t N>
+  size_t operator()(const SmallString<N>& val) const {
+    return Murmur3StringHash()(val);
+  }
+
+#ifdef ARDUINO
+  size_t operator()(const ::String& val) const {
+    return Murmur3StringHash()(::roo::string_view(val.c_str(), val.length()));
+  }
+#endif
+
+ private:
+  // Uses the word-at-a-time murmur3_32 at run time, where the compiler tells
+  // the two apart.
+  static constexpr uint32_t hashBytes(const char* data, size_t len) {
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+    if (!__builtin_is_constant_evaluated()) {
+      return murmur3_32(data, len, 0x92F4E42BUL);
+    }
+#endif
+#endif
+    return murmur3_32_constexpr(data, len, 0x92F4E42BUL);
+  }
+};
+
+// Not constexpr, so that a duplicate key fails constant evaluation.
+inline void duplicateKeyInFrozenTable() {
+  assert(false && "Duplicate key in a frozen table");
+}
+
+/// @brief Immutable hash table of `N` entries, built by a constexpr
+/// constructor.
+///
+/// Uses the layout and the probing of `FlatSmallHashtable`: a slot array whose
+/// length is the Radke prime that holds `N` entries below the maximum fill
+/// ratio, with a control byte per slot carrying a 7-bit hash tag. Each slot
+/// refers to an entry by index; the entries themselves are kept in the order
+/// given, which is also the iteration order.
+///
+/// Declared `constexpr` (or `static constexpr`), the whole table is computed
+/// by the compiler and placed in read-only memory (flash, on
+/// microcontrollers), so that it costs nothing at startup. Use
+/// `FrozenFlatHashMap` and `FrozenFlatHashSet` rather than this class.
+///
+/// The hash and the key comparison must be usable in constant expressions for
+/// the stored keys; see `FrozenHashFn`. Keys must be unique.
+///
+/// @tparam Entry Stored entry type.
+/// @tparam Key Key type extracted from entries.
+/// @tparam N Number of entries.
+/// @tparam HashFn Hash function type.
+/// @tparam KeyFn Functor extracting a key from an entry.
+/// @tparam KeyCmpFn Key equality predicate type.
+template <typename Entry, typename Key, size_t N, typename HashFn = FrozenHashFn,
+          typename KeyFn = DefaultKeyFn<Entry>,
+          typename KeyCmpFn = TransparentEq>
+class FrozenFlatHashtable {
+  static_assert(N > 0, "A frozen table must have at least one entry");
+  static_assert(N <= SmallSizePolicy::kMaxResizeThreshold,
+                "Too many entries for a frozen table");
+
+ public:
+  using size_type = SmallSizePolicy::index_type;
+  using key_type = Key;
+  using value_type = Entry;
+  using hasher = HashFn;
+  using key_equal = KeyCmpFn;
+  using iterator = const Entry*;
+  using const_iterator = const Entry*;
+
+  /// @brief Builds the table from an array of entries.
+  constexpr FrozenFlatHashtable(const Entry (&entries)[N],
+                                HashFn hash_fn = HashFn(),
+                                KeyFn key_fn = KeyFn(),
+                                KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : FrozenFlatHashtable(entries, std::make_index_sequence<N>(), hash_fn,
+                            key_fn, key_cmp_fn) {}
+
+  /// @brief Returns the number of entries.
+  constexpr size_type size() const { return N; }
+
+  /// @brief Returns whether the table is empty; never, as N > 0.
+  constexpr bool empty() const { return false; }
+
+  /// @brief Returns the slot array length.
+  constexpr size_type ht_len() const { return kHtLen; }
+
+  constexpr const_iterator begin() const { return entries_; }
+  constexpr const_iterator end() const { return entries_ + N; }
+
+  /// @brief Returns an iterator to the entry with `key`, or `end()`.
+  constexpr const_iterator find(const Key& key) const { return lookup(key); }
+
+  /// @brief Heterogeneous key overload of `find`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  constexpr const_iterator find(const K& key) const {
+    return lookup(key);
+  }
+
+  /// @brief Returns whether `key` is present.
+  constexpr bool contains(const Key& key) const { return lookup(key) != end(); }
+
+  /// @brief Heterogeneous key overload of `contains`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  constexpr bool contains(const K& key) const {
+    return lookup(key) != end();
+  }
+
+ private:
+  static constexpr int kCapacityIdx =
+      initialCapacityIdx<SmallSizePolicy>((size_type)N);
+  static constexpr size_type kHtLen = SmallSizePolicy::htLen(kCapacityIdx);
+
+  using ProbeSeq = QuadraticProbeSeq<size_type>;
+
+  template <size_t... I>
+  constexpr FrozenFlatHashtable(const Entry (&entries)[N],
+                                std::index_sequence<I...>, HashFn hash_fn,
+                                KeyFn key_fn, KeyCmpFn key_cmp_fn)
+      : hash_fn_(hash_fn),
+        key_fn_(key_fn),
+        key_cmp_fn_(key_cmp_fn),
+        entries_{entries[I]...},
+        tags_{},
+        slots_{} {
+    for (size_type i = 0; i < N; ++i) {
+      const Key& key = key_fn_(entries_[i]);
+      uint32_t hash = (uint32_t)hash_fn_(key);
+      uint8_t tag = tagOf(hash);
+      ProbeSeq seq(SmallSizePolicy::homeSlot(hash, kCapacityIdx), kHtLen);
+      while (tags_[seq.pos()] != 0) {
+        if (tags_[seq.pos()] == tag &&
+            key_cmp_fn_(key_fn_(entries_[slots_[seq.pos()]]), key)) {
+          duplicateKeyInFrozenTable();
+        }
+        seq.next();
+      }
+      tags_[seq.pos()] = tag;
+      slots_[seq.pos()] = i;
+    }
+  }
+
+  // Control byte of a slot holding an entry with this hash. Empty slots
+  // are 0.
+  static constexpr uint8_t tagOf(uint32_t hash) {
+    return (uint8_t)((hash & 0x7F) | 0x80);
+  }
+
+  template <typename K>
+  constexpr const Entry* lookup(const K& key) const {
+    uint32_t hash = (uint32_t)hash_fn_(key);
+    uint8_t tag = tagOf(hash);
+    ProbeSeq seq(SmallSizePolicy::homeSlot(hash, kCapacityIdx), kHtLen);
+    while (true) {
+      uint8_t t = tags_[seq.pos()];
+      if (t == tag) {
+        const Entry& entry = entries_[slots_[seq.pos()]];
+        if (key_cmp_fn_(key_fn_(entry), key)) return &entry;
+      } else if (t == 0) {
+        return end();
+      }
+      seq.next();
+    }
+  }
+
+  HashFn hash_fn_;
+  KeyFn key_fn_;
+  KeyCmpFn key_cmp_fn_;
+  Entry entries_[N];
+  uint8_t tags_[kHtLen];
+  size_type slots_[kHtLen];
+};
+
+/// @brief Immutable hash map of `N` key-value pairs, built at compile time.
+///
+/// Example:
+///
+/// @code
+/// static constexpr auto kTopics =
+///     makeFrozenFlatHashMap<roo::string_view, int>({
+///         {"sensors/temperature", 1},
+///         {"sensors/humidity", 2},
+///     });
+/// int id = kTopics.at(topic);  // topic: std::string, const char*, ...
+/// @endcode
+///
+/// See `FrozenFlatHashtable`.
+template <typename Key, typename Value, size_t N,
+          typename HashFn = FrozenHashFn, typename KeyCmpFn = TransparentEq>
+class FrozenFlatHashMap
+    : public FrozenFlatHashtable<std::pair<Key, Value>, Key, N, HashFn,
+                                 MapKeyFn<Key, Value>, KeyCmpFn> {
+ public:
+  using Base = FrozenFlatHashtable<std::pair<Key, Value>, Key, N, HashFn,
+                                   MapKeyFn<Key, Value>, KeyCmpFn>;
+  using mapped_type = Value;
+  using value_type = typename Base::value_type;
+
+  /// @brief Builds the map from an array of key-value pairs.
+  constexpr FrozenFlatHashMap(const value_type (&entries)[N],
+                              HashFn hash_fn = HashFn(),
+                              KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : Base(entries, hash_fn, MapKeyFn<Key, Value>(), key_cmp_fn) {}
+
+  /// @brief Returns the value for `key`.
+  ///
+  /// Asserts in debug builds if `key` is not present.
+  constexpr const Value& at(const Key& key) const {
+    auto it = this->find(key);
+    assert(it != this->end());
+    return it->second;
+  }
+
+  /// @brief Heterogeneous key overload of `at`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  constexpr const Value& at(const K& key) const {
+    auto it = this->find(key);
+    assert(it != this->end());
+    return it->second;
+  }
+
+  /// @brief Same as `at`.
+  constexpr const Value& operator[](const Key& key) const { return at(key); }
+
+  /// @brief Heterogeneous key overload of `operator[]`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  constexpr const Value& operator[](const K& key) const {
+    return at(key);
+  }
+};
+
+/// @brief Immutable hash set of `N` keys, built at compile time. See
+/// `FrozenFlatHashtable`.
+template <typename Key, size_t N, typename HashFn = FrozenHashFn,
+          typename KeyCmpFn = TransparentEq>
+using FrozenFlatHashSet =
+    FrozenFlatHashtable<Key, Key, N, HashFn, DefaultKeyFn<Key>, KeyCmpFn>;
+
+/// @brief Builds a `FrozenFlatHashMap`, deducing the number of entries.
+template <typename Key, typename Value, size_t N>
+constexpr FrozenFlatHashMap<Key, Value, N> makeFrozenFlatHashMap(
+    const std::pair<Key, Value> (&entries)[N]) {
+  return FrozenFlatHashMap<Key, Value, N>(entries);
+}
+
+/// @brief Builds a `FrozenFlatHashSet`, deducing the number of keys.
+template <typename Key, size_t N>
+constexpr FrozenFlatHashSet<Key, N> makeFrozenFlatHashSet(
+    const Key (&keys)[N]) {
+  return FrozenFlatHashSet<Key, N>(keys);
+}
+
+}  // namespace roo_collections
@@ -1,39 +1,183 @@
 #include "roo_collections/hash.h"
 
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 namespace roo_collections {
 
-static inline uint32_t murmur_32_scramble(uint32_t k) {
+namespace {
+
+// Little-endian unaligned loads. They compile to single instructions on
+// targets that allow unaligned access, and to byte loads elsewhere.
+
+inline uint32_t load32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+inline uint64_t load64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+inline uint32_t murmur_32_scramble(uint32_t k) {
   k *= 0xcc9e2d51;
   k = (k << 15) | (k >> 17);
   k *= 0x1b873593;
   return k;
 }
 
+// Multiplies a by b into 128 bits, and stores the low half in a and the high
+// half in b.
+inline void mum(uint64_t* a, uint64_t* b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = *a;
+  r *= *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  *a = lo;
+  *b = hi;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+  mum(&a, &b);
+  return a ^ b;
+}
+
+// Reads 1 to 3 bytes, touching the first, the middle, and the last one.
+inline uint64_t load3(const unsigned char* p, size_t k) {
+  return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+constexpr uint64_t kWySecret[4] = {0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+                                   0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL};
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+
+// CRC-32C of each 4-bit value. Small enough for microcontrollers, at the cost
+// of two table lookups per byte.
+constexpr uint32_t kCrc32cNibbleTable[16] = {
+    0x00000000, 0x105EC76F, 0x20BD8EDE, 0x30E349B1, 0x417B1DBC, 0x5125DAD3,
+    0x61C69362, 0x7198540D, 0x82F63B78, 0x92A8FC17, 0xA24BB5A6, 0xB21572C9,
+    0xC38D26C4, 0xD3D3E1AB, 0xE330A81A, 0xF36E6F75};
+
+inline uint32_t crc32cByte(uint32_t crc, unsigned char b) {
+  crc ^= b;
+  crc = (crc >> 4) ^ kCrc32cNibbleTable[crc & 15];
+  return (crc >> 4) ^ kCrc32cNibbleTable[crc & 15];
+}
+
+#endif
+
+}  // namespace
+
 uint32_t murmur3_32(const void* key, size_t len, uint32_t seed) {
   const unsigned char* buf = (const unsigned char*)key;
   uint32_t h = seed;
-  uint32_t k;
   for (size_t i = len >> 2; i; i--) {
-    k = ((uint32_t)buf[0]) | ((uint32_t)buf[1] << 8) |
-        ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    h ^= murmur_32_scramble(load32(buf));
     buf += 4;
-    h ^= murmur_32_scramble(k);
     h = (h << 13) | (h >> 19);
     h = h * 5 + 0xe6546b64;
   }
-  k = 0;
-  for (size_t i = len & 3; i; i--) {
-    k <<= 8;
-    k |= buf[i - 1];
+  uint32_t k = 0;
+  switch (len & 3) {
+    case 3:
+      k ^= (uint32_t)buf[2] << 16;
+      // fall through
+    case 2:
+      k ^= (uint32_t)buf[1] << 8;
+      // fall through
+    case 1:
+      k ^= buf[0];
   }
   h ^= murmur_32_scramble(k);
   h ^= len;
-  h ^= h >> 16;
-  h *= 0x85ebca6b;
-  h ^= h >> 13;
-  h *= 0xc2b2ae35;
-  h ^= h >> 16;
-  return h;
+  return fmix32(h);
+}
+
+uint64_t wyhash64(const void* key, size_t len, uint64_t seed) {
+  const unsigned char* p = (const unsigned char*)key;
+  seed ^= mix(seed ^ kWySecret[0], kWySecret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = ((uint64_t)load32(p) << 32) | load32(p + ((len >> 3) << 2));
+      b = ((uint64_t)load32(p + len - 4) << 32) |
+          load32(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = load3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = mix(load64(p) ^ kWySecret[1], load64(p + 8) ^ seed);
+        see1 = mix(load64(p + 16) ^ kWySecret[2], load64(p + 24) ^ see1);
+        see2 = mix(load64(p + 32) ^ kWySecret[3], load64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = mix(load64(p) ^ kWySecret[1], load64(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = load64(p + i - 16);
+    b = load64(p + i - 8);
+  }
+  a ^= kWySecret[1];
+  b ^= seed;
+  mum(&a, &b);
+  return mix(a ^ kWySecret[0] ^ len, b ^ kWySecret[1]);
+}
+
+uint32_t crc32c(const void* key, size_t len, uint32_t crc) {
+  const unsigned char* p = (const unsigned char*)key;
+  crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+  uint64_t c = crc;
+  for (; len >= 8; len -= 8, p += 8) c = _mm_crc32_u64(c, load64(p));
+  crc = (uint32_t)c;
+#endif
+#if defined(__SSE4_2__)
+  for (; len >= 4; len -= 4, p += 4) crc = _mm_crc32_u32(crc, load32(p));
+  for (; len > 0; --len, ++p) crc = _mm_crc32_u8(crc, *p);
+#elif defined(__ARM_FEATURE_CRC32)
+  for (; len >= 8; len -= 8, p += 8) crc = __crc32cd(crc, load64(p));
+  for (; len > 0; --len, ++p) crc = __crc32cb(crc, *p);
+#else
+  for (; len > 0; --len, ++p) crc = crc32cByte(crc, *p);
+#endif
+  return ~crc;
 }
 
-}  // namespace roo_collections
\ No newline at end of file
+}  // namespace roo_collections
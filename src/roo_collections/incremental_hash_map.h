@@ -0,0 +1,551 @@
+#pragma once
+
+/// @file
+/// @brief Flat hash map that spreads each resize over later operations.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+#include "roo_collections/flat_small_hash_map.h"
+
+namespace roo_collections {
+
+/// @brief Flat hash map with a bounded cost of every insert and erase.
+///
+/// A `FlatSmallHashMap` rehashes all of its entries within the single insert
+/// that reaches the resize threshold, which shows up as a latency spike in
+/// large maps. Instead, this map allocates the new table and keeps the old one
+/// alongside, and each subsequent insert and erase migrates a few slots of the
+/// old table to the new one. While the migration is in progress, lookups probe
+/// both tables.
+///
+/// The number of slots migrated per operation is fixed when the migration
+/// starts, so that it completes before the new table fills up; it is at least
+/// 8, and grows when the new table has little headroom.
+///
+/// This lowers the worst-case latency of an insert, but not the typical one:
+/// every insert and erase during a migration does extra work, so the p99 and
+/// p99.9 latencies are higher than those of `FlatSmallHashMap` (about twice as
+/// high in `benchmarks/latency_benchmark.cpp`). The slowest single operation
+/// is the insert that starts a resize: it allocates the new table and clears
+/// its control bytes, which takes time proportional to the new capacity, i.e.
+/// still milliseconds with 1M entries. Once the table has reached the
+/// largest capacity of the `SizePolicy`, deleted slots are purged in place,
+/// within a single insert, as in `FlatSmallHashMap`.
+///
+/// Lookups do not migrate, so that they stay const. Iteration visits the
+/// entries remaining in the old table first. As with `FlatSmallHashMap`,
+/// inserts and erases invalidate iterators.
+///
+/// @tparam Key Key type.
+/// @tparam Value Mapped value type.
+/// @tparam HashFn Hash function type.
+/// @tparam KeyCmpFn Key equality predicate type.
+/// @tparam SizePolicy Width of indices and probing; see `SmallSizePolicy`,
+/// `LargeSizePolicy`, and `GroupProbing`.
+/// @tparam Allocator Allocator of `std::pair<Key, Value>` entries, shared by
+/// both tables.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
+class IncrementalFlatHashMap {
+ public:
+  /// @brief Type of each of the two underlying tables.
+  using Map =
+      FlatSmallHashMap<Key, Value, HashFn, KeyCmpFn, SizePolicy, Allocator>;
+
+  using size_type = typename Map::size_type;
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = typename Map::value_type;
+  using hasher = HashFn;
+  using key_equal = KeyCmpFn;
+  using allocator_type = Allocator;
+
+  /// @brief Constant forward iterator.
+  class ConstIterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = const typename Map::value_type;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    ConstIterator() : map_(nullptr), in_old_(false) {}
+
+    reference operator*() const { return *it_; }
+    pointer operator->() const { return &*it_; }
+
+    ConstIterator& operator++() {
+      ++it_;
+      skipToCurrent();
+      return *this;
+    }
+
+    ConstIterator operator++(int n) {
+      ConstIterator itr = *this;
+      operator++();
+      return itr;
+    }
+
+    bool operator==(const ConstIterator& other) const {
+      return in_old_ == other.in_old_ && it_ == other.it_;
+    }
+
+    bool operator!=(const ConstIterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class IncrementalFlatHashMap;
+
+    ConstIterator(const IncrementalFlatHashMap* map, bool in_old,
+                  typename Map::ConstIterator it)
+        : map_(map), in_old_(in_old), it_(it) {
+      skipToCurrent();
+    }
+
+    // Moves on from the end of the old table to the start of the current one.
+    void skipToCurrent() {
+      if (in_old_ && it_ == map_->old_.end()) {
+        in_old_ = false;
+        it_ = map_->current_.begin();
+      }
+    }
+
+    const IncrementalFlatHashMap* map_;
+    bool in_old_;
+    typename Map::ConstIterator it_;
+  };
+
+  /// @brief Mutable forward iterator.
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename Map::value_type;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    Iterator() : map_(nullptr), in_old_(false) {}
+
+    reference operator*() { return *it_; }
+    pointer operator->() { return &*it_; }
+
+    operator ConstIterator() const { return ConstIterator(map_, in_old_, it_); }
+
+    Iterator& operator++() {
+      ++it_;
+      skipToCurrent();
+      return *this;
+    }
+
+    Iterator operator++(int n) {
+      Iterator itr = *this;
+      operator++();
+      return itr;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return in_old_ == other.in_old_ && it_ == other.it_;
+    }
+
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class IncrementalFlatHashMap;
+
+    Iterator(IncrementalFlatHashMap* map, bool in_old,
+             typename Map::Iterator it)
+        : map_(map), in_old_(in_old), it_(it) {
+      skipToCurrent();
+    }
+
+    void skipToCurrent() {
+      if (in_old_ && it_ == map_->old_.end()) {
+        in_old_ = false;
+        it_ = map_->current_.begin();
+      }
+    }
+
+    IncrementalFlatHashMap* map_;
+    bool in_old_;
+    typename Map::Iterator it_;
+  };
+
+  using iterator = Iterator;
+  using const_iterator = ConstIterator;
+
+  /// @brief Creates an empty map.
+  IncrementalFlatHashMap(HashFn hash_fn = HashFn(),
+                         KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                         const Allocator& alloc = Allocator())
+      : current_(hash_fn, key_cmp_fn, alloc),
+        old_(0, hash_fn, key_cmp_fn, alloc),
+        cursor_(0),
+        step_(0) {}
+
+  /// @brief Creates an empty map that uses the given allocator.
+  explicit IncrementalFlatHashMap(const Allocator& alloc)
+      : IncrementalFlatHashMap(HashFn(), KeyCmpFn(), alloc) {}
+
+  /// @brief Creates a map with capacity for approximately `size_hint`
+  /// elements without resizing.
+  IncrementalFlatHashMap(size_type size_hint, HashFn hash_fn = HashFn(),
+                         KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                         const Allocator& alloc = Allocator())
+      : current_(size_hint, hash_fn, key_cmp_fn, alloc),
+        old_(0, hash_fn, key_cmp_fn, alloc),
+        cursor_(0),
+        step_(0) {}
+
+  /// @brief Builds a map from an initializer list.
+  IncrementalFlatHashMap(std::initializer_list<value_type> init,
+                         HashFn hash_fn = HashFn(),
+                         KeyCmpFn key_cmp_fn = KeyCmpFn(),
+                         const Allocator& alloc = Allocator())
+      : current_(init, hash_fn, key_cmp_fn, alloc),
+        old_(0, hash_fn, key_cmp_fn, alloc),
+        cursor_(0),
+        step_(0) {}
+
+  /// @brief Returns a copy of the allocator.
+  allocator_type get_allocator() const { return current_.get_allocator(); }
+
+  /// @brief Returns the number of stored elements.
+  size_type size() const { return current_.size() + old_.size(); }
+
+  /// @brief Returns whether the map is empty.
+  bool empty() const { return size() == 0; }
+
+  /// @brief Returns the number of elements that the current table can hold
+  /// before the next resize starts.
+  size_type capacity() const { return current_.capacity(); }
+
+  /// @brief Returns whether a resize is in progress, i.e. whether some
+  /// entries still remain in the old table.
+  bool resizing() const { return !old_.empty(); }
+
+  ConstIterator begin() const {
+    return ConstIterator(this, true, old_.begin());
+  }
+
+  Iterator begin() { return Iterator(this, true, old_.begin()); }
+
+  ConstIterator end() const {
+    return ConstIterator(this, false, current_.end());
+  }
+
+  Iterator end() { return Iterator(this, false, current_.end()); }
+
+  /// @brief Finds `key` and returns a const iterator to the entry, or
+  /// `end()`.
+  ConstIterator find(const Key& key) const { return findImpl(key); }
+
+  /// @brief Heterogeneous lookup overload of `find`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  ConstIterator find(const K& key) const {
+    return findImpl(key);
+  }
+
+  /// @brief Finds `key` and returns an iterator to the entry, or `end()`.
+  Iterator find(const Key& key) { return findImpl(key); }
+
+  /// @brief Heterogeneous lookup overload of `find`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  Iterator find(const K& key) {
+    return findImpl(key);
+  }
+
+  /// @brief Returns whether `key` exists in the map.
+  bool contains(const Key& key) const {
+    return current_.contains(key) || old_.contains(key);
+  }
+
+  /// @brief Heterogeneous key overload of `contains`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  bool contains(const K& key) const {
+    return current_.contains(key) || old_.contains(key);
+  }
+
+  /// @brief Returns a const reference to the mapped value for `key`.
+  ///
+  /// Asserts in debug builds if `key` is not present.
+  const Value& at(const Key& key) const {
+    auto it = find(key);
+    assert(it != end());
+    return (*it).second;
+  }
+
+  /// @brief Heterogeneous overload of const `at`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  const Value& at(const K& key) const {
+    auto it = find(key);
+    assert(it != end());
+    return (*it).second;
+  }
+
+  /// @brief Returns a mutable reference to the mapped value for `key`.
+  ///
+  /// Asserts in debug builds if `key` is not present.
+  Value& at(const Key& key) {
+    auto it = find(key);
+    assert(it != end());
+    return (*it).second;
+  }
+
+  /// @brief Heterogeneous overload of mutable `at`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  Value& at(const K& key) {
+    auto it = find(key);
+    assert(it != end());
+    return (*it).second;
+  }
+
+  /// @brief Returns a mutable reference to the value for `key`.
+  ///
+  /// Inserts a default-constructed value when `key` is not present. Must not
+  /// be used to insert into a map that is full at the largest capacity of its
+  /// `SizePolicy`, where `try_emplace()` would return `{end(), false}`.
+  Value& operator[](const Key& key) {
+    auto result = try_emplace(key);
+    assert(result.first != end());
+    return (*result.first).second;
+  }
+
+  /// @brief Heterogeneous overload of `operator[]`.
+  ///
+  /// Has the same precondition as the non-template overload.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  Value& operator[](const K& key) {
+    auto result = try_emplace(key);
+    assert(result.first != end());
+    return (*result.first).second;
+  }
+
+  /// @brief Inserts a copy of `val` if its key is not present.
+  /// @return Pair of iterator and insertion flag.
+  std::pair<Iterator, bool> insert(const value_type& val) {
+    return try_emplace(val.first, val.second);
+  }
+
+  /// @brief Moves `val` into the map if its key is not present.
+  /// @return Pair of iterator and insertion flag.
+  std::pair<Iterator, bool> insert(value_type&& val) {
+    return try_emplace(std::move(val.first), std::move(val.second));
+  }
+
+  /// @brief Inserts a value constructed from `args` if `key` is not present.
+  /// @return Pair of iterator and insertion flag.
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    Iterator existing = prepareInsert(key);
+    if (existing != end()) return std::make_pair(existing, false);
+    auto result = current_.try_emplace(key, std::forward<Args>(args)...);
+    return std::make_pair(Iterator(this, false, result.first), result.second);
+  }
+
+  /// @brief Move-key overload of `try_emplace`.
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    Iterator existing = prepareInsert(key);
+    if (existing != end()) return std::make_pair(existing, false);
+    auto result =
+        current_.try_emplace(std::move(key), std::forward<Args>(args)...);
+    return std::make_pair(Iterator(this, false, result.first), result.second);
+  }
+
+  /// @brief Heterogeneous overload of `try_emplace`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>, typename... Args>
+  std::pair<Iterator, bool> try_emplace(const K& key, Args&&... args) {
+    Iterator existing = prepareInsert(key);
+    if (existing != end()) return std::make_pair(existing, false);
+    auto result = current_.try_emplace(key, std::forward<Args>(args)...);
+    return std::make_pair(Iterator(this, false, result.first), result.second);
+  }
+
+  /// @brief Inserts `obj` under `key`, or assigns it to the existing value.
+  /// @return Pair of iterator and insertion flag.
+  template <typename M>
+  std::pair<Iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second && result.first != end()) {
+      (*result.first).second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  /// @brief Heterogeneous overload of `insert_or_assign`.
+  template <typename K, typename M,
+            typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  std::pair<Iterator, bool> insert_or_assign(const K& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second && result.first != end()) {
+      (*result.first).second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  /// @brief Removes an entry by key.
+  /// @return `true` if an entry was removed.
+  bool erase(const Key& key) {
+    migrate();
+    return current_.erase(key) || old_.erase(key);
+  }
+
+  /// @brief Heterogeneous key overload of `erase`.
+  template <typename K, typename = has_is_transparent_t<HashFn, K>,
+            typename = has_is_transparent_t<KeyCmpFn, K>>
+  bool erase(const K& key) {
+    migrate();
+    return current_.erase(key) || old_.erase(key);
+  }
+
+  /// @brief Removes the entry at `itr` and returns iterator to the next entry.
+  ///
+  /// Does not migrate, so that the returned iterator stays valid.
+  Iterator erase(const ConstIterator& itr) {
+    if (itr == end()) return end();
+    if (itr.in_old_) return Iterator(this, true, old_.erase(itr.it_));
+    return Iterator(this, false, current_.erase(itr.it_));
+  }
+
+  /// @brief Removes all entries, and releases the old table if a resize is in
+  /// progress.
+  void clear() {
+    current_.clear();
+    releaseOld();
+  }
+
+  /// @brief Equality comparison by key/value content.
+  bool operator==(const IncrementalFlatHashMap& other) const {
+    if (other.size() != size()) return false;
+    for (const auto& e : *this) {
+      auto itr = other.find(e.first);
+      if (itr == other.end()) return false;
+      if (*itr != e) return false;
+    }
+    return true;
+  }
+
+  bool operator!=(const IncrementalFlatHashMap& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  // Never migrate fewer slots than this per operation, so that lookups don't
+  // have to probe two tables for longer than necessary.
+  static constexpr size_type kMinMigrationStep = 8;
+
+  template <typename K>
+  ConstIterator findImpl(const K& key) const {
+    auto it = current_.find(key);
+    if (it == current_.end() && resizing()) {
+      auto old_it = old_.find(key);
+      if (old_it != old_.end()) return ConstIterator(this, true, old_it);
+    }
+    return ConstIterator(this, false, it);
+  }
+
+  template <typename K>
+  Iterator findImpl(const K& key) {
+    auto it = current_.find(key);
+    if (it == current_.end() && resizing()) {
+      auto old_it = old_.find(key);
+      if (old_it != old_.end()) return Iterator(this, true, old_it);
+    }
+    return Iterator(this, false, it);
+  }
+
+  // Does the migration work due for an insert, and starts a new resize if the
+  // key would have to go to an empty slot of a table past its resize
+  // threshold. A table at the largest capacity of the size policy can't
+  // grow, so it is left to the insert to purge its tombstones in place, or,
+  // if it has none, to fail. Returns the iterator to the entry if the key is
+  // in the old table, or end() otherwise.
+  template <typename K>
+  Iterator prepareInsert(const K& key) {
+    migrate();
+    if (resizing()) {
+      auto it = old_.find(key);
+      if (it != old_.end()) return Iterator(this, true, it);
+    } else if (current_.used_ >= current_.resize_threshold_ &&
+               current_.capacity_idx_ < SizePolicy::kMaxCapacityIdx &&
+               !current_.contains(key)) {
+      startResize();
+    }
+    return end();
+  }
+
+  // Moves the current table aside and replaces it with an empty one, sized
+  // for at least twice the entries, or a quarter of the old threshold,
+  // whichever is more. The latter bounds the number of slots to scan per
+  // insert when the old table is mostly tombstones.
+  void startResize() {
+    size_type size = current_.size();
+    uint64_t hint = std::max<uint64_t>(2 * (uint64_t)size,
+                                       current_.capacity() / 4);
+    hint = std::min<uint64_t>(hint, SizePolicy::kMaxResizeThreshold);
+    old_ = std::move(current_);
+    current_ = Map((size_type)hint, old_.hash_fn_, old_.key_cmp_fn_,
+                   old_.alloc_);
+    // Below the largest capacity, the threshold is less than the largest
+    // one, so the new table always has some headroom.
+    assert(current_.capacity() > size);
+    // Each insert uses up at most one slot of headroom in the new table, and
+    // the migration needs to scan all slots of the old table before it runs
+    // out.
+    size_type headroom = current_.capacity() - size;
+    step_ = std::max<size_type>(kMinMigrationStep,
+                                old_.ht_len() / headroom + 1);
+    cursor_ = 0;
+  }
+
+  // Migrates the entries from the next step_ slots of the old table, and
+  // releases the old table once it is exhausted.
+  void migrate() {
+    if (!resizing()) return;
+    size_type stop =
+        std::min<uint64_t>((uint64_t)cursor_ + step_, old_.ht_len());
+    for (; cursor_ < stop; ++cursor_) {
+      if (old_.states_[cursor_] >= 0) continue;
+      current_.insertUnique(old_.slots_.moved(cursor_), old_.hashAt(cursor_));
+      old_.eraseAt(cursor_);
+    }
+    if (cursor_ == old_.ht_len() || old_.empty()) releaseOld();
+  }
+
+  void releaseOld() {
+    old_ = Map(0, old_.hash_fn_, old_.key_cmp_fn_, old_.alloc_);
+  }
+
+  // Receives new entries, and the entries migrated from old_.
+  Map current_;
+
+  // The table being migrated from, or an empty table with no storage if there
+  // is no resize in progress.
+  Map old_;
+
+  // Next slot of old_ to migrate.
+  size_type cursor_;
+
+  // Number of slots of old_ to migrate per operation.
+  size_type step_;
+};
+
+}  // namespace roo_collections
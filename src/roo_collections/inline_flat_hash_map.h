@@ -0,0 +1,379 @@
+#pragma once
+
+/// @file
+/// @brief Fixed-capacity flat hash maps and sets, stored inside the object.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/flat_small_hash_set.h"
+
+namespace roo_collections {
+
+/// @brief What an inline container does when it runs out of inline storage.
+enum class InlineOverflow {
+  /// @brief Never allocates. Inserting a new key into a full container fails,
+  /// returning `{end(), false}`.
+  kFail,
+
+  /// @brief Grows onto the heap, like `FlatSmallHashMap`, and moves back into
+  /// the inline storage when it shrinks enough (e.g. on `compact()`).
+  kSpillToHeap,
+};
+
+namespace internal {
+
+// Storage for an array of kLen objects of type T, handed out to at most one
+// allocation at a time.
+template <typename T, size_t kLen>
+class InlineBlock {
+ public:
+  InlineBlock() : busy_(false) {}
+
+  InlineBlock(const InlineBlock&) = delete;
+  InlineBlock& operator=(const InlineBlock&) = delete;
+
+  // Returns the block for n objects of type U, if it is free and they fit,
+  // or nullptr.
+  template <typename U>
+  U* tryAllocate(size_t n) {
+    if (busy_ || n * sizeof(U) > sizeof(bytes_) || alignof(U) > alignof(T)) {
+      return nullptr;
+    }
+    busy_ = true;
+    return reinterpret_cast<U*>(bytes_);
+  }
+
+  // Releases the block if p points to it. Returns whether it did.
+  bool tryDeallocate(const void* p) {
+    if (p != bytes_) return false;
+    busy_ = false;
+    return true;
+  }
+
+ private:
+  alignas(T) unsigned char bytes_[kLen * sizeof(T)];
+  bool busy_;
+};
+
+// Stands in for the second slot array of layouts that have only one.
+template <size_t kLen>
+class InlineBlock<void, kLen> {
+ public:
+  template <typename U>
+  U* tryAllocate(size_t /*n*/) {
+    return nullptr;
+  }
+
+  bool tryDeallocate(const void* /*p*/) { return false; }
+};
+
+// Storage for the slot arrays and the control bytes of one table, sized for
+// the given capacity index: one block per array of the slot layout of the
+// size policy (one for the entries, or, with SplitKeyValue, one for the keys
+// and one for the values), and one for the control bytes. Allocations that
+// don't fit are refused.
+template <typename Entry, typename SizePolicy, int kCapacityIdx>
+class InlineArena {
+ public:
+  InlineArena() = default;
+
+  InlineArena(const InlineArena&) = delete;
+  InlineArena& operator=(const InlineArena&) = delete;
+
+  // Returns one of the free blocks that fits n objects of type T, or nullptr.
+  // The table allocates its slot arrays, in order, before its control bytes,
+  // so they land in the matching blocks.
+  template <typename T>
+  T* tryAllocate(size_t n) {
+    T* p = first_.template tryAllocate<T>(n);
+    if (p == nullptr) p = second_.template tryAllocate<T>(n);
+    if (p == nullptr) p = control_.template tryAllocate<T>(n);
+    return p;
+  }
+
+  // Releases the block at p. Returns false if p does not point to this arena.
+  bool tryDeallocate(const void* p) {
+    return first_.tryDeallocate(p) || second_.tryDeallocate(p) ||
+           control_.tryDeallocate(p);
+  }
+
+ private:
+  // Only the array types matter here, not the allocator.
+  using Slots =
+      typename SizePolicy::template slots<Entry, std::allocator<Entry>>;
+
+  static constexpr size_t kLen = SizePolicy::htLen(kCapacityIdx);
+
+  InlineBlock<typename Slots::first_array_type, kLen> first_;
+  InlineBlock<typename Slots::second_array_type, kLen> second_;
+  InlineBlock<uint32_t, controlWords<SizePolicy>(kCapacityIdx)> control_;
+};
+
+// Allocator that takes its memory from an InlineArena, falling back to the
+// heap if kSpill is set. Copies refer to the same arena, and compare equal
+// only if they do; it never propagates to another container.
+template <typename T, typename Arena, bool kSpill>
+class InlineArenaAllocator {
+ public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = InlineArenaAllocator<U, Arena, kSpill>;
+  };
+
+  explicit InlineArenaAllocator(Arena* arena) : arena_(arena) {}
+
+  template <typename U>
+  InlineArenaAllocator(const InlineArenaAllocator<U, Arena, kSpill>& other)
+      : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    T* p = arena_->template tryAllocate<T>(n);
+    if (p != nullptr) return p;
+    // A table with InlineOverflow::kFail never outgrows its arena.
+    assert(kSpill);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (!arena_->tryDeallocate(p)) std::allocator<T>().deallocate(p, n);
+  }
+
+  Arena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const InlineArenaAllocator<U, Arena, kSpill>& other) const {
+    return arena_ == other.arena();
+  }
+
+  template <typename U>
+  bool operator!=(const InlineArenaAllocator<U, Arena, kSpill>& other) const {
+    return arena_ != other.arena();
+  }
+
+ private:
+  Arena* arena_;
+};
+
+// Selects the table parameters of an inline container holding at least N
+// entries.
+template <typename Entry, typename SizePolicy, size_t N,
+          InlineOverflow kOverflow>
+struct InlineTableTraits {
+  static_assert(N > 0, "Inline capacity must be positive");
+  static_assert(N <= SizePolicy::kMaxResizeThreshold,
+                "Inline capacity exceeds the size policy");
+
+  static constexpr int kCapacityIdx = initialCapacityIdx<SizePolicy>(N);
+
+  using Policy =
+      typename std::conditional<kOverflow == InlineOverflow::kFail,
+                                FixedCapacity<SizePolicy>, SizePolicy>::type;
+
+  using Arena = InlineArena<Entry, Policy, kCapacityIdx>;
+
+  using Allocator = InlineArenaAllocator<Entry, Arena,
+                                         kOverflow != InlineOverflow::kFail>;
+};
+
+// Holds the arena in a base class, so that it gets constructed before the
+// table that allocates from it.
+template <typename Arena>
+struct InlineArenaHolder {
+  Arena inline_arena_;
+};
+
+}  // namespace internal
+
+/// @brief Flat hash map with inline storage for at least `N` elements.
+///
+/// Has the interface and the probing of `FlatSmallHashMap`, but keeps its slot
+/// array and control bytes inside the object, sized at compile time to the
+/// smallest Radke prime that holds `N` elements below the maximum fill ratio.
+/// It can thus live on the stack or in static storage, with no allocator
+/// traffic. `capacity()` may exceed `N`, up to the rounded-up size.
+///
+/// With `InlineOverflow::kFail` (the default), the map never allocates. It
+/// purges tombstones in place as needed, and inserting a new key into a full
+/// map fails: `insert()`, `emplace()`, and `try_emplace()` return
+/// `{end(), false}`, and `operator[]` must not be used on a full map.
+///
+/// With `InlineOverflow::kSpillToHeap`, the map grows onto the heap once it
+/// exceeds the inline capacity, and returns to the inline storage when it
+/// shrinks back.
+///
+/// Copies and moves transfer the elements one by one, as each map owns its
+/// storage. Moving leaves the source empty.
+///
+/// @tparam Key Key type.
+/// @tparam Value Mapped value type.
+/// @tparam N Minimum number of elements held inline.
+/// @tparam kOverflow What to do when the inline storage runs out.
+/// @tparam HashFn Hash function type.
+/// @tparam KeyCmpFn Key equality predicate type.
+/// @tparam SizePolicy Width of indices and probing; see `SmallSizePolicy`,
+/// `LargeSizePolicy`, `GroupProbing`, `StoredHash`, and `SplitKeyValue`.
+template <typename Key, typename Value, size_t N,
+          InlineOverflow kOverflow = InlineOverflow::kFail,
+          typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy>
+class InlineFlatHashMap
+    : private internal::InlineArenaHolder<typename internal::InlineTableTraits<
+          std::pair<Key, Value>, SizePolicy, N, kOverflow>::Arena>,
+      public FlatSmallHashMap<
+          Key, Value, HashFn, KeyCmpFn,
+          typename internal::InlineTableTraits<std::pair<Key, Value>,
+                                               SizePolicy, N,
+                                               kOverflow>::Policy,
+          typename internal::InlineTableTraits<std::pair<Key, Value>,
+                                               SizePolicy, N,
+                                               kOverflow>::Allocator> {
+  using Traits = internal::InlineTableTraits<std::pair<Key, Value>,
+                                             SizePolicy, N, kOverflow>;
+  using Holder = internal::InlineArenaHolder<typename Traits::Arena>;
+
+ public:
+  using Base = FlatSmallHashMap<Key, Value, HashFn, KeyCmpFn,
+                                typename Traits::Policy,
+                                typename Traits::Allocator>;
+
+  using size_type = typename Base::size_type;
+  using value_type = typename Base::value_type;
+
+  /// @brief Creates an empty map.
+  InlineFlatHashMap(HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : Base(N, hash_fn, key_cmp_fn, inlineAllocator()) {}
+
+  /// @brief Builds a map from an iterator range. With `InlineOverflow::kFail`,
+  /// the elements that do not fit are dropped.
+  template <typename InputIt>
+  InlineFlatHashMap(InputIt first, InputIt last, HashFn hash_fn = HashFn(),
+                    KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : InlineFlatHashMap(hash_fn, key_cmp_fn) {
+    for (auto it = first; it != last; ++it) this->insert(*it);
+  }
+
+  /// @brief Builds a map from an initializer list. With
+  /// `InlineOverflow::kFail`, the elements that do not fit are dropped.
+  InlineFlatHashMap(std::initializer_list<value_type> init,
+                    HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : InlineFlatHashMap(init.begin(), init.end(), hash_fn, key_cmp_fn) {}
+
+  /// @brief Copy constructor.
+  InlineFlatHashMap(const InlineFlatHashMap& other)
+      : Base(other, inlineAllocator()) {}
+
+  /// @brief Move constructor.
+  InlineFlatHashMap(InlineFlatHashMap&& other)
+      : Base(std::move(other), inlineAllocator()) {
+    other.clear();
+  }
+
+  InlineFlatHashMap& operator=(const InlineFlatHashMap& other) {
+    Base::operator=(other);
+    return *this;
+  }
+
+  InlineFlatHashMap& operator=(InlineFlatHashMap&& other) {
+    if (this != &other) {
+      Base::operator=(std::move(other));
+      other.clear();
+    }
+    return *this;
+  }
+
+ private:
+  typename Traits::Allocator inlineAllocator() {
+    return typename Traits::Allocator(&this->Holder::inline_arena_);
+  }
+};
+
+/// @brief Flat hash set with inline storage for at least `N` keys.
+///
+/// The set counterpart of `InlineFlatHashMap`; see there for the semantics of
+/// `N` and `kOverflow`.
+template <typename Key, size_t N,
+          InlineOverflow kOverflow = InlineOverflow::kFail,
+          typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy>
+class InlineFlatHashSet
+    : private internal::InlineArenaHolder<typename internal::InlineTableTraits<
+          Key, SizePolicy, N, kOverflow>::Arena>,
+      public FlatSmallHashSet<
+          Key, HashFn, KeyCmpFn,
+          typename internal::InlineTableTraits<Key, SizePolicy, N,
+                                               kOverflow>::Policy,
+          typename internal::InlineTableTraits<Key, SizePolicy, N,
+                                               kOverflow>::Allocator> {
+  using Traits = internal::InlineTableTraits<Key, SizePolicy, N, kOverflow>;
+  using Holder = internal::InlineArenaHolder<typename Traits::Arena>;
+
+ public:
+  using Base = FlatSmallHashSet<Key, HashFn, KeyCmpFn, typename Traits::Policy,
+                                typename Traits::Allocator>;
+
+  using size_type = typename Base::size_type;
+  using value_type = typename Base::value_type;
+
+  /// @brief Creates an empty set.
+  InlineFlatHashSet(HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : Base(N, hash_fn, DefaultKeyFn<Key>(), key_cmp_fn, inlineAllocator()) {}
+
+  /// @brief Builds a set from an iterator range. With `InlineOverflow::kFail`,
+  /// the keys that do not fit are dropped.
+  template <typename InputIt>
+  InlineFlatHashSet(InputIt first, InputIt last, HashFn hash_fn = HashFn(),
+                    KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : InlineFlatHashSet(hash_fn, key_cmp_fn) {
+    for (auto it = first; it != last; ++it) this->insert(*it);
+  }
+
+  /// @brief Builds a set from an initializer list. With
+  /// `InlineOverflow::kFail`, the keys that do not fit are dropped.
+  InlineFlatHashSet(std::initializer_list<value_type> init,
+                    HashFn hash_fn = HashFn(), KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : InlineFlatHashSet(init.begin(), init.end(), hash_fn, key_cmp_fn) {}
+
+  /// @brief Copy constructor.
+  InlineFlatHashSet(const InlineFlatHashSet& other)
+      : Base(other, inlineAllocator()) {}
+
+  /// @brief Move constructor.
+  InlineFlatHashSet(InlineFlatHashSet&& other)
+      : Base(std::move(other), inlineAllocator()) {
+    other.clear();
+  }
+
+  InlineFlatHashSet& operator=(const InlineFlatHashSet& other) {
+    Base::operator=(other);
+    return *this;
+  }
+
+  InlineFlatHashSet& operator=(InlineFlatHashSet&& other) {
+    if (this != &other) {
+      Base::operator=(std::move(other));
+      other.clear();
+    }
+    return *this;
+  }
+
+ private:
+  typename Traits::Allocator inlineAllocator() {
+    return typename Traits::Allocator(&this->Holder::inline_arena_);
+  }
+};
+
+}  // namespace roo_collections
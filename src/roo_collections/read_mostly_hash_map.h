@@ -0,0 +1,243 @@
+#pragma once
+
+/// @file
+/// @brief Thread-safe flat hash map with lock-free readers, for data that is
+/// read far more often than it is written.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "roo_collections/flat_small_hash_map.h"
+
+namespace roo_collections {
+
+namespace internal {
+
+// Returns a small integer that identifies the calling thread, assigned on
+// first use. Spreads the threads over the reader slots.
+inline size_t readerThreadIndex() {
+  static std::atomic<size_t> next(0);
+  // Constant-initialized, so that accessing it needs no guard.
+  static thread_local size_t index = 0;
+  if (index == 0) index = next.fetch_add(1, std::memory_order_relaxed) + 1;
+  return index;
+}
+
+}  // namespace internal
+
+/// @brief Thread-safe map, in which readers never block, and are never
+/// blocked by writers.
+///
+/// Keeps the current contents as an immutable `FlatSmallHashMap`, published
+/// through an atomic pointer. Writers copy it, apply their changes to the
+/// copy, and publish the copy in its place. Changes are therefore batched:
+/// each `update()` call copies the map once, regardless of how many changes it
+/// makes. The old map is destroyed as soon as no reader uses it any more.
+///
+/// Readers announce themselves by incrementing a counter in one of
+/// `kReaderSlots` cache-line-sized slots, picked by thread, so that threads on
+/// different cores don't contend for the same cache line. There are two
+/// counters per slot, for the two phases of a grace period: a writer that has
+/// replaced the map waits for the readers of one phase to drain while new
+/// readers enter the other, and then the other way round. Continuous reading
+/// thus can't starve the writer.
+///
+/// Writes are serialized with a mutex, and cost a copy of the whole map plus
+/// the wait for the readers that started before it was replaced. Best for
+/// configuration and routing tables that are read on every request and change
+/// a few times per minute; for frequently changing data, use a mutex around a
+/// `FlatSmallHashMap` instead.
+///
+/// A reader must not call `update()` (or any other writing method) from
+/// within `read()`; that deadlocks.
+///
+/// @tparam Key Key type.
+/// @tparam Value Mapped value type.
+/// @tparam HashFn Hash function type.
+/// @tparam KeyCmpFn Key equality predicate type.
+/// @tparam SizePolicy Width of indices and probing; see `SmallSizePolicy`,
+/// `LargeSizePolicy`, and `GroupProbing`.
+/// @tparam Allocator Allocator of `std::pair<Key, Value>` entries.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
+class ReadMostlyFlatHashMap {
+ public:
+  /// @brief Type of the published, immutable maps.
+  using Map =
+      FlatSmallHashMap<Key, Value, HashFn, KeyCmpFn, SizePolicy, Allocator>;
+
+  using size_type = typename Map::size_type;
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = typename Map::value_type;
+  using hasher = HashFn;
+  using key_equal = KeyCmpFn;
+
+  /// @brief Number of reader slots. Up to this many threads read without
+  /// sharing cache lines.
+  static constexpr size_t kReaderSlots = 32;
+
+  /// @brief Constructs an empty map.
+  ReadMostlyFlatHashMap() : ReadMostlyFlatHashMap(Map()) {}
+
+  /// @brief Constructs a map with the contents of `map`.
+  explicit ReadMostlyFlatHashMap(Map map)
+      : current_(new Map(std::move(map))), phase_(0) {
+    for (ReaderSlot& slot : slots_) {
+      slot.readers[0].store(0, std::memory_order_relaxed);
+      slot.readers[1].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  ReadMostlyFlatHashMap(const ReadMostlyFlatHashMap&) = delete;
+  ReadMostlyFlatHashMap& operator=(const ReadMostlyFlatHashMap&) = delete;
+
+  /// @brief Destructor. No reader may be active.
+  ~ReadMostlyFlatHashMap() { delete current_.load(std::memory_order_relaxed); }
+
+  /// @brief Calls `fn(map)` with the current contents, and returns its
+  /// result.
+  ///
+  /// The map stays valid and unchanged for the duration of the call, even if
+  /// writers replace it in the meantime. References into it must not be
+  /// retained past the call.
+  template <typename Fn>
+  auto read(Fn&& fn) const -> decltype(fn(std::declval<const Map&>())) {
+    ReadGuard guard(*this);
+    return fn(guard.map());
+  }
+
+  /// @brief Returns whether `key` is present.
+  template <typename K>
+  bool contains(const K& key) const {
+    ReadGuard guard(*this);
+    return guard.map().contains(key);
+  }
+
+  /// @brief If `key` is present, copies its value to `value` and returns
+  /// true. Otherwise, returns false.
+  template <typename K>
+  bool get(const K& key, Value& value) const {
+    ReadGuard guard(*this);
+    auto it = guard.map().find(key);
+    if (it == guard.map().end()) return false;
+    value = it->second;
+    return true;
+  }
+
+  /// @brief Returns the number of entries.
+  size_type size() const {
+    ReadGuard guard(*this);
+    return guard.map().size();
+  }
+
+  /// @brief Returns whether the map is empty.
+  bool empty() const { return size() == 0; }
+
+  /// @brief Calls `fn(map)` on a copy of the current contents, and then
+  /// publishes the copy, replacing the current contents.
+  ///
+  /// Readers see either all of the changes made by `fn`, or none. Returns
+  /// after the previous contents have been destroyed.
+  template <typename Fn>
+  void update(Fn&& fn) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::unique_ptr<Map> next(
+        new Map(*current_.load(std::memory_order_relaxed)));
+    fn(*next);
+    publish(next.release());
+  }
+
+  /// @brief Replaces the contents with `map`, without copying.
+  void reset(Map map) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    publish(new Map(std::move(map)));
+  }
+
+  /// @brief Inserts or assigns a single entry. Prefer `update()` to make
+  /// several changes at once.
+  template <typename K, typename M>
+  void insert_or_assign(K&& key, M&& obj) {
+    update([&](Map& map) {
+      map.insert_or_assign(std::forward<K>(key), std::forward<M>(obj));
+    });
+  }
+
+  /// @brief Erases a single entry. Returns whether it was present. Prefer
+  /// `update()` to make several changes at once.
+  template <typename K>
+  bool erase(const K& key) {
+    bool erased = false;
+    update([&](Map& map) { erased = map.erase(key); });
+    return erased;
+  }
+
+  /// @brief Removes all entries.
+  void clear() { reset(Map()); }
+
+ private:
+  struct alignas(64) ReaderSlot {
+    // Number of readers that entered in each phase, and haven't left yet.
+    std::atomic<uint32_t> readers[2];
+  };
+
+  // Pins the current map for the duration of a read.
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const ReadMostlyFlatHashMap& owner) {
+      ReaderSlot& slot =
+          owner.slots_[internal::readerThreadIndex() % kReaderSlots];
+      counter_ = &slot.readers[owner.phase_.load(std::memory_order_relaxed)];
+      // Sequentially consistent, so that either the writer sees the reader
+      // in its scan, or the reader sees the map that the writer published
+      // before the scan.
+      counter_->fetch_add(1, std::memory_order_seq_cst);
+      map_ = owner.current_.load(std::memory_order_seq_cst);
+    }
+
+    ~ReadGuard() { counter_->fetch_sub(1, std::memory_order_release); }
+
+    const Map& map() const { return *map_; }
+
+   private:
+    std::atomic<uint32_t>* counter_;
+    const Map* map_;
+  };
+
+  // Replaces the current map with `next`, and destroys the previous one
+  // once no reader uses it.
+  void publish(Map* next) {
+    Map* prev = current_.exchange(next, std::memory_order_seq_cst);
+    // A reader may have picked its phase before the previous flip, and
+    // entered it just now; so both phases have to drain.
+    for (int i = 0; i < 2; ++i) {
+      int drained = phase_.load(std::memory_order_relaxed);
+      phase_.store(drained ^ 1, std::memory_order_seq_cst);
+      for (ReaderSlot& slot : slots_) {
+        while (slot.readers[drained].load(std::memory_order_seq_cst) != 0) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    delete prev;
+  }
+
+  std::atomic<Map*> current_;
+  // Phase that new readers enter. Only flipped by writers.
+  std::atomic<int> phase_;
+  mutable ReaderSlot slots_[kReaderSlots];
+  std::mutex write_mutex_;
+};
+
+}  // namespace roo_collections
@@ -0,0 +1,231 @@
+#pragma once
+
+/// @file
+/// @brief Thread-safe flat hash map, split into independently locked shards.
+/// @ingroup roo_collections
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/hash.h"
+
+namespace roo_collections {
+
+/// @brief Thread-safe map for shared state that many threads update
+/// concurrently, such as per-flow counters.
+///
+/// Splits the entries over a power-of-two number of shards, each a
+/// `FlatSmallHashMap` with its own lock, in a cache line of its own. The shard
+/// of a key is picked from the upper bits of its hash, remixed with `fmix32`
+/// so that identity hashes of small integers spread too. Each key is hashed
+/// only once: the same hash then locates it within the shard. Operations on
+/// keys in different shards proceed in parallel; with enough shards, threads
+/// rarely contend, and throughput grows with the number of cores.
+///
+/// Since a shard may rehash as soon as its lock is released, no iterators or
+/// references to entries are handed out. Instead, lookups copy the value
+/// (`get()`) or pass it to a callback under the lock (`find()`), and
+/// `update()` modifies a value in place, atomically. Callbacks must not call
+/// back into the map.
+///
+/// Whole-map operations (`size()`, `clear()`, `for_each()`) lock one shard at
+/// a time, so they don't observe a consistent snapshot of the map when it is
+/// being modified concurrently. For data that is mostly read, see
+/// `ReadMostlyFlatHashMap`.
+///
+/// @tparam Key Key type.
+/// @tparam Value Mapped value type.
+/// @tparam HashFn Hash function type.
+/// @tparam KeyCmpFn Key equality predicate type.
+/// @tparam SizePolicy Width of indices and probing of the shards; see
+/// `SmallSizePolicy`, `LargeSizePolicy`, and `GroupProbing`.
+/// @tparam Mutex Lock of each shard, e.g. a spinlock with the interface of
+/// `std::mutex`.
+template <typename Key, typename Value, typename HashFn = DefaultHashFn<Key>,
+          typename KeyCmpFn = std::equal_to<Key>,
+          typename SizePolicy = SmallSizePolicy, typename Mutex = std::mutex>
+class ShardedFlatHashMap {
+ public:
+  /// @brief Type of each shard.
+  using Map = FlatSmallHashMap<Key, Value, HashFn, KeyCmpFn, SizePolicy>;
+
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = typename Map::value_type;
+  using hasher = HashFn;
+  using key_equal = KeyCmpFn;
+
+  /// @brief Number of shards, unless specified otherwise. Enough for 16
+  /// threads to rarely contend for the same shard.
+  static constexpr size_t kDefaultShardCount = 64;
+
+  /// @brief Creates an empty map with `shard_count` shards, rounded up to a
+  /// power of two.
+  explicit ShardedFlatHashMap(size_t shard_count = kDefaultShardCount,
+                              HashFn hash_fn = HashFn(),
+                              KeyCmpFn key_cmp_fn = KeyCmpFn())
+      : hash_fn_(hash_fn), shard_bits_(0) {
+    assert(shard_count > 0 && shard_count <= (1u << 16));
+    while (((size_t)1 << shard_bits_) < shard_count) ++shard_bits_;
+    shards_.reset(new Shard[(size_t)1 << shard_bits_]);
+    for (size_t i = 0; i < this->shard_count(); ++i) {
+      shards_[i].map = Map(hash_fn, key_cmp_fn);
+    }
+  }
+
+  ShardedFlatHashMap(const ShardedFlatHashMap&) = delete;
+  ShardedFlatHashMap& operator=(const ShardedFlatHashMap&) = delete;
+
+  /// @brief Returns the number of shards.
+  size_t shard_count() const { return (size_t)1 << shard_bits_; }
+
+  /// @brief Returns the number of entries.
+  size_t size() const {
+    size_t result = 0;
+    for (size_t i = 0; i < shard_count(); ++i) {
+      std::lock_guard<Mutex> lock(shards_[i].mutex);
+      result += shards_[i].map.size();
+    }
+    return result;
+  }
+
+  /// @brief Returns whether the map is empty.
+  bool empty() const { return size() == 0; }
+
+  /// @brief Returns whether `key` is present.
+  template <typename K>
+  bool contains(const K& key) const {
+    size_t hash = hash_fn_(key);
+    const Shard& shard = shardFor(hash);
+    std::lock_guard<Mutex> lock(shard.mutex);
+    return shard.map.contains_with_hash(key, hash);
+  }
+
+  /// @brief If `key` is present, copies its value to `value` and returns
+  /// true. Otherwise, returns false.
+  template <typename K>
+  bool get(const K& key, Value& value) const {
+    return find(key, [&](const Value& v) { value = v; });
+  }
+
+  /// @brief If `key` is present, calls `fn(value)` with the shard locked, and
+  /// returns true. Otherwise, returns false.
+  template <typename K, typename Fn>
+  bool find(const K& key, Fn&& fn) const {
+    size_t hash = hash_fn_(key);
+    const Shard& shard = shardFor(hash);
+    std::lock_guard<Mutex> lock(shard.mutex);
+    auto it = shard.map.find_with_hash(key, hash);
+    if (it == shard.map.end()) return false;
+    fn(it->second);
+    return true;
+  }
+
+  /// @brief Inserts a value constructed from `args` under `key`, if `key` is
+  /// not present. Returns whether it was inserted.
+  template <typename K, typename... Args>
+  bool try_emplace(const K& key, Args&&... args) {
+    size_t hash = hash_fn_(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<Mutex> lock(shard.mutex);
+    return shard.map
+        .try_emplace_with_hash(key, hash, std::forward<Args>(args)...)
+        .second;
+  }
+
+  /// @brief Inserts a copy of `entry`, if its key is not present. Returns
+  /// whether it was inserted.
+  bool insert(const value_type& entry) {
+    return try_emplace(entry.first, entry.second);
+  }
+
+  /// @brief Inserts `obj` under `key`, or assigns it to the existing value.
+  /// Returns whether it was inserted.
+  template <typename K, typename M>
+  bool insert_or_assign(const K& key, M&& obj) {
+    size_t hash = hash_fn_(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<Mutex> lock(shard.mutex);
+    auto result =
+        shard.map.try_emplace_with_hash(key, hash, std::forward<M>(obj));
+    if (!result.second && result.first != shard.map.end()) {
+      (*result.first).second = std::forward<M>(obj);
+    }
+    return result.second;
+  }
+
+  /// @brief Calls `fn(value)` on the value of `key`, with the shard locked.
+  /// If `key` is not present, inserts a default-constructed value first.
+  /// Returns false, without calling `fn`, only if `key` is not present and
+  /// its shard is full at the largest capacity of the size policy.
+  ///
+  /// Example: `counters.update(flow, [](int& count) { ++count; });`
+  template <typename K, typename Fn>
+  bool update(const K& key, Fn&& fn) {
+    size_t hash = hash_fn_(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<Mutex> lock(shard.mutex);
+    auto it = shard.map.try_emplace_with_hash(key, hash).first;
+    if (it == shard.map.end()) return false;
+    fn((*it).second);
+    return true;
+  }
+
+  /// @brief Removes the entry with `key`. Returns whether it was present.
+  template <typename K>
+  bool erase(const K& key) {
+    size_t hash = hash_fn_(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<Mutex> lock(shard.mutex);
+    return shard.map.erase_with_hash(key, hash);
+  }
+
+  /// @brief Removes all entries.
+  void clear() {
+    for (size_t i = 0; i < shard_count(); ++i) {
+      std::lock_guard<Mutex> lock(shards_[i].mutex);
+      shards_[i].map.clear();
+    }
+  }
+
+  /// @brief Calls `fn(entry)` for every entry, one shard at a time, with the
+  /// shard locked.
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < shard_count(); ++i) {
+      std::lock_guard<Mutex> lock(shards_[i].mutex);
+      shards_[i].map.for_each(fn);
+    }
+  }
+
+ private:
+  struct alignas(64) Shard {
+    mutable Mutex mutex;
+    Map map;
+  };
+
+  Shard& shardFor(size_t hash) {
+    return shards_[shardIndex(hash)];
+  }
+
+  const Shard& shardFor(size_t hash) const {
+    return shards_[shardIndex(hash)];
+  }
+
+  size_t shardIndex(size_t hash) const {
+    return (size_t)((uint64_t)fmix32((uint32_t)hash) >> (32 - shard_bits_));
+  }
+
+  HashFn hash_fn_;
+  int shard_bits_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace roo_collections
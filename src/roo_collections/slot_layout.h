@@ -0,0 +1,202 @@
+#pragma once
+
+/// @file
+/// @brief Layouts of the entries in the slot arrays of a hashtable.
+/// @ingroup roo_collections
+
+#include <stddef.h>
+
+#include <memory>
+#include <tuple>
+#include <utility>
+
+namespace roo_collections {
+namespace internal {
+
+// A slot layout is a handle to the arrays that hold the entries of a
+// hashtable, one per slot. The arrays are raw storage: the table constructs
+// an entry in a slot on insert, and destroys it on erase, and keeps track of
+// which slots are full. Copying the handle does not copy the arrays, and its
+// const methods hand out mutable entries, as a plain pointer would; the table
+// allocates and releases the arrays explicitly, with its allocator of entries.
+
+// Stores each entry in one piece, in a single array. The default.
+template <typename Entry, typename Allocator>
+class InterleavedSlots {
+ public:
+  using reference = Entry&;
+  using const_reference = const Entry&;
+  using pointer = Entry*;
+  using const_pointer = const Entry*;
+
+  // Element types of the arrays that allocate() requests, in order; void
+  // where there is no such array.
+  using first_array_type = Entry;
+  using second_array_type = void;
+
+  InterleavedSlots() : entries_(nullptr) {}
+
+  void allocate(Allocator& alloc, size_t len) {
+    entries_ = AllocTraits::allocate(alloc, len);
+  }
+
+  void deallocate(Allocator& alloc, size_t len) {
+    AllocTraits::deallocate(alloc, entries_, len);
+    entries_ = nullptr;
+  }
+
+  // Returns the key of the entry at `pos`.
+  template <typename KeyFn>
+  decltype(auto) key(size_t pos, const KeyFn& key_fn) const {
+    return key_fn(entries_[pos]);
+  }
+
+  reference at(size_t pos) const { return entries_[pos]; }
+
+  pointer address(size_t pos) const { return &entries_[pos]; }
+
+  const_pointer constAddress(size_t pos) const { return &entries_[pos]; }
+
+  // Returns the address to prefetch ahead of comparing the key at `pos`.
+  const void* keyAddress(size_t pos) const { return &entries_[pos]; }
+
+  // Returns the entry at `pos` as an rvalue, to move-construct another entry
+  // from.
+  Entry&& moved(size_t pos) const { return std::move(entries_[pos]); }
+
+  template <typename... Args>
+  void construct(Allocator& alloc, size_t pos, Args&&... args) const {
+    AllocTraits::construct(alloc, &entries_[pos], std::forward<Args>(args)...);
+  }
+
+  void destroy(Allocator& alloc, size_t pos) const {
+    AllocTraits::destroy(alloc, &entries_[pos]);
+  }
+
+ private:
+  using AllocTraits = std::allocator_traits<Allocator>;
+
+  Entry* entries_;
+};
+
+// Stands in for a pointer to an entry that does not exist in memory as a
+// whole, so that `it->second` works on iterators that return proxies.
+template <typename Reference>
+class ArrowProxy {
+ public:
+  explicit ArrowProxy(Reference ref) : ref_(ref) {}
+
+  Reference* operator->() { return &ref_; }
+
+ private:
+  Reference ref_;
+};
+
+// Stores the keys and the values of std::pair entries in two parallel arrays,
+// so that probing, which compares keys, never brings values into the cache.
+// Entries are accessed through pairs of references.
+template <typename Entry, typename Allocator>
+class SplitSlots;
+
+template <typename Key, typename Value, typename Allocator>
+class SplitSlots<std::pair<Key, Value>, Allocator> {
+ public:
+  using reference = std::pair<const Key&, Value&>;
+  using const_reference = std::pair<const Key&, const Value&>;
+  using pointer = ArrowProxy<reference>;
+  using const_pointer = ArrowProxy<const_reference>;
+
+  using first_array_type = Key;
+  using second_array_type = Value;
+
+  SplitSlots() : keys_(nullptr), values_(nullptr) {}
+
+  void allocate(Allocator& alloc, size_t len) {
+    KeyAllocator key_alloc(alloc);
+    keys_ = KeyAllocTraits::allocate(key_alloc, len);
+    ValueAllocator value_alloc(alloc);
+    values_ = ValueAllocTraits::allocate(value_alloc, len);
+  }
+
+  void deallocate(Allocator& alloc, size_t len) {
+    KeyAllocator key_alloc(alloc);
+    KeyAllocTraits::deallocate(key_alloc, keys_, len);
+    ValueAllocator value_alloc(alloc);
+    ValueAllocTraits::deallocate(value_alloc, values_, len);
+    keys_ = nullptr;
+    values_ = nullptr;
+  }
+
+  template <typename KeyFn>
+  const Key& key(size_t pos, const KeyFn&) const {
+    return keys_[pos];
+  }
+
+  reference at(size_t pos) const { return reference(keys_[pos], values_[pos]); }
+
+  pointer address(size_t pos) const { return pointer(at(pos)); }
+
+  const_pointer constAddress(size_t pos) const {
+    return const_pointer(at(pos));
+  }
+
+  const void* keyAddress(size_t pos) const { return &keys_[pos]; }
+
+  std::pair<Key&&, Value&&> moved(size_t pos) const {
+    return std::pair<Key&&, Value&&>(std::move(keys_[pos]),
+                                     std::move(values_[pos]));
+  }
+
+  // Constructs the entry from a pair, or from a pair of references.
+  template <typename P>
+  void construct(Allocator& alloc, size_t pos, P&& entry) const {
+    KeyAllocator key_alloc(alloc);
+    KeyAllocTraits::construct(key_alloc, &keys_[pos],
+                              std::get<0>(std::forward<P>(entry)));
+    ValueAllocator value_alloc(alloc);
+    ValueAllocTraits::construct(value_alloc, &values_[pos],
+                                std::get<1>(std::forward<P>(entry)));
+  }
+
+  // Constructs the key and the value from the respective tuples of
+  // arguments, as the piecewise constructor of std::pair does.
+  template <typename... KeyArgs, typename... ValueArgs>
+  void construct(Allocator& alloc, size_t pos, std::piecewise_construct_t,
+                 std::tuple<KeyArgs...> key_args,
+                 std::tuple<ValueArgs...> value_args) const {
+    KeyAllocator key_alloc(alloc);
+    constructFromTuple<KeyAllocTraits>(key_alloc, &keys_[pos], key_args,
+                                       std::index_sequence_for<KeyArgs...>());
+    ValueAllocator value_alloc(alloc);
+    constructFromTuple<ValueAllocTraits>(
+        value_alloc, &values_[pos], value_args,
+        std::index_sequence_for<ValueArgs...>());
+  }
+
+  void destroy(Allocator& alloc, size_t pos) const {
+    KeyAllocator key_alloc(alloc);
+    KeyAllocTraits::destroy(key_alloc, &keys_[pos]);
+    ValueAllocator value_alloc(alloc);
+    ValueAllocTraits::destroy(value_alloc, &values_[pos]);
+  }
+
+ private:
+  using AllocTraits = std::allocator_traits<Allocator>;
+  using KeyAllocator = typename AllocTraits::template rebind_alloc<Key>;
+  using KeyAllocTraits = std::allocator_traits<KeyAllocator>;
+  using ValueAllocator = typename AllocTraits::template rebind_alloc<Value>;
+  using ValueAllocTraits = std::allocator_traits<ValueAllocator>;
+
+  template <typename Traits, typename A, typename T, typename Tuple,
+            size_t... I>
+  static void constructFromTuple(A& alloc, T* p, Tuple& args,
+                                 std::index_sequence<I...>) {
+    Traits::construct(alloc, p, std::get<I>(std::move(args))...);
+  }
+
+  Key* keys_;
+  Value* values_;
+};
+
+}  // namespace internal
+}  // namespace roo_collections
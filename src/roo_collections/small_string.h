@@ -5,6 +5,7 @@
 /// @ingroup roo_collections
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <algorithm>
 #include <cstring>
@@ -16,11 +17,58 @@
 
 namespace roo_collections {
 
+namespace internal {
+
+// Character buffer of a SmallString, which also keeps track of its length.
+//
+// For capacities up to 256 bytes, the length is packed into the last byte of
+// the buffer, as the number of unused bytes. When the string is full, that
+// number is zero, and serves as the null terminator. Larger buffers store the
+// length in a separate field.
+template <size_t N, bool kPacked = (N <= 256)>
+class SmallStringBuffer {
+ public:
+  size_t length() const {
+    size_t unused = (uint8_t)data_[N - 1];
+    // Always true; tells the compiler that the length does not wrap around.
+    return unused < N ? N - 1 - unused : 0;
+  }
+
+  void setLength(size_t len) {
+    data_[len] = 0;
+    data_[N - 1] = (char)(N - 1 - len);
+  }
+
+  char data_[N];
+};
+
+template <size_t N>
+class SmallStringBuffer<N, false> {
+ public:
+  size_t length() const { return len_; }
+
+  void setLength(size_t len) {
+    data_[len] = 0;
+    len_ = len;
+  }
+
+  char data_[N];
+
+ private:
+  size_t len_;
+};
+
+}  // namespace internal
+
 /// @brief Fixed-capacity string stored inline (no heap allocation).
 ///
 /// Intended for short, bounded identifiers and other small keys/values where a
 /// constant memory footprint is preferred over unbounded growth.
 ///
+/// The length is stored inline, so that `length()`, conversion to
+/// `roo::string_view`, hashing, and comparisons do not need to scan the
+/// string. For `N` up to 256, this costs no extra memory.
+///
 /// @tparam N Capacity of the internal storage buffer, in bytes.
 template <size_t N>
 class SmallString {
@@ -31,7 +79,7 @@ class SmallString {
   static constexpr size_t kCapacity = N;
 
   /// @brief Creates an empty string.
-  SmallString() { data_[0] = 0; }
+  SmallString() { buf_.setLength(0); }
 
   /// @brief Constructs from a C string.
   /// @param str Null-terminated source string.
@@ -46,13 +94,10 @@ class SmallString {
   SmallString(const roo::string_view& str) { assign(str.data(), str.size()); }
 
   /// @brief Copy constructor.
-  SmallString(const SmallString& other) { assign(other.data_, other.length()); }
+  SmallString(const SmallString& other) = default;
 
   /// @brief Copy assignment.
-  SmallString& operator=(const SmallString& other) {
-    assign(other.data_, other.length());
-    return *this;
-  }
+  SmallString& operator=(const SmallString& other) = default;
 
   /// @brief Assigns from C string.
   SmallString& operator=(const char* other) {
@@ -68,36 +113,85 @@ class SmallString {
 
   /// @brief Returns the string length.
   /// @return Length in characters.
-  size_t length() const { return strlen(data_); }
+  size_t length() const { return buf_.length(); }
 
   /// @brief Returns pointer to null-terminated character data.
-  const char* c_str() const { return data_; }
+  const char* c_str() const { return buf_.data_; }
 
   /// @brief Checks whether the string is empty.
   /// @return `true` when empty.
-  bool empty() const { return data_[0] == 0; }
+  bool empty() const { return length() == 0; }
 
   /// @brief Equality comparison.
-  bool operator==(const SmallString& other) const {
-    return strcmp(data_, other.data_) == 0;
+  template <size_t M>
+  bool operator==(const SmallString<M>& other) const {
+    return equals(other.c_str(), other.length());
   }
 
   /// @brief Inequality comparison.
-  bool operator!=(const SmallString& other) const { return !operator==(other); }
+  template <size_t M>
+  bool operator!=(const SmallString<M>& other) const {
+    return !operator==(other);
+  }
+
+  /// @brief Equality comparison with a string view.
+  bool operator==(roo::string_view other) const {
+    return equals(other.data(), other.size());
+  }
+
+  /// @brief Inequality comparison with a string view.
+  bool operator!=(roo::string_view other) const { return !operator==(other); }
+
+  /// @brief Equality comparison with `std::string`.
+  bool operator==(const std::string& other) const {
+    return equals(other.data(), other.size());
+  }
+
+  /// @brief Inequality comparison with `std::string`.
+  bool operator!=(const std::string& other) const {
+    return !operator==(other);
+  }
+
+  /// @brief Equality comparison with a C string.
+  bool operator==(const char* other) const {
+    return equals(other, strlen(other));
+  }
+
+  /// @brief Inequality comparison with a C string.
+  bool operator!=(const char* other) const { return !operator==(other); }
+
+  friend bool operator==(roo::string_view a, const SmallString& b) {
+    return b == a;
+  }
+  friend bool operator!=(roo::string_view a, const SmallString& b) {
+    return b != a;
+  }
+  friend bool operator==(const std::string& a, const SmallString& b) {
+    return b == a;
+  }
+  friend bool operator!=(const std::string& a, const SmallString& b) {
+    return b != a;
+  }
+  friend bool operator==(const char* a, const SmallString& b) { return b == a; }
+  friend bool operator!=(const char* a, const SmallString& b) { return b != a; }
 
   /// @brief Implicit conversion to `roo::string_view`.
   operator roo::string_view() const {
-    return roo::string_view(data_, length());
+    return roo::string_view(buf_.data_, length());
   }
 
  private:
   void assign(const char* str, size_t len) {
     len = std::min(len, N - 1);
-    memcpy(data_, str, len);
-    data_[len] = 0;
+    memcpy(buf_.data_, str, len);
+    buf_.setLength(len);
   }
 
-  char data_[N];
+  bool equals(const char* str, size_t len) const {
+    return length() == len && memcmp(buf_.data_, str, len) == 0;
+  }
+
+  internal::SmallStringBuffer<N> buf_;
 };
 
 }  // namespace roo_collections
@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `DenseFlatHashMap`.
+/// @ingroup roo_collections
+
+#include "roo_collections/dense_flat_hash_map.h"
@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `serializeSnapshot()` and the snapshot views.
+/// @ingroup roo_collections
+
+#include "roo_collections/flat_hashtable_snapshot.h"
@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `FrozenFlatHashMap` and `FrozenFlatHashSet`.
+/// @ingroup roo_collections
+
+#include "roo_collections/frozen_flat_hash_map.h"
@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `IncrementalFlatHashMap`.
+/// @ingroup roo_collections
+
+#include "roo_collections/incremental_hash_map.h"
@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `InlineFlatHashMap` and `InlineFlatHashSet`.
+/// @ingroup roo_collections
+
+#include "roo_collections/inline_flat_hash_map.h"
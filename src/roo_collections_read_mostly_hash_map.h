@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `ReadMostlyFlatHashMap`.
+/// @ingroup roo_collections
+
+#include "roo_collections/read_mostly_hash_map.h"
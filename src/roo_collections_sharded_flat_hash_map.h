@@ -0,0 +1,5 @@
+/// @file
+/// @brief Public forwarding header for `ShardedFlatHashMap`.
+/// @ingroup roo_collections
+
+#include "roo_collections/sharded_flat_hash_map.h"
@@ -0,0 +1,102 @@
+#include "roo_collections/control_group.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace roo_collections {
+
+namespace {
+
+template <typename Mask>
+std::vector<int> offsets(Mask mask) {
+  std::vector<int> result;
+  for (; mask; mask.clearLowest()) {
+    result.push_back(mask.lowest());
+  }
+  return result;
+}
+
+template <typename Group>
+void verifyGroup() {
+  int8_t ctrl[64];
+  for (int i = 0; i < 64; ++i) ctrl[i] = 2;
+  ctrl[0] = (int8_t)0x85;
+  ctrl[2] = (int8_t)0xFF;
+  ctrl[3] = 0;
+  ctrl[5] = (int8_t)0x85;
+  ctrl[6] = 1;
+  ctrl[Group::kWidth - 1] = 0;
+  ctrl[Group::kWidth] = (int8_t)0x85;
+
+  Group group(ctrl);
+  EXPECT_EQ(offsets(group.match((int8_t)0x85)), (std::vector<int>{0, 5}));
+  EXPECT_EQ(offsets(group.match((int8_t)0x86)), (std::vector<int>{}));
+  EXPECT_EQ(offsets(group.match(1)), (std::vector<int>{6}));
+  EXPECT_EQ(offsets(group.matchEmpty()),
+            (std::vector<int>{3, Group::kWidth - 1}));
+  EXPECT_EQ(offsets(group.matchEmptyOrDeleted()),
+            (std::vector<int>{3, 6, Group::kWidth - 1}));
+  EXPECT_EQ(offsets(group.matchFull()), (std::vector<int>{0, 2, 5}));
+
+  // Loading from an unaligned position.
+  Group shifted(ctrl + 1);
+  EXPECT_EQ(offsets(shifted.match((int8_t)0x85)),
+            (std::vector<int>{4, Group::kWidth - 1}));
+  EXPECT_EQ(offsets(shifted.matchEmpty()),
+            (std::vector<int>{2, Group::kWidth - 2}));
+  EXPECT_EQ(offsets(shifted.matchFull()),
+            (std::vector<int>{1, 4, Group::kWidth - 1}));
+}
+
+}  // namespace
+
+// Verifies the portable SWAR group reports exact per-slot matches, including
+// adjacent zero bytes that could trigger borrow-induced false positives.
+TEST(ControlGroup, Portable) {
+  verifyGroup<PortableControlGroup>();
+
+  int8_t ctrl[8] = {1, 0, 0, 1, 0, (int8_t)0x80, 1, 0};
+  PortableControlGroup group(ctrl);
+  EXPECT_EQ(offsets(group.matchEmpty()), (std::vector<int>{1, 2, 4, 7}));
+  EXPECT_EQ(offsets(group.match(1)), (std::vector<int>{0, 3, 6}));
+  EXPECT_EQ(offsets(group.matchEmptyOrDeleted()),
+            (std::vector<int>{0, 1, 2, 3, 4, 6, 7}));
+  EXPECT_EQ(offsets(group.match((int8_t)0x80)), (std::vector<int>{5}));
+  EXPECT_EQ(offsets(group.matchFull()), (std::vector<int>{5}));
+}
+
+#if defined(__SSE2__)
+// Verifies the SSE2 group against the same scenarios as the portable one.
+TEST(ControlGroup, Sse2) { verifyGroup<Sse2ControlGroup>(); }
+#endif
+
+#if defined(__AVX2__)
+// Verifies the AVX2 group against the same scenarios as the portable one.
+TEST(ControlGroup, Avx2) { verifyGroup<Avx2ControlGroup>(); }
+#endif
+
+// Verifies the single-slot group.
+TEST(ControlGroup, SingleSlot) {
+  int8_t full = (int8_t)0x85;
+  int8_t empty = 0;
+  EXPECT_EQ(offsets(SingleSlotGroup(&full).match(full)),
+            (std::vector<int>{0}));
+  EXPECT_FALSE(SingleSlotGroup(&full).matchEmpty());
+  EXPECT_FALSE(SingleSlotGroup(&full).matchEmptyOrDeleted());
+  int8_t deleted = 1;
+  EXPECT_TRUE(SingleSlotGroup(&deleted).matchEmptyOrDeleted());
+  EXPECT_FALSE(SingleSlotGroup(&deleted).matchEmpty());
+  EXPECT_EQ(offsets(SingleSlotGroup(&empty).matchEmpty()),
+            (std::vector<int>{0}));
+  EXPECT_EQ(offsets(SingleSlotGroup(&full).matchFull()),
+            (std::vector<int>{0}));
+  EXPECT_FALSE(SingleSlotGroup(&empty).matchFull());
+  EXPECT_FALSE(SingleSlotGroup(&deleted).matchFull());
+  int8_t padding = 2;
+  EXPECT_FALSE(SingleSlotGroup(&padding).matchFull());
+}
+
+}  // namespace roo_collections
@@ -0,0 +1,234 @@
+#include "roo_collections/dense_flat_hash_map.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace roo_collections {
+
+TEST(DenseFlatHashMap, Basic) {
+  DenseFlatHashMap<std::string, int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+  EXPECT_FALSE(map.contains("a"));
+  EXPECT_TRUE(map.insert({"a", 1}).second);
+  EXPECT_FALSE(map.insert({"a", 2}).second);
+  EXPECT_TRUE(map.try_emplace("b", 2).second);
+  EXPECT_TRUE(map.insert_or_assign("c", 3).second);
+  EXPECT_FALSE(map.insert_or_assign("c", 30).second);
+  map["d"] = 4;
+  EXPECT_EQ(map.size(), 4);
+  EXPECT_EQ(map.at("a"), 1);
+  EXPECT_EQ(map.at("c"), 30);
+  EXPECT_EQ(map.find("d")->second, 4);
+  EXPECT_EQ(map.find("e"), map.end());
+  // Entries are kept in insertion order.
+  std::vector<std::string> keys;
+  for (const auto& e : map) keys.push_back(e.first);
+  EXPECT_EQ(keys, (std::vector<std::string>{"a", "b", "c", "d"}));
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_FALSE(map.contains("a"));
+  map["a"] = 5;
+  EXPECT_EQ(map.at("a"), 5);
+}
+
+TEST(DenseFlatHashMap, EraseMovesLastEntry) {
+  DenseFlatHashMap<int, int> map = {{1, 10}, {2, 20}, {3, 30}, {4, 40}};
+  EXPECT_TRUE(map.erase(2));
+  EXPECT_FALSE(map.erase(2));
+  ASSERT_EQ(map.size(), 3);
+  EXPECT_EQ(map.begin()[1].first, 4);
+  EXPECT_EQ(map.at(4), 40);
+  EXPECT_TRUE(map.erase(4));
+  EXPECT_EQ(map.at(3), 30);
+  EXPECT_EQ(map.at(1), 10);
+  EXPECT_EQ(map.tombstones(), 2);
+  EXPECT_TRUE(map.erase(1));
+  EXPECT_TRUE(map.erase(3));
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.tombstones(), 0);
+}
+
+TEST(DenseFlatHashMap, EraseWhileIterating) {
+  DenseFlatHashMap<int, int> map;
+  for (int i = 0; i < 1000; ++i) map[i] = i;
+  for (auto it = map.begin(); it != map.end();) {
+    if (it->first % 3 == 0) {
+      it = map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(map.size(), 666);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(map.contains(i), i % 3 != 0);
+  }
+}
+
+namespace {
+
+template <typename Policy>
+using PolicyMap = DenseFlatHashMap<int16_t, int16_t, DefaultHashFn<int16_t>,
+                                   std::equal_to<int16_t>, Policy>;
+
+template <typename Map>
+void stressAgainstStdMap(int rounds) {
+  Map test;
+  std::map<int16_t, int16_t> reference;
+  srand(7);
+  for (int i = 0; i < rounds; ++i) {
+    for (int j = 0; j < 50; ++j) {
+      int16_t k = rand() % 4000;
+      int16_t v = rand();
+      EXPECT_EQ(test.insert({k, v}).second, reference.insert({k, v}).second);
+    }
+    for (int j = 0; j < 40; ++j) {
+      int16_t k = rand() % 4000;
+      EXPECT_EQ(test.erase(k), reference.erase(k) > 0);
+    }
+    ASSERT_EQ(test.size(), reference.size());
+    for (int j = 0; j < 50; ++j) {
+      int16_t k = rand() % 4000;
+      EXPECT_EQ(test.contains(k), reference.count(k) > 0);
+    }
+    std::map<int16_t, int16_t> copy(test.begin(), test.end());
+    ASSERT_EQ(copy, reference);
+  }
+}
+
+}  // namespace
+
+TEST(DenseFlatHashMap, Stress) {
+  stressAgainstStdMap<PolicyMap<SmallSizePolicy>>(200);
+  stressAgainstStdMap<PolicyMap<GroupProbing<LargeSizePolicy>>>(200);
+  stressAgainstStdMap<PolicyMap<PowerOfTwoCapacity<SmallSizePolicy>>>(200);
+  stressAgainstStdMap<
+      PolicyMap<PowerOfTwoCapacity<GroupProbing<SmallSizePolicy>>>>(200);
+}
+
+// Verifies that churn at a steady size neither grows the slot table, nor
+// lets tombstones pile up.
+TEST(DenseFlatHashMap, ChurnAtFixedSizeKeepsCapacity) {
+  DenseFlatHashMap<int, int> map;
+  const int window = 1000;
+  for (int i = 0; i < window; ++i) map[i] = i;
+  auto capacity = map.capacity();
+  for (int i = window; i < 50000; ++i) {
+    map[i] = i;
+    ASSERT_TRUE(map.erase(i - window));
+    ASSERT_EQ(map.capacity(), capacity);
+    ASSERT_LE(map.tombstones(), capacity - window);
+  }
+  for (int i = 50000 - window; i < 50000; ++i) ASSERT_EQ(map.at(i), i);
+}
+
+TEST(DenseFlatHashMap, ReserveAndShrinkToFit) {
+  DenseFlatHashMap<int, std::string> map(1000);
+  EXPECT_GE(map.capacity(), 1000);
+  auto ht_len = map.ht_len();
+  for (int i = 0; i < 1000; ++i) map[i] = std::to_string(i);
+  EXPECT_EQ(map.ht_len(), ht_len);
+  for (int i = 0; i < 990; ++i) map.erase(i);
+  map.shrink_to_fit();
+  EXPECT_LT(map.ht_len(), ht_len);
+  EXPECT_EQ(map.tombstones(), 0);
+  EXPECT_EQ(map.at(995), "995");
+  map.clear();
+  map.shrink_to_fit();
+  EXPECT_EQ(map.ht_len(), 0);
+  map[1] = "1";
+  EXPECT_EQ(map.at(1), "1");
+}
+
+TEST(DenseFlatHashMap, InsertFailsWhenFullAtMaxCapacity) {
+  DenseFlatHashMap<int, int> map;
+  const int n = SmallSizePolicy::kMaxResizeThreshold;
+  for (int i = 0; i < n; ++i) ASSERT_TRUE(map.insert({i, i}).second);
+  EXPECT_EQ(map.insert({n, n}), std::make_pair(map.end(), false));
+  EXPECT_EQ(map.insert_or_assign(n, n), std::make_pair(map.end(), false));
+  EXPECT_FALSE(map.insert_or_assign(5, 50).second);
+  EXPECT_EQ(map.at(5), 50);
+  EXPECT_EQ(map.size(), n);
+  EXPECT_FALSE(map.contains(n));
+  // Erasing leaves a tombstone, which makes room again.
+  EXPECT_TRUE(map.erase(0));
+  EXPECT_TRUE(map.insert({n, n}).second);
+  EXPECT_EQ(map.at(n), n);
+  for (int i = 1; i <= n; ++i) ASSERT_TRUE(map.contains(i));
+}
+
+TEST(DenseFlatHashMap, HeterogeneousLookup) {
+  DenseFlatHashMap<std::string, int, TransparentStringHashFn, TransparentEq>
+      map;
+  EXPECT_TRUE(map.try_emplace(roo::string_view("alpha"), 1).second);
+  map[roo::string_view("beta")] = 2;
+  EXPECT_EQ(map.at("alpha"), 1);
+  EXPECT_EQ(map.find(roo::string_view("beta"))->second, 2);
+  EXPECT_TRUE(map.contains(std::string("beta")));
+  EXPECT_TRUE(map.erase("alpha"));
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(DenseFlatHashMap, MoveOnlyValues) {
+  DenseFlatHashMap<int, std::unique_ptr<int>> map;
+  for (int i = 0; i < 100; ++i) {
+    map.try_emplace(i, std::unique_ptr<int>(new int(i)));
+  }
+  for (int i = 0; i < 100; i += 2) map.erase(i);
+  DenseFlatHashMap<int, std::unique_ptr<int>> moved(std::move(map));
+  EXPECT_EQ(moved.size(), 50);
+  EXPECT_EQ(*moved.at(51), 51);
+}
+
+TEST(DenseFlatHashMap, MovedFromIsReusable) {
+  DenseFlatHashMap<int, int> a;
+  for (int i = 0; i < 100; ++i) a[i] = i;
+  DenseFlatHashMap<int, int> b = std::move(a);
+  EXPECT_TRUE(a.empty());
+  EXPECT_EQ(a.ht_len(), 0);
+  EXPECT_FALSE(a.contains(5));
+  a[5] = 7;
+  EXPECT_EQ(a.at(5), 7);
+  EXPECT_EQ(a.size(), 1);
+  b = std::move(a);
+  EXPECT_EQ(b.size(), 1);
+  EXPECT_EQ(b.at(5), 7);
+  EXPECT_TRUE(a.empty());
+  for (int i = 0; i < 100; ++i) a[i] = -i;
+  EXPECT_EQ(a.size(), 100);
+  EXPECT_EQ(a.at(99), -99);
+}
+
+TEST(DenseFlatHashMap, CopyAndEquality) {
+  DenseFlatHashMap<int, int> map;
+  for (int i = 0; i < 100; ++i) map[i] = i;
+  DenseFlatHashMap<int, int> copy = map;
+  EXPECT_EQ(copy, map);
+  copy.erase(5);
+  EXPECT_NE(copy, map);
+  copy[5] = 5;
+  // Equal contents, in a different order.
+  EXPECT_EQ(copy, map);
+  copy[5] = 6;
+  EXPECT_NE(copy, map);
+  map = copy;
+  EXPECT_EQ(map.at(5), 6);
+}
+
+#ifdef ROO_COLLECTIONS_HAS_PMR
+TEST(DenseFlatHashMap, PolymorphicAllocator) {
+  char arena[16384];
+  std::pmr::monotonic_buffer_resource resource(
+      arena, sizeof(arena), std::pmr::null_memory_resource());
+  pmr::DenseFlatHashMap<int, int> map(&resource);
+  for (int i = 0; i < 200; ++i) map[i] = i * i;
+  EXPECT_EQ(map.get_allocator().resource(), &resource);
+  EXPECT_EQ(map.at(12), 144);
+}
+#endif
+
+}  // namespace roo_collections
@@ -1,8 +1,10 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -348,6 +350,131 @@ TEST(FlatSmallHashMap, Clear) {
   EXPECT_EQ(map.capacity(), 2);
 }
 
+// Verifies that stats() is available without ROO_COLLECTIONS_HASHTABLE_STATS,
+// and reports no tag matches then. See hashtable_stats_test.cpp.
+TEST(FlatSmallHashMap, StatsWithoutCounters) {
+  FlatSmallHashMap<int, int> map{{1, 1}, {2, 2}};
+  EXPECT_TRUE(map.contains(1));
+  HashtableStats stats = map.stats();
+  EXPECT_EQ(stats.size, 2);
+  EXPECT_GE(stats.avg_hit_probe_length, 1);
+  EXPECT_EQ(stats.tag_matches, 0);
+  EXPECT_EQ(stats.tag_false_positives, 0);
+}
+
+// Verifies compacting a table that still needs the largest capacity.
+TEST(FlatSmallHashMap, CompactAtMaxCapacity) {
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 60000; ++i) map[i] = i;
+  for (int i = 0; i < 60000; i += 2) map.erase(i);
+  map.compact();
+  EXPECT_EQ(map.size(), 30000);
+  EXPECT_EQ(map.tombstones(), 0);
+  for (int i = 0; i < 60000; ++i) {
+    ASSERT_EQ(map.contains(i), i % 2 == 1);
+  }
+}
+
+TEST(FlatSmallHashMap, InsertFailsWhenFullAtMaxCapacity) {
+  FlatSmallHashMap<int, int> map;
+  const int n = SmallSizePolicy::kMaxResizeThreshold;
+  for (int i = 0; i < n; ++i) ASSERT_TRUE(map.insert({i, i}).second);
+  EXPECT_EQ(map.capacity(), n);
+  EXPECT_EQ(map.insert({n, n}), std::make_pair(map.end(), false));
+  EXPECT_EQ(map.try_emplace(n, n), std::make_pair(map.end(), false));
+  EXPECT_EQ(map.insert_or_assign(n, n), std::make_pair(map.end(), false));
+  EXPECT_FALSE(map.insert_or_assign(5, 50).second);
+  EXPECT_EQ(map.at(5), 50);
+  std::vector<std::pair<int, int>> more = {{n, n}, {n + 1, n + 1}};
+  EXPECT_EQ(map.insert_unique_range(more.begin(), more.end()), 0);
+  EXPECT_EQ(map.size(), n);
+  EXPECT_FALSE(map.contains(n));
+  // Erasing leaves a tombstone, which makes room again.
+  EXPECT_TRUE(map.erase(0));
+  EXPECT_TRUE(map.insert({n, n}).second);
+  EXPECT_EQ(map.at(n), n);
+  for (int i = 1; i <= n; ++i) ASSERT_TRUE(map.contains(i));
+}
+
+TEST(FlatSmallHashMap, Reserve) {
+  FlatSmallHashMap<int, int> map;
+  map[1] = 1;
+  map.reserve(1000);
+  EXPECT_GE(map.capacity(), 1000);
+  auto ht_len = map.ht_len();
+  for (int i = 0; i < 1000; ++i) map[i] = i;
+  EXPECT_EQ(map.ht_len(), ht_len);
+  // Never shrinks.
+  map.reserve(10);
+  EXPECT_EQ(map.ht_len(), ht_len);
+  for (int i = 0; i < 1000; ++i) ASSERT_EQ(map.at(i), i);
+}
+
+TEST(FlatSmallHashMap, RehashAndShrinkToFit) {
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 100; ++i) map[i] = i;
+  map.rehash(5000);
+  EXPECT_GE(map.ht_len(), 5000);
+  for (int i = 0; i < 100; ++i) ASSERT_EQ(map.at(i), i);
+  for (int i = 0; i < 100; i += 2) map.erase(i);
+  EXPECT_GT(map.tombstones(), 0);
+  // Shrinks as far as the elements allow.
+  map.rehash(0);
+  EXPECT_EQ(map.tombstones(), 0);
+  EXPECT_EQ(map.ht_len(), (FlatSmallHashMap<int, int>(50).ht_len()));
+  map.rehash(5000);
+  map.shrink_to_fit();
+  EXPECT_EQ(map.ht_len(), (FlatSmallHashMap<int, int>(50).ht_len()));
+  for (int i = 0; i < 100; ++i) ASSERT_EQ(map.contains(i), i % 2 == 1);
+}
+
+TEST(FlatSmallHashMap, MaxLoadFactor) {
+  FlatSmallHashMap<int, int> map;
+  EXPECT_NEAR(map.max_load_factor(), 0.73, 0.001);
+  map.max_load_factor(0.5);
+  EXPECT_NEAR(map.max_load_factor(), 0.5, 0.001);
+  EXPECT_EQ(map.capacity(), map.ht_len() / 2);
+  for (int i = 0; i < 5000; ++i) {
+    map[i] = i;
+    ASSERT_LE(map.size(), map.ht_len() / 2);
+  }
+  // Carried over by copies and rehashes.
+  FlatSmallHashMap<int, int> copy = map;
+  EXPECT_EQ(copy.max_load_factor(), map.max_load_factor());
+  copy.compact();
+  EXPECT_EQ(copy.capacity(), copy.ht_len() / 2);
+  // A higher load factor lets the same table hold more elements.
+  auto ht_len = map.ht_len();
+  map.max_load_factor(0.9);
+  EXPECT_GT(map.capacity(), map.ht_len() * 0.89);
+  for (int i = 5000; i < map.capacity(); ++i) map[i] = i;
+  EXPECT_EQ(map.ht_len(), ht_len);
+  // Reserve uses the load factor, too.
+  FlatSmallHashMap<int, int> sparse;
+  sparse.max_load_factor(0.25);
+  sparse.reserve(100);
+  EXPECT_GE(sparse.ht_len(), 400);
+  // Out of range values are clamped.
+  sparse.max_load_factor(2);
+  EXPECT_NEAR(sparse.max_load_factor(), 0.95, 0.001);
+  sparse.max_load_factor(0);
+  EXPECT_NEAR(sparse.max_load_factor(), 0.05, 0.001);
+}
+
+// Verifies that lowering the load factor below the current fill grows the
+// table on the next insert.
+TEST(FlatSmallHashMap, LowerMaxLoadFactorGrowsOnInsert) {
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 700; ++i) map[i] = i;
+  auto ht_len = map.ht_len();
+  map.max_load_factor(0.3);
+  EXPECT_LT(map.capacity(), map.size());
+  map[700] = 700;
+  EXPECT_GT(map.ht_len(), ht_len);
+  EXPECT_LE(map.size(), map.capacity());
+  for (int i = 0; i <= 700; ++i) ASSERT_EQ(map.at(i), i);
+}
+
 TEST(FlatSmallHashMap, OperatorSubscript) {
   std::vector<std::pair<std::string, int>> entries = {
       {"a", 1}, {"b", 2}, {"c", 3}};
@@ -503,6 +630,1068 @@ TEST(FlatSmallHashMap, IteratorsEmpty) {
   EXPECT_EQ(iterBegin, iterEnd);
 }
 
+namespace {
+
+// Fills maps of growing sizes, erasing most entries from the larger ones to
+// leave long runs of empty and deleted slots, and checks that the iterators
+// and for_each() both visit exactly the live entries, in the same order.
+template <typename Policy>
+void verifySparseIteration() {
+  using Map = FlatSmallHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>,
+                               Policy>;
+  for (int n : {0, 1, 2, 7, 15, 16, 17, 31, 33, 100, 1000, 5000}) {
+    Map map;
+    std::map<int, int> expected;
+    for (int i = 0; i < n; ++i) map[i] = i;
+    for (int i = 0; i < n; ++i) {
+      if (n > 100 && i % 29 != 0) {
+        map.erase(i);
+      } else {
+        expected[i] = i;
+      }
+    }
+    std::vector<int> keys;
+    for (auto it = map.begin(); it != map.end(); ++it) {
+      keys.push_back(it->first);
+    }
+    std::vector<int> visited;
+    map.for_each([&](const std::pair<int, int>& e) {
+      visited.push_back(e.first);
+    });
+    EXPECT_EQ(visited, keys);
+    std::map<int, int> actual(map.begin(), map.end());
+    EXPECT_EQ(actual, expected) << "n = " << n;
+  }
+}
+
+}  // namespace
+
+TEST(FlatSmallHashMap, IteratesSparseTables) {
+  verifySparseIteration<SmallSizePolicy>();
+  verifySparseIteration<GroupProbing<SmallSizePolicy>>();
+  verifySparseIteration<PowerOfTwoCapacity<SmallSizePolicy>>();
+  verifySparseIteration<GroupProbing<LargeSizePolicy>>();
+  verifySparseIteration<SplitKeyValue<SmallSizePolicy>>();
+}
+
+TEST(FlatSmallHashMap, ForEach) {
+  FlatSmallHashMap<std::string, int> map;
+  int calls = 0;
+  map.for_each([&](const std::pair<std::string, int>&) { ++calls; });
+  EXPECT_EQ(calls, 0);
+  for (int i = 0; i < 100; ++i) map[std::to_string(i)] = i;
+  map.for_each([](std::pair<std::string, int>& e) { e.second *= 2; });
+  const auto& const_map = map;
+  int sum = 0;
+  const_map.for_each([&](const std::pair<std::string, int>& e) {
+    EXPECT_EQ(e.second, 2 * std::stoi(e.first));
+    sum += e.second;
+  });
+  EXPECT_EQ(sum, 9900);
+}
+
+TEST(FlatSmallHashMap, SplitKeyValueForEach) {
+  FlatSmallHashMap<int, std::string, DefaultHashFn<int>, std::equal_to<int>,
+                   SplitKeyValue<GroupProbing<SmallSizePolicy>>>
+      map;
+  for (int i = 0; i < 50; ++i) map[i] = "v";
+  map.for_each(
+      [](std::pair<const int&, std::string&> e) { e.second += "!"; });
+  int count = 0;
+  map.for_each([&](std::pair<const int&, const std::string&> e) {
+    EXPECT_EQ(e.second, "v!");
+    ++count;
+  });
+  EXPECT_EQ(count, 50);
+}
+
+namespace {
+
+// Value type without a default constructor, which counts live instances.
+class Tracked {
+ public:
+  explicit Tracked(int v) : v_(v) { ++live_; }
+  Tracked(const Tracked& other) : v_(other.v_) { ++live_; }
+  Tracked(Tracked&& other) : v_(other.v_) { ++live_; }
+  Tracked& operator=(const Tracked& other) = default;
+  Tracked& operator=(Tracked&& other) = default;
+  ~Tracked() { --live_; }
+
+  bool operator==(const Tracked& other) const { return v_ == other.v_; }
+  bool operator!=(const Tracked& other) const { return v_ != other.v_; }
+
+  int v() const { return v_; }
+
+  static int live() { return live_; }
+
+ private:
+  int v_;
+  static int live_;
+};
+
+int Tracked::live_ = 0;
+
+}  // namespace
+
+// Verifies that entries need not be default-constructible, and that only
+// occupied slots ever hold live entries, across insert, erase, rehash, copy,
+// clear, compact and destruction.
+TEST(FlatSmallHashMap, OnlyOccupiedSlotsHoldLiveEntries) {
+  ASSERT_EQ(Tracked::live(), 0);
+  {
+    FlatSmallHashMap<int, Tracked> map(0);
+    EXPECT_EQ(Tracked::live(), 0);
+    for (int i = 0; i < 500; ++i) {
+      map.insert({i, Tracked(i)});
+      EXPECT_EQ(Tracked::live(), map.size());
+    }
+    for (int i = 0; i < 500; i += 2) {
+      EXPECT_TRUE(map.erase(i));
+    }
+    EXPECT_EQ(Tracked::live(), 250);
+    {
+      FlatSmallHashMap<int, Tracked> copy(map);
+      EXPECT_EQ(Tracked::live(), 500);
+      EXPECT_EQ(copy, map);
+      copy = map;
+      EXPECT_EQ(Tracked::live(), 500);
+    }
+    EXPECT_EQ(Tracked::live(), 250);
+    map.compact();
+    EXPECT_EQ(Tracked::live(), 250);
+    for (int i = 1; i < 500; i += 2) {
+      ASSERT_TRUE(map.contains(i));
+      EXPECT_EQ(map.at(i).v(), i);
+    }
+    map.clear();
+    EXPECT_EQ(Tracked::live(), 0);
+    map.insert({7, Tracked(7)});
+    EXPECT_EQ(Tracked::live(), 1);
+  }
+  EXPECT_EQ(Tracked::live(), 0);
+}
+
+// Verifies that repeated churn through in-place tombstone purges keeps the
+// entry lifetimes balanced.
+TEST(FlatSmallHashMap, ChurnKeepsEntryLifetimesBalanced) {
+  {
+    FlatSmallHashMap<int, Tracked> map;
+    for (int i = 0; i < 1000; ++i) {
+      map.insert({i, Tracked(i)});
+      if (i >= 5) {
+        EXPECT_TRUE(map.erase(i - 5));
+      }
+      EXPECT_EQ(Tracked::live(), map.size());
+    }
+    EXPECT_EQ(map.size(), 5);
+  }
+  EXPECT_EQ(Tracked::live(), 0);
+}
+
+// Verifies that try_emplace constructs the entry only when the key is absent,
+// and leaves the key and arguments untouched otherwise.
+TEST(FlatSmallHashMap, TryEmplace) {
+  FlatSmallHashMap<std::string, std::unique_ptr<int>> map;
+  auto result = map.try_emplace("a", new int(1));
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ(*(*result.first).second, 1);
+
+  std::string key = "a";
+  std::unique_ptr<int> value(new int(2));
+  result = map.try_emplace(std::move(key), std::move(value));
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(*(*result.first).second, 1);
+  EXPECT_EQ(key, "a");
+  ASSERT_NE(value, nullptr);
+
+  result = map.try_emplace("b", std::move(value));
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ(value, nullptr);
+  EXPECT_EQ(*map.at("b"), 2);
+  EXPECT_EQ(map.size(), 2);
+}
+
+// Verifies that try_emplace does not construct the value when the key is
+// present, even after the table has grown.
+TEST(FlatSmallHashMap, TryEmplaceDoesNotConstructWhenPresent) {
+  FlatSmallHashMap<int, Tracked> map;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(map.try_emplace(i, i).second);
+  }
+  EXPECT_EQ(Tracked::live(), 100);
+  for (int i = 0; i < 100; ++i) {
+    auto result = map.try_emplace(i, -1);
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ((*result.first).second.v(), i);
+  }
+  EXPECT_EQ(Tracked::live(), 100);
+}
+
+// Verifies heterogeneous try_emplace and operator[] on a string map.
+TEST(FlatSmallHashMap, TryEmplaceHeterogeneous) {
+  FlatSmallStringHashMap<int> map;
+  EXPECT_TRUE(map.try_emplace(roo::string_view("abc"), 1).second);
+  EXPECT_FALSE(map.try_emplace("abc", 2).second);
+  EXPECT_TRUE(map.try_emplace(std::string("def"), 3).second);
+  EXPECT_EQ(map.at("abc"), 1);
+  EXPECT_EQ(map.at("def"), 3);
+  map[roo::string_view("ghi")] = 4;
+  EXPECT_EQ(map.at(std::string("ghi")), 4);
+  EXPECT_EQ(map.size(), 3);
+}
+
+// Verifies insert_or_assign inserts new keys and overwrites existing values.
+TEST(FlatSmallHashMap, InsertOrAssign) {
+  FlatSmallStringHashMap<std::string> map;
+  auto result = map.insert_or_assign("a", "x");
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ((*result.first).second, "x");
+  result = map.insert_or_assign(roo::string_view("a"), "y");
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ((*result.first).second, "y");
+  std::string key = "b";
+  result = map.insert_or_assign(std::move(key), std::string("z"));
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ(map.at("b"), "z");
+  EXPECT_EQ(map.size(), 2);
+}
+
+// Verifies emplace on maps and sets.
+TEST(FlatSmallHashMap, Emplace) {
+  FlatSmallHashMap<std::string, int> map;
+  EXPECT_TRUE(map.emplace("a", 1).second);
+  EXPECT_FALSE(map.emplace("a", 2).second);
+  EXPECT_EQ(map.at("a"), 1);
+
+  FlatSmallHashSet<std::string> set;
+  EXPECT_TRUE(set.emplace(3, 'x').second);
+  EXPECT_FALSE(set.emplace("xxx").second);
+  EXPECT_TRUE(set.contains("xxx"));
+}
+
+TEST(FlatSmallHashMap, InsertUniqueRange) {
+  std::vector<std::pair<int, int>> entries;
+  for (int i = 0; i < 10000; ++i) entries.push_back({i, -i});
+  FlatSmallHashMap<int, int> map = {{-1, 1}};
+  EXPECT_EQ(map.insert_unique_range(entries.begin(), entries.end()), 10000);
+  EXPECT_EQ(map.size(), 10001);
+  // Sized once, for all the entries.
+  EXPECT_EQ(map.ht_len(), (FlatSmallHashMap<int, int>(10001).ht_len()));
+  for (int i = 0; i < 10000; ++i) ASSERT_EQ(map.at(i), -i);
+  EXPECT_EQ(map.at(-1), 1);
+
+  FlatSmallHashSet<std::string, DefaultHashFn<std::string>,
+                   std::equal_to<std::string>,
+                   StoredHash<GroupProbing<SmallSizePolicy>>>
+      set;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; ++i) keys.push_back(std::to_string(i));
+  set.insert_unique_range(keys.begin(), keys.end());
+  for (const std::string& k : keys) ASSERT_TRUE(set.contains(k));
+}
+
+namespace {
+
+// Hash function with per-instance state, so that tables using different
+// seeds place the same keys differently.
+struct SeededHash {
+  size_t operator()(int key) const { return fmix32(key ^ seed); }
+  uint32_t seed;
+};
+
+}  // namespace
+
+TEST(FlatSmallHashMap, MergeIntoEmptyTakesOverStorage) {
+  FlatSmallHashMap<int, int> source;
+  for (int i = 0; i < 1000; ++i) source[i] = i;
+  const void* storage = &*source.begin();
+  FlatSmallHashMap<int, int> target;
+  target.max_load_factor(0.5);
+  target.merge(std::move(source));
+  EXPECT_TRUE(source.empty());
+  EXPECT_EQ(target.size(), 1000);
+  EXPECT_EQ(&*target.begin(), storage);
+  EXPECT_NEAR(target.max_load_factor(), 0.5, 0.001);
+  for (int i = 0; i < 1000; ++i) ASSERT_EQ(target.at(i), i);
+}
+
+TEST(FlatSmallHashMap, MergeIntoEmptyRehashes) {
+  FlatSmallHashMap<int, int, SeededHash> source(8, SeededHash{1});
+  for (int i = 0; i < 1000; ++i) source[i] = i;
+  FlatSmallHashMap<int, int, SeededHash> target(8, SeededHash{2});
+  target.merge(source);
+  EXPECT_TRUE(source.empty());
+  EXPECT_EQ(target.size(), 1000);
+  for (int i = 0; i < 1000; ++i) ASSERT_EQ(target.at(i), i);
+  EXPECT_FALSE(target.contains(1000));
+}
+
+TEST(FlatSmallHashMap, MergeKeepsDuplicatesInSource) {
+  FlatSmallHashMap<std::string, int> target;
+  FlatSmallHashMap<std::string, int> source;
+  for (int i = 0; i < 100; ++i) target[std::to_string(i)] = i;
+  for (int i = 50; i < 150; ++i) source[std::to_string(i)] = -i;
+  target.merge(source);
+  EXPECT_EQ(target.size(), 150);
+  EXPECT_EQ(source.size(), 50);
+  for (int i = 0; i < 150; ++i) {
+    ASSERT_EQ(target.at(std::to_string(i)), i < 100 ? i : -i);
+  }
+  for (int i = 50; i < 100; ++i) {
+    ASSERT_EQ(source.at(std::to_string(i)), -i);
+  }
+  // Merging into itself does nothing.
+  target.merge(target);
+  EXPECT_EQ(target.size(), 150);
+}
+
+// Merging into a map that fills up at the largest capacity leaves the entries
+// that don't fit in the source.
+TEST(FlatSmallHashMap, MergeStopsWhenFullAtMaxCapacity) {
+  FlatSmallHashMap<int, int> target;
+  FlatSmallHashMap<int, int> source;
+  const int n = SmallSizePolicy::kMaxResizeThreshold;
+  for (int i = 0; i < n - 10; ++i) target[i] = i;
+  for (int i = n - 20; i < n + 100; ++i) source[i] = -i;
+  target.merge(source);
+  EXPECT_EQ(target.size(), n);
+  EXPECT_EQ(target.size() + source.size(), n + 110);
+  for (int i = n - 20; i < n - 10; ++i) {
+    ASSERT_EQ(target.at(i), i);
+    ASSERT_EQ(source.at(i), -i);
+  }
+  for (const auto& e : source) {
+    ASSERT_EQ(target.contains(e.first), e.first < n - 10);
+  }
+}
+
+// Verifies the 32-bit modular reduction against plain modulo.
+TEST(FlatSmallHashtable, LargeFastmodMatchesModulo) {
+  static const uint32_t samples[] = {0,          1,          2,
+                                     12345,      65535,      65536,
+                                     0x7fffffff, 0x80000000, 0xfffffffa,
+                                     0xfffffffb, 0xffffffff};
+  for (int idx = 0; idx < 32; ++idx) {
+    for (uint32_t n : samples) {
+      EXPECT_EQ(largeFastmod(n, idx), n % kLargeRadkePrimes[idx])
+          << "n=" << n << " idx=" << idx;
+    }
+    for (uint32_t n = 0; n < 100000; n += 7) {
+      uint32_t v = n * 2654435761u;
+      ASSERT_EQ(largeFastmod(v, idx), v % kLargeRadkePrimes[idx]);
+    }
+  }
+}
+
+// Verifies that the default size policy keeps the compact 16-bit layout, and
+// that the large policy only widens it.
+TEST(FlatSmallHashtable, SizePolicyLayout) {
+  using Small = FlatSmallHashSet<int>;
+  using Large = FlatSmallHashSet<int, DefaultHashFn<int>, std::equal_to<int>,
+                                 LargeSizePolicy>;
+  static_assert(sizeof(Small::size_type) == 2, "");
+  static_assert(sizeof(Large::size_type) == 4, "");
+  EXPECT_LT(sizeof(Small), sizeof(Large));
+}
+
+// Verifies that a table with the large size policy grows well past 64k
+// elements and supports lookup, erase and compaction at that size.
+TEST(FlatSmallHashMap, LargeSizePolicyBeyond64k) {
+  FlatSmallHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>,
+                   LargeSizePolicy>
+      map;
+  const int n = 200000;
+  for (int i = 0; i < n; ++i) {
+    ASSERT_TRUE(map.insert({i, -i}).second);
+  }
+  EXPECT_EQ(map.size(), n);
+  EXPECT_GE(map.capacity(), n);
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(map.at(i), -i);
+  }
+  EXPECT_FALSE(map.contains(n));
+  for (int i = 0; i < n; i += 2) {
+    ASSERT_TRUE(map.erase(i));
+  }
+  EXPECT_EQ(map.size(), n / 2);
+  map.compact();
+  EXPECT_EQ(map.size(), n / 2);
+  size_t count = 0;
+  for (const auto& e : map) {
+    EXPECT_EQ(e.first % 2, 1);
+    ++count;
+  }
+  EXPECT_EQ(count, n / 2);
+}
+
+namespace {
+
+template <typename Policy>
+using PolicyIntMap =
+    FlatSmallHashMap<int16_t, int16_t, DefaultHashFn<int16_t>,
+                     std::equal_to<int16_t>, Policy>;
+
+// Runs random inserts and erases against std::map, checking that the
+// contents and lookups agree throughout.
+template <typename Map>
+void stressAgainstStdMap(int rounds) {
+  Map test;
+  std::map<int16_t, int16_t> reference;
+  srand(7);
+  for (int i = 0; i < rounds; ++i) {
+    for (int j = 0; j < 50; ++j) {
+      int16_t k = rand() % 4000;
+      int16_t v = rand();
+      EXPECT_EQ(test.insert({k, v}).second, reference.insert({k, v}).second);
+    }
+    for (int j = 0; j < 40; ++j) {
+      int16_t k = rand() % 4000;
+      EXPECT_EQ(test.erase(k), reference.erase(k) > 0);
+    }
+    ASSERT_EQ(test.size(), reference.size());
+    for (int j = 0; j < 50; ++j) {
+      int16_t k = rand() % 4000;
+      EXPECT_EQ(test.contains(k), reference.count(k) > 0);
+    }
+    std::map<int16_t, int16_t> copy(test.begin(), test.end());
+    ASSERT_EQ(copy, reference);
+  }
+}
+
+}  // namespace
+
+// Verifies that batched lookups agree with find(), across several batches,
+// and with a mix of hits and misses.
+TEST(FlatSmallHashMap, FindBatch) {
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 100; i += 2) map[i] = i * 10;
+  std::vector<int> keys;
+  for (int i = 0; i < 41; ++i) keys.push_back(i * 3);
+  std::vector<FlatSmallHashMap<int, int>::iterator> results(keys.size());
+  map.find_batch(keys.data(), keys.size(), results.data());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(results[i], map.find(keys[i]));
+    if (keys[i] % 2 == 0 && keys[i] < 100) {
+      (*results[i]).second = -1;
+    }
+  }
+  EXPECT_EQ(map.at(6), -1);
+
+  const FlatSmallHashMap<int, int>& cmap = map;
+  std::vector<FlatSmallHashMap<int, int>::const_iterator> cresults(
+      keys.size());
+  cmap.find_batch(keys.data(), keys.size(), cresults.data());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(cresults[i], cmap.find(keys[i]));
+  }
+}
+
+TEST(FlatSmallHashMap, FindBatchHeterogeneous) {
+  FlatSmallStringHashMap<int> map{{"a", 1}, {"b", 2}, {"c", 3}};
+  const char* keys[] = {"a", "x", "c", "", "b"};
+  FlatSmallStringHashMap<int>::iterator results[5];
+  map.find_batch(keys, 5, results);
+  EXPECT_EQ((*results[0]).second, 1);
+  EXPECT_EQ(results[1], map.end());
+  EXPECT_EQ((*results[2]).second, 3);
+  EXPECT_EQ(results[3], map.end());
+  EXPECT_EQ((*results[4]).second, 2);
+}
+
+TEST(FlatSmallHashSet, ContainsBatch) {
+  FlatSmallStringHashSet set{"foo", "bar"};
+  roo::string_view keys[] = {"bar", "baz", "foo"};
+  bool results[3];
+  set.contains_batch(keys, 3, results);
+  EXPECT_TRUE(results[0]);
+  EXPECT_FALSE(results[1]);
+  EXPECT_TRUE(results[2]);
+
+  FlatSmallHashSet<int> empty;
+  int ints[] = {1, 2};
+  empty.contains_batch(ints, 2, results);
+  EXPECT_FALSE(results[0]);
+  EXPECT_FALSE(results[1]);
+  empty.contains_batch(ints, 0, results);
+}
+
+// Verifies that re-inserting an erased key takes over its tombstone.
+TEST(FlatSmallHashMap, InsertReusesTombstone) {
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 6; ++i) map[i] = i;
+  EXPECT_TRUE(map.erase(3));
+  EXPECT_TRUE(map.erase(4));
+  EXPECT_EQ(map.tombstones(), 2);
+  map[3] = 30;
+  EXPECT_EQ(map.tombstones(), 1);
+  map[4] = 40;
+  EXPECT_EQ(map.tombstones(), 0);
+  EXPECT_EQ(map.size(), 6);
+  EXPECT_EQ(map.at(3), 30);
+  EXPECT_EQ(map.at(4), 40);
+}
+
+namespace {
+
+// Slides a window of `window` live keys over a long sequence of keys, and
+// checks that the capacity never changes, and that tombstones never
+// accumulate beyond the resize threshold.
+template <typename Policy>
+void churnAtFixedSize(int window) {
+  FlatSmallHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>, Policy>
+      map;
+  for (int i = 0; i < window; ++i) map[i] = i;
+  auto capacity = map.capacity();
+  for (int i = window; i < 50000; ++i) {
+    map[i] = i;
+    ASSERT_TRUE(map.erase(i - window));
+    ASSERT_EQ(map.capacity(), capacity);
+    ASSERT_LE(map.tombstones(), capacity - window);
+  }
+  ASSERT_EQ(map.size(), window);
+  for (int i = 50000 - window; i < 50000; ++i) {
+    ASSERT_EQ(map.at(i), i);
+  }
+  EXPECT_FALSE(map.contains(50000 - window - 1));
+}
+
+}  // namespace
+
+// Verifies that churn at a steady size never grows nor reallocates the table.
+TEST(FlatSmallHashMap, ChurnAtFixedSizeKeepsCapacity) {
+  churnAtFixedSize<SmallSizePolicy>(5);
+  churnAtFixedSize<SmallSizePolicy>(100);
+  churnAtFixedSize<SmallSizePolicy>(1000);
+  churnAtFixedSize<GroupProbing<SmallSizePolicy>>(100);
+  churnAtFixedSize<GroupProbing<LargeSizePolicy>>(1000);
+}
+
+// Verifies group probing with the widest group available on the target.
+TEST(FlatSmallHashMap, GroupProbingStress) {
+  stressAgainstStdMap<PolicyIntMap<GroupProbing<SmallSizePolicy>>>(200);
+}
+
+// Verifies group probing with the portable SWAR group, and the large size
+// policy.
+TEST(FlatSmallHashMap, PortableGroupProbingStress) {
+  stressAgainstStdMap<
+      PolicyIntMap<GroupProbing<LargeSizePolicy, PortableControlGroup>>>(200);
+}
+
+// Verifies group probing on tables smaller than a single group, including the
+// empty table, and with heterogeneous string lookup.
+TEST(FlatSmallHashMap, GroupProbingSmallTables) {
+  FlatSmallHashMap<std::string, int, TransparentStringHashFn, TransparentEq,
+                   GroupProbing<SmallSizePolicy>>
+      map(0);
+  EXPECT_FALSE(map.contains("a"));
+  EXPECT_EQ(map.begin(), map.end());
+  for (int i = 0; i < 20; ++i) {
+    map[std::to_string(i)] = i;
+    for (int j = 0; j <= i; ++j) {
+      ASSERT_EQ(map.at(roo::string_view(std::to_string(j))), j);
+    }
+    EXPECT_FALSE(map.contains("x"));
+  }
+  for (int i = 0; i < 20; i += 3) {
+    EXPECT_TRUE(map.erase(std::to_string(i)));
+  }
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(map.contains(std::to_string(i)), i % 3 != 0);
+  }
+  auto copy = map;
+  EXPECT_EQ(copy, map);
+}
+
+// Verifies that a key hashed once can be looked up, inserted, and erased in
+// several tables that share the hash function.
+TEST(FlatSmallHashMap, WithHash) {
+  FlatSmallStringHashMap<int> config{{"a", 1}, {"b", 2}};
+  FlatSmallStringHashMap<int> overrides{{"b", 20}};
+  FlatSmallStringHashSet seen;
+  for (const char* key : {"a", "b", "c"}) {
+    size_t hash = config.hash_function()(key);
+    EXPECT_EQ(hash, overrides.hash_function()(std::string(key)));
+    auto it = overrides.find_with_hash(roo::string_view(key), hash);
+    if (it == overrides.end()) it = config.find_with_hash(key, hash);
+    const auto& const_config = config;
+    EXPECT_EQ(const_config.find_with_hash(std::string(key), hash) ==
+                  const_config.end(),
+              !config.contains(key));
+    EXPECT_EQ(config.contains_with_hash(key, hash), config.contains(key));
+    EXPECT_TRUE(seen.insert_with_hash(key, hash).second);
+    EXPECT_FALSE(seen.insert_with_hash(key, hash).second);
+    if (key[0] == 'c') {
+      EXPECT_EQ(it, config.end());
+      EXPECT_TRUE(config.insert_with_hash({key, 3}, hash).second);
+      continue;
+    }
+    (*it).second *= 10;
+  }
+  EXPECT_EQ(config,
+            FlatSmallStringHashMap<int>({{"a", 10}, {"b", 2}, {"c", 3}}));
+  EXPECT_EQ(overrides, FlatSmallStringHashMap<int>({{"b", 200}}));
+  EXPECT_EQ(seen.size(), 3);
+  size_t hash = seen.hash_function()("b");
+  EXPECT_TRUE(seen.erase_with_hash("b", hash));
+  EXPECT_FALSE(seen.erase_with_hash("b", hash));
+  EXPECT_FALSE(seen.contains_with_hash(roo::string_view("b"), hash));
+  EXPECT_TRUE(overrides.erase_with_hash(std::string("b"), hash));
+  EXPECT_TRUE(overrides.empty());
+}
+
+TEST(FlatSmallHashMap, TryEmplaceWithHash) {
+  FlatSmallStringHashMap<int> map;
+  size_t hash = map.hash_function()("a");
+  EXPECT_TRUE(map.try_emplace_with_hash(roo::string_view("a"), hash, 1).second);
+  auto result = map.try_emplace_with_hash(std::string("a"), hash, 2);
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ((*result.first).second, 1);
+  FlatSmallHashMap<int, std::string> ints;
+  EXPECT_TRUE(ints.try_emplace_with_hash(5, ints.hash_function()(5), 3, 'x')
+                  .second);
+  EXPECT_EQ(ints.at(5), "xxx");
+}
+
+template <typename StringHash>
+void heterogeneousLookupWith() {
+  FlatSmallHashMap<std::string, int, BasicTransparentStringHashFn<StringHash>,
+                   TransparentEq>
+      map;
+  for (int i = 0; i < 1000; ++i) {
+    map[std::string(i % 50, 'x') + std::to_string(i)] = i;
+  }
+  for (int i = 0; i < 1000; ++i) {
+    std::string key = std::string(i % 50, 'x') + std::to_string(i);
+    ASSERT_EQ(map.at(key.c_str()), i);
+    ASSERT_EQ(map.at(roo::string_view(key)), i);
+  }
+  EXPECT_FALSE(map.contains("x"));
+}
+
+TEST(FlatSmallHashMap, AlternativeStringHashes) {
+  heterogeneousLookupWith<Murmur3StringHash>();
+  heterogeneousLookupWith<WyStringHash>();
+  heterogeneousLookupWith<Crc32cStringHash>();
+}
+
+namespace {
+
+// Counts calls to the hash function and key comparisons.
+struct CountingHash {
+  size_t operator()(const std::string& key) const {
+    ++calls;
+    return DefaultHashFn<std::string>()(key);
+  }
+  static int calls;
+};
+
+int CountingHash::calls = 0;
+
+struct CountingEq {
+  bool operator()(const std::string& a, const std::string& b) const {
+    ++calls;
+    return a == b;
+  }
+  static int calls;
+};
+
+int CountingEq::calls = 0;
+
+}  // namespace
+
+// Verifies that with stored hashes, growing and purging tombstones never hash
+// the keys again, and that misses never compare keys.
+TEST(FlatSmallHashMap, StoredHashAvoidsRehashingAndCompares) {
+  FlatSmallHashMap<std::string, int, CountingHash, CountingEq,
+                   StoredHash<SmallSizePolicy>>
+      map;
+  CountingHash::calls = 0;
+  for (int i = 0; i < 2000; ++i) map[std::to_string(i)] = i;
+  EXPECT_EQ(CountingHash::calls, 2000);
+  for (int i = 0; i < 2000; i += 2) map.erase(std::to_string(i));
+  for (int i = 0; i < 2000; ++i) map[std::to_string(i + 2000)] = i;
+  EXPECT_EQ(CountingHash::calls, 5000);
+  EXPECT_EQ(map.size(), 3000);
+  CountingEq::calls = 0;
+  for (int i = 5000; i < 10000; ++i) {
+    EXPECT_FALSE(map.contains(std::to_string(i)));
+  }
+  EXPECT_EQ(CountingEq::calls, 0);
+  auto copy = map;
+  for (int i = 1; i < 4000; ++i) {
+    ASSERT_EQ(copy.contains(std::to_string(i)), i % 2 == 1 || i >= 2000);
+  }
+  copy.compact();
+  EXPECT_EQ(copy, map);
+}
+
+TEST(FlatSmallHashMap, StoredHashStress) {
+  stressAgainstStdMap<PolicyIntMap<StoredHash<SmallSizePolicy>>>(200);
+  stressAgainstStdMap<
+      PolicyIntMap<StoredHash<GroupProbing<LargeSizePolicy>>>>(200);
+}
+
+// Verifies that the triangular probe sequence covers every slot of a
+// power-of-two table, one group at a time.
+TEST(FlatSmallHashtable, TriangularProbeSeqCoversTable) {
+  for (uint16_t cap = 1; cap <= 1024; cap *= 2) {
+    for (uint16_t home : {0, 1, cap / 2, cap - 1}) {
+      if (home >= cap) continue;
+      std::vector<bool> seen(cap);
+      TriangularProbeSeq<uint16_t, 1> single(home, cap);
+      for (int i = 0; i < cap; ++i) {
+        ASSERT_FALSE(seen[single.pos()]) << "cap=" << cap << " i=" << i;
+        seen[single.pos()] = true;
+        if (i + 1 < cap) single.next();
+      }
+      std::vector<bool> covered(cap);
+      TriangularProbeSeq<uint16_t, 16> grouped(home, cap);
+      int groups = cap < 16 ? 1 : cap / 16;
+      for (int i = 0; i < groups; ++i) {
+        ASSERT_EQ(grouped.pos() % (cap < 16 ? cap : 16), 0);
+        for (int j = 0; j < 16 && grouped.pos() + j < cap; ++j) {
+          ASSERT_FALSE(covered[grouped.pos() + j]);
+          covered[grouped.pos() + j] = true;
+        }
+        if (i + 1 < groups) grouped.next();
+      }
+      EXPECT_EQ(std::count(covered.begin(), covered.end(), true), cap);
+    }
+  }
+}
+
+TEST(FlatSmallHashtable, PowerOfTwoCapacityLayout) {
+  using Small = PowerOfTwoCapacity<SmallSizePolicy>;
+  using Large = PowerOfTwoCapacity<LargeSizePolicy>;
+  static_assert(Small::htLen(0) == 1, "");
+  static_assert(Small::htLen(1) == 4, "");
+  static_assert(Small::htLen(Small::kMaxCapacityIdx) == 32768, "");
+  static_assert(Large::htLen(Large::kMaxCapacityIdx) == 0x80000000u, "");
+  static_assert(Small::kMaxResizeThreshold < 32768, "");
+  // The default capacity holds 8 elements.
+  static_assert(Small::htLen(initialCapacityIdx<Small>(8)) == 16, "");
+  for (int idx = 0; idx <= Small::kMaxCapacityIdx; ++idx) {
+    for (uint32_t hash : {0u, 1u, 0x12345678u, 0xffffffffu}) {
+      ASSERT_LT(Small::homeSlot(hash, idx), Small::htLen(idx));
+    }
+  }
+}
+
+// Verifies power-of-two capacities on their own, and composed with the other
+// adapters in either order.
+TEST(FlatSmallHashMap, PowerOfTwoCapacityStress) {
+  stressAgainstStdMap<PolicyIntMap<PowerOfTwoCapacity<SmallSizePolicy>>>(200);
+  stressAgainstStdMap<
+      PolicyIntMap<PowerOfTwoCapacity<GroupProbing<LargeSizePolicy>>>>(200);
+  stressAgainstStdMap<PolicyIntMap<
+      GroupProbing<PowerOfTwoCapacity<SmallSizePolicy>, PortableControlGroup>>>(
+      200);
+  stressAgainstStdMap<PolicyIntMap<
+      StoredHash<PowerOfTwoCapacity<GroupProbing<SmallSizePolicy>>>>>(200);
+}
+
+TEST(FlatSmallHashMap, PowerOfTwoCapacityChurn) {
+  churnAtFixedSize<PowerOfTwoCapacity<SmallSizePolicy>>(5);
+  churnAtFixedSize<PowerOfTwoCapacity<SmallSizePolicy>>(1000);
+  churnAtFixedSize<PowerOfTwoCapacity<GroupProbing<LargeSizePolicy>>>(1000);
+}
+
+// Keys that differ only in their upper bits would all land in the same slot,
+// if the identity hash were simply masked.
+TEST(FlatSmallHashMap, PowerOfTwoCapacityMixesIdentityHash) {
+  FlatSmallHashSet<uint32_t, DefaultHashFn<uint32_t>, std::equal_to<uint32_t>,
+                   PowerOfTwoCapacity<LargeSizePolicy>>
+      set;
+  for (uint32_t i = 0; i < 4096; ++i) set.insert(i << 20);
+  EXPECT_EQ(set.size(), 4096);
+  EXPECT_EQ(set.ht_len(), 8192);
+  HashtableStats stats = set.stats();
+  EXPECT_LT(stats.avg_hit_probe_length, 2);
+  EXPECT_LT(stats.max_hit_probe_length, 32);
+}
+
+// Fills a table to its largest capacity, and up to the resize threshold.
+TEST(FlatSmallHashMap, PowerOfTwoCapacityAtMaxCapacity) {
+  using Policy = PowerOfTwoCapacity<GroupProbing<SmallSizePolicy>>;
+  FlatSmallHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>, Policy>
+      map;
+  const int n = Policy::kMaxResizeThreshold;
+  for (int i = 0; i < n; ++i) map[i] = i;
+  EXPECT_EQ(map.ht_len(), 32768);
+  for (int i = 0; i < n; i += 2) map.erase(i);
+  map.compact();
+  EXPECT_EQ(map.size(), n / 2);
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(map.contains(i), i % 2 == 1);
+  }
+}
+
+namespace {
+
+// Stateful allocator that tracks the bytes it has outstanding. Allocators
+// compare equal if they share the tracker. Propagation on container copy,
+// move, and swap is controlled by kPropagate.
+template <typename T, bool kPropagate>
+struct TrackingAllocator {
+  using value_type = T;
+  using propagate_on_container_copy_assignment =
+      std::integral_constant<bool, kPropagate>;
+  using propagate_on_container_move_assignment =
+      std::integral_constant<bool, kPropagate>;
+  using propagate_on_container_swap = std::integral_constant<bool, kPropagate>;
+
+  template <typename U>
+  struct rebind {
+    using other = TrackingAllocator<U, kPropagate>;
+  };
+
+  explicit TrackingAllocator(long* bytes) : bytes(bytes) {}
+
+  template <typename U>
+  TrackingAllocator(const TrackingAllocator<U, kPropagate>& other)
+      : bytes(other.bytes) {}
+
+  T* allocate(size_t n) {
+    *bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    *bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const TrackingAllocator<U, kPropagate>& other) const {
+    return bytes == other.bytes;
+  }
+
+  template <typename U>
+  bool operator!=(const TrackingAllocator<U, kPropagate>& other) const {
+    return bytes != other.bytes;
+  }
+
+  long* bytes;
+};
+
+template <bool kPropagate>
+using TrackingMap =
+    FlatSmallHashMap<std::string, int, DefaultHashFn<std::string>,
+                     std::equal_to<std::string>, SmallSizePolicy,
+                     TrackingAllocator<std::pair<std::string, int>, kPropagate>>;
+
+template <bool kPropagate>
+TrackingMap<kPropagate> trackingMap(long* bytes, int count) {
+  TrackingMap<kPropagate> map(
+      (TrackingAllocator<std::pair<std::string, int>, kPropagate>(bytes)));
+  for (int i = 0; i < count; ++i) map[std::to_string(i)] = i;
+  return map;
+}
+
+}  // namespace
+
+TEST(FlatSmallHashMap, AllocatorAccountsForAllStorage) {
+  long bytes = 0;
+  {
+    auto map = trackingMap<false>(&bytes, 1000);
+    EXPECT_GT(bytes, 0);
+    EXPECT_EQ(map.get_allocator().bytes, &bytes);
+    for (int i = 0; i < 1000; i += 2) map.erase(std::to_string(i));
+    map.compact();
+    EXPECT_EQ(map.size(), 500);
+  }
+  EXPECT_EQ(bytes, 0);
+}
+
+TEST(FlatSmallHashMap, AllocatorPropagatesOnMove) {
+  long a = 0, b = 0;
+  {
+    auto map = trackingMap<false>(&a, 100);
+    auto moved = std::move(map);
+    EXPECT_EQ(moved.get_allocator().bytes, &a);
+    EXPECT_EQ(moved.size(), 100);
+    // Not propagated on assignment: entries are moved into storage from the
+    // target's allocator.
+    auto target = trackingMap<false>(&b, 1);
+    target = std::move(moved);
+    EXPECT_EQ(target.get_allocator().bytes, &b);
+    EXPECT_EQ(target.size(), 100);
+    EXPECT_EQ(target.at("42"), 42);
+    moved.clear();
+    moved.compact();
+    EXPECT_EQ(a, 0);
+  }
+  {
+    auto source = trackingMap<true>(&a, 100);
+    auto target = trackingMap<true>(&b, 1);
+    target = std::move(source);
+    EXPECT_EQ(target.get_allocator().bytes, &a);
+    EXPECT_EQ(b, 0);
+    EXPECT_EQ(target.at("42"), 42);
+  }
+  EXPECT_EQ(a, 0);
+  EXPECT_EQ(b, 0);
+}
+
+TEST(FlatSmallHashMap, AllocatorPropagatesOnCopy) {
+  long a = 0, b = 0;
+  {
+    auto source = trackingMap<false>(&a, 100);
+    auto copy = source;
+    EXPECT_EQ(copy.get_allocator().bytes, &a);
+    TrackingMap<false> other_copy(
+        source, TrackingAllocator<std::pair<std::string, int>, false>(&b));
+    EXPECT_EQ(other_copy.get_allocator().bytes, &b);
+    EXPECT_EQ(other_copy, source);
+    auto target = trackingMap<false>(&b, 1);
+    target = source;
+    EXPECT_EQ(target.get_allocator().bytes, &b);
+    EXPECT_EQ(target, source);
+    auto propagating = trackingMap<true>(&b, 1);
+    propagating = trackingMap<true>(&a, 100);
+    EXPECT_EQ(propagating.get_allocator().bytes, &a);
+    auto propagating_copy = trackingMap<true>(&b, 1);
+    propagating_copy = propagating;
+    EXPECT_EQ(propagating_copy.get_allocator().bytes, &a);
+    EXPECT_EQ(propagating_copy, propagating);
+  }
+  EXPECT_EQ(a, 0);
+  EXPECT_EQ(b, 0);
+}
+
+#ifdef ROO_COLLECTIONS_HAS_PMR
+TEST(FlatSmallHashMap, PolymorphicAllocator) {
+  char arena[16384];
+  std::pmr::monotonic_buffer_resource resource(
+      arena, sizeof(arena), std::pmr::null_memory_resource());
+  pmr::FlatSmallHashMap<int, int> map(&resource);
+  for (int i = 0; i < 200; ++i) map[i] = i * i;
+  EXPECT_EQ(map.get_allocator().resource(), &resource);
+  EXPECT_EQ(map.at(12), 144);
+  pmr::FlatSmallHashSet<int> set(&resource);
+  for (int i = 0; i < 100; ++i) set.insert(i);
+  EXPECT_TRUE(set.contains(99));
+  // Copies do not propagate polymorphic allocators.
+  auto copy = map;
+  EXPECT_EQ(copy.get_allocator().resource(),
+            std::pmr::get_default_resource());
+  EXPECT_EQ(copy, map);
+  pmr::FlatSmallStringHashMap<int> strings(&resource);
+  strings["a"] = 1;
+  EXPECT_EQ(strings.at(roo::string_view("a")), 1);
+}
+#endif
+
+namespace {
+
+// Large enough that a few of them fill a cache line.
+struct Config {
+  int id;
+  char payload[60];
+};
+
+template <typename Key, typename Value, typename Policy = SmallSizePolicy>
+using SplitMap = FlatSmallHashMap<Key, Value, DefaultHashFn<Key>,
+                                  std::equal_to<Key>, SplitKeyValue<Policy>>;
+
+}  // namespace
+
+TEST(FlatSmallHashMap, SplitKeyValueBasic) {
+  SplitMap<std::string, Config> map;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(map.try_emplace(std::to_string(i), Config{i, {}}).second);
+  }
+  EXPECT_FALSE(map.insert({"7", Config{-1, {}}}).second);
+  EXPECT_FALSE(map.insert_or_assign("8", Config{-8, {}}).second);
+  map["100"].id = 100;
+  EXPECT_EQ(map.size(), 101);
+  auto it = map.find("7");
+  ASSERT_NE(it, map.end());
+  EXPECT_EQ(it->first, "7");
+  EXPECT_EQ((*it).second.id, 7);
+  it->second.id = 70;
+  EXPECT_EQ(map.at("7").id, 70);
+  EXPECT_EQ(map.at("8").id, -8);
+  for (int i = 0; i < 100; i += 2) EXPECT_TRUE(map.erase(std::to_string(i)));
+  EXPECT_FALSE(map.contains("0"));
+  int sum = 0;
+  for (const auto& e : map) {
+    EXPECT_EQ(&map.at(e.first), &e.second);
+    sum += e.second.id;
+  }
+  EXPECT_EQ(sum, 2500 + 63 + 100);
+  const auto& cmap = map;
+  EXPECT_EQ(cmap.find("9")->second.id, 9);
+  auto copy = map;
+  copy.compact();
+  EXPECT_EQ(copy.size(), 51);
+  EXPECT_EQ(copy.at("7").id, 70);
+  std::map<std::string, int> ids;
+  for (const auto& e : copy) ids[e.first] = e.second.id;
+  EXPECT_EQ(ids.size(), 51);
+}
+
+TEST(FlatSmallHashMap, SplitKeyValueStress) {
+  stressAgainstStdMap<PolicyIntMap<SplitKeyValue<SmallSizePolicy>>>(200);
+  stressAgainstStdMap<PolicyIntMap<
+      SplitKeyValue<StoredHash<GroupProbing<LargeSizePolicy>>>>>(200);
+  stressAgainstStdMap<
+      PolicyIntMap<SplitKeyValue<PowerOfTwoCapacity<SmallSizePolicy>>>>(200);
+  churnAtFixedSize<SplitKeyValue<SmallSizePolicy>>(1000);
+  churnAtFixedSize<SplitKeyValue<GroupProbing<LargeSizePolicy>>>(1000);
+}
+
+TEST(FlatSmallHashMap, SplitKeyValueMoveOnlyValues) {
+  SplitMap<int, std::unique_ptr<int>> map;
+  for (int i = 0; i < 1000; ++i) {
+    map.try_emplace(i, std::unique_ptr<int>(new int(i)));
+  }
+  for (int i = 0; i < 1000; i += 3) map.erase(i);
+  map.compact();
+  SplitMap<int, std::unique_ptr<int>> moved(std::move(map));
+  EXPECT_EQ(moved.size(), 666);
+  EXPECT_EQ(*moved.at(500), 500);
+  SplitMap<int, std::unique_ptr<int>> merged;
+  merged.try_emplace(1, std::unique_ptr<int>(new int(-1)));
+  merged.merge(moved);
+  EXPECT_EQ(merged.size(), 666);
+  EXPECT_EQ(*merged.at(1), -1);
+  EXPECT_EQ(*merged.at(998), 998);
+  ASSERT_EQ(moved.size(), 1);
+  EXPECT_EQ(*moved.at(1), 1);
+}
+
+TEST(FlatSmallHashMap, SplitKeyValueHeterogeneousLookup) {
+  FlatSmallHashMap<std::string, int, TransparentStringHashFn, TransparentEq,
+                   SplitKeyValue<GroupProbing<SmallSizePolicy>>>
+      map;
+  EXPECT_TRUE(map.try_emplace(roo::string_view("alpha"), 1).second);
+  map[roo::string_view("beta")] = 2;
+  EXPECT_EQ(map.at("alpha"), 1);
+  EXPECT_EQ(map.find(roo::string_view("beta"))->second, 2);
+  EXPECT_TRUE(map.erase("alpha"));
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(FlatSmallHashMap, SplitKeyValueAllocator) {
+  using Alloc = TrackingAllocator<std::pair<std::string, int>, false>;
+  long bytes = 0;
+  {
+    FlatSmallHashMap<std::string, int, DefaultHashFn<std::string>,
+                     std::equal_to<std::string>,
+                     SplitKeyValue<SmallSizePolicy>, Alloc>
+        map((Alloc(&bytes)));
+    for (int i = 0; i < 1000; ++i) map[std::to_string(i)] = i;
+    EXPECT_GE(bytes, (long)map.ht_len() * (sizeof(std::string) + sizeof(int)));
+    auto copy = map;
+    EXPECT_EQ(copy, map);
+    map.clear();
+    map.compact();
+  }
+  EXPECT_EQ(bytes, 0);
+}
+
 TEST(FlatSmallHashMap, Regression1) {
   FlatSmallHashMap<int16_t, int16_t> map;
   map.insert({58, -47});
@@ -0,0 +1,216 @@
+#include "roo_collections/flat_hashtable_snapshot.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define ROO_COLLECTIONS_TEST_MMAP 1
+#endif
+
+namespace roo_collections {
+
+TEST(FlatHashtableSnapshot, IntMap) {
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 1000; ++i) map[i * 7] = i;
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallHashMapSnapshot<int, int> snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_EQ(snapshot.size(), 1000);
+  EXPECT_EQ(snapshot.ht_len(), map.ht_len());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(snapshot.at(i * 7), i);
+    ASSERT_FALSE(snapshot.contains(i * 7 + 1));
+  }
+  EXPECT_EQ(snapshot.find(3), snapshot.end());
+  EXPECT_EQ(snapshot.find(14)->second, 2);
+}
+
+TEST(FlatHashtableSnapshot, StringMap) {
+  FlatSmallStringHashMap<std::string> map = {
+      {"alpha", "a"}, {"beta", "b"}, {"", "empty"}, {"gamma", ""}};
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallStringHashMapSnapshot<std::string> snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_EQ(snapshot.at("alpha"), "a");
+  EXPECT_EQ(snapshot.at(roo::string_view("beta")), "b");
+  EXPECT_EQ(snapshot.at(std::string("")), "empty");
+  EXPECT_EQ(snapshot.at(SmallString<8>("gamma")), "");
+  EXPECT_FALSE(snapshot.contains("delta"));
+  // The strings point into the image.
+  roo::string_view value = snapshot.at("alpha");
+  EXPECT_GE(value.data(), image.data());
+  EXPECT_LT(value.data(), image.data() + image.size());
+}
+
+TEST(FlatHashtableSnapshot, Iteration) {
+  FlatSmallHashMap<std::string, int> map;
+  for (int i = 0; i < 100; ++i) map[std::to_string(i)] = i;
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallHashMapSnapshot<std::string, int> snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  std::map<std::string, int> entries;
+  for (const auto& e : snapshot) entries[std::string(e.first)] = e.second;
+  EXPECT_EQ(entries.size(), 100);
+  for (const auto& e : map) EXPECT_EQ(entries[e.first], e.second);
+  EXPECT_EQ(snapshot.at(std::string("42")), 42);
+}
+
+TEST(FlatHashtableSnapshot, Set) {
+  FlatSmallStringHashSet set = {"get", "set", "list"};
+  std::vector<char> image = serializeSnapshot(set);
+  FlatSmallStringHashSetSnapshot snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_TRUE(snapshot.contains("get"));
+  EXPECT_TRUE(snapshot.contains(std::string("list")));
+  EXPECT_FALSE(snapshot.contains("put"));
+  EXPECT_EQ(*snapshot.find("set"), "set");
+}
+
+TEST(FlatHashtableSnapshot, GroupProbingWithStoredHashAndTombstones) {
+  using Policy = StoredHash<GroupProbing<LargeSizePolicy>>;
+  FlatSmallHashMap<std::string, int, DefaultHashFn<std::string>,
+                   std::equal_to<std::string>, Policy>
+      map;
+  for (int i = 0; i < 20000; ++i) map[std::to_string(i)] = i;
+  for (int i = 0; i < 20000; i += 3) map.erase(std::to_string(i));
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallHashMapSnapshot<std::string, int, DefaultHashFn<std::string>,
+                           Policy>
+      snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_EQ(snapshot.size(), map.size());
+  for (int i = 0; i < 20000; ++i) {
+    auto it = snapshot.find(std::to_string(i));
+    if (i % 3 == 0) {
+      ASSERT_EQ(it, snapshot.end());
+    } else {
+      ASSERT_EQ(it->second, i);
+    }
+  }
+  // The same layout without stored hashes doesn't match.
+  FlatSmallHashMapSnapshot<std::string, int, DefaultHashFn<std::string>,
+                           GroupProbing<LargeSizePolicy>>
+      other;
+  EXPECT_FALSE(other.attach(image.data(), image.size()));
+}
+
+TEST(FlatHashtableSnapshot, Empty) {
+  FlatSmallHashMapSnapshot<int, int> detached;
+  EXPECT_TRUE(detached.empty());
+  EXPECT_FALSE(detached.contains(0));
+  EXPECT_EQ(detached.begin(), detached.end());
+
+  FlatSmallHashMap<int, int> map;
+  map.clear();
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallHashMapSnapshot<int, int> snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_TRUE(snapshot.empty());
+  EXPECT_FALSE(snapshot.contains(5));
+  EXPECT_EQ(snapshot.begin(), snapshot.end());
+}
+
+TEST(FlatHashtableSnapshot, RejectsMismatchedImages) {
+  FlatSmallHashMap<int, int> map = {{1, 1}, {2, 2}};
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallHashMapSnapshot<int, int> snapshot;
+  // Truncated.
+  EXPECT_FALSE(snapshot.attach(image.data(), image.size() - 1));
+  EXPECT_FALSE(snapshot.attach(image.data(), 10));
+  // Different entry layout.
+  FlatSmallHashMapSnapshot<int, double> wide;
+  EXPECT_FALSE(wide.attach(image.data(), image.size()));
+  // Different index width.
+  FlatSmallHashMapSnapshot<int, int, DefaultHashFn<int>, LargeSizePolicy> large;
+  EXPECT_FALSE(large.attach(image.data(), image.size()));
+  // Corrupt magic.
+  std::vector<char> corrupt = image;
+  corrupt[0] = 'X';
+  EXPECT_FALSE(snapshot.attach(corrupt.data(), corrupt.size()));
+  // Nothing attached so far.
+  EXPECT_FALSE(snapshot.contains(1));
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_EQ(snapshot.at(2), 2);
+}
+
+// Verifies that images record the capacity scheme, which determines the home
+// slots of the keys.
+TEST(FlatHashtableSnapshot, PowerOfTwoCapacity) {
+  using Policy = PowerOfTwoCapacity<GroupProbing<SmallSizePolicy>>;
+  FlatSmallHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>, Policy>
+      map;
+  for (int i = 0; i < 1000; ++i) map[i * 3] = i;
+  std::vector<char> image = serializeSnapshot(map);
+  FlatSmallHashMapSnapshot<int, int, DefaultHashFn<int>, Policy> snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  for (int i = 0; i < 3000; ++i) {
+    ASSERT_EQ(snapshot.contains(i), i % 3 == 0);
+  }
+  FlatSmallHashMapSnapshot<int, int, DefaultHashFn<int>,
+                           GroupProbing<SmallSizePolicy>>
+      radke;
+  EXPECT_FALSE(radke.attach(image.data(), image.size()));
+}
+
+// Images always store whole entries, so a table with split keys and values
+// serializes to the same image as its interleaved counterpart.
+TEST(FlatHashtableSnapshot, SplitKeyValue) {
+  FlatSmallHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>,
+                   SplitKeyValue<SmallSizePolicy>>
+      split;
+  FlatSmallHashMap<int, int> map;
+  for (int i = 0; i < 1000; ++i) {
+    split[i * 3] = i;
+    map[i * 3] = i;
+  }
+  std::vector<char> image = serializeSnapshot(split);
+  EXPECT_EQ(image, serializeSnapshot(map));
+  FlatSmallHashMapSnapshot<int, int> snapshot;
+  ASSERT_TRUE(snapshot.attach(image.data(), image.size()));
+  EXPECT_EQ(snapshot.at(300), 100);
+}
+
+#ifdef ROO_COLLECTIONS_TEST_MMAP
+
+TEST(FlatHashtableSnapshot, MappedFile) {
+  FlatSmallHashMap<std::string, int, TransparentStringHashFn, TransparentEq,
+                   LargeSizePolicy>
+      dict;
+  for (int i = 0; i < 100000; ++i) dict["word" + std::to_string(i)] = i;
+  std::vector<char> image = serializeSnapshot(dict);
+
+  char path[] = "/tmp/roo_collections_snapshot_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, image.data(), image.size()), (ssize_t)image.size());
+  image.clear();
+  void* data = mmap(nullptr, lseek(fd, 0, SEEK_END), PROT_READ, MAP_PRIVATE,
+                    fd, 0);
+  ASSERT_NE(data, MAP_FAILED);
+
+  FlatSmallHashMapSnapshot<std::string, int, TransparentStringHashFn,
+                           LargeSizePolicy>
+      snapshot;
+  size_t size = lseek(fd, 0, SEEK_END);
+  ASSERT_TRUE(snapshot.attach(data, size));
+  EXPECT_EQ(snapshot.size(), 100000);
+  EXPECT_EQ(snapshot.at("word0"), 0);
+  EXPECT_EQ(snapshot.at(roo::string_view("word99999")), 99999);
+  EXPECT_FALSE(snapshot.contains("word100000"));
+
+  munmap(data, size);
+  close(fd);
+  unlink(path);
+}
+
+#endif  // ROO_COLLECTIONS_TEST_MMAP
+
+}  // namespace roo_collections
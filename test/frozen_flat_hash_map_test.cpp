@@ -0,0 +1,96 @@
+#include "roo_collections/frozen_flat_hash_map.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace roo_collections {
+
+namespace {
+
+enum class Command { kGet, kSet, kDelete, kList };
+
+constexpr auto kCommands = makeFrozenFlatHashMap<roo::string_view, Command>({
+    {"get", Command::kGet},
+    {"set", Command::kSet},
+    {"delete", Command::kDelete},
+    {"list", Command::kList},
+});
+
+constexpr auto kPrimes = makeFrozenFlatHashSet<int>({2, 3, 5, 7, 11, 13});
+
+// Lookups are evaluated by the compiler.
+static_assert(kCommands.size() == 4, "");
+static_assert(kCommands.at("delete") == Command::kDelete, "");
+static_assert(kCommands.contains(roo::string_view("list")), "");
+static_assert(!kCommands.contains("put"), "");
+static_assert(kPrimes.contains(11), "");
+static_assert(!kPrimes.contains(4), "");
+
+}  // namespace
+
+TEST(FrozenFlatHashMap, HeterogeneousLookup) {
+  EXPECT_EQ(kCommands.at("get"), Command::kGet);
+  EXPECT_EQ(kCommands.at(std::string("set")), Command::kSet);
+  EXPECT_EQ(kCommands.at(roo::string_view("delete")), Command::kDelete);
+  EXPECT_EQ(kCommands[SmallString<8>("list")], Command::kList);
+  EXPECT_EQ(kCommands.find(std::string("nope")), kCommands.end());
+  EXPECT_FALSE(kCommands.contains(""));
+}
+
+TEST(FrozenFlatHashMap, IteratesInGivenOrder) {
+  std::vector<std::string> keys;
+  for (const auto& e : kCommands) keys.emplace_back(e.first);
+  EXPECT_EQ(keys, std::vector<std::string>({"get", "set", "delete", "list"}));
+}
+
+TEST(FrozenFlatHashMap, SameLayoutAsFlatSmallHashtable) {
+  EXPECT_EQ(kCommands.ht_len(), 7);
+  EXPECT_EQ(kPrimes.ht_len(), 11);
+}
+
+TEST(FrozenFlatHashMap, StringHashMatchesMurmur3) {
+  EXPECT_EQ(FrozenHashFn()("sensors/temperature"),
+            Murmur3StringHash()("sensors/temperature"));
+  EXPECT_EQ(FrozenHashFn()(std::string("abc")), FrozenHashFn()("abc"));
+}
+
+namespace {
+
+constexpr int kManyCount = 1000;
+
+struct Many {
+  std::pair<int, int> entries[kManyCount];
+
+  constexpr Many() : entries() {
+    for (int i = 0; i < kManyCount; ++i) {
+      entries[i].first = i * 7919;
+      entries[i].second = i;
+    }
+  }
+};
+
+constexpr Many kManyEntries;
+constexpr FrozenFlatHashMap<int, int, kManyCount> kMany(kManyEntries.entries);
+
+}  // namespace
+
+TEST(FrozenFlatHashMap, Large) {
+  static_assert(kMany.at(999 * 7919) == 999, "");
+  for (int i = 0; i < kManyCount; ++i) {
+    ASSERT_EQ(kMany.at(i * 7919), i);
+    ASSERT_FALSE(kMany.contains(i * 7919 + 1));
+  }
+}
+
+TEST(FrozenFlatHashMap, BuiltAtRunTime) {
+  std::string names[] = {"alpha", "beta", "gamma"};
+  std::pair<roo::string_view, int> entries[] = {
+      {names[0], 0}, {names[1], 1}, {names[2], 2}};
+  FrozenFlatHashMap<roo::string_view, int, 3> map(entries);
+  EXPECT_EQ(map.at("beta"), 1);
+  EXPECT_FALSE(map.contains("delta"));
+}
+
+}  // namespace roo_collections
@@ -2,7 +2,9 @@
 
 #include <stdint.h>
 
+#include <set>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -58,6 +60,29 @@ uint32_t referenceMurmur3_32(const void* key, size_t len, uint32_t seed) {
   return h;
 }
 
+uint32_t referenceCrc32c(const void* key, size_t len) {
+  const uint8_t* data = static_cast<const uint8_t*>(key);
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+// Returns a buffer of pseudo-random bytes.
+std::vector<uint8_t> randomBytes(size_t len) {
+  std::vector<uint8_t> result(len);
+  uint32_t x = 12345;
+  for (uint8_t& b : result) {
+    x = x * 1103515245 + 12345;
+    b = x >> 24;
+  }
+  return result;
+}
+
 }  // namespace
 
 // Verifies murmur3_32 matches the standard x86_32 MurmurHash3 reference across
@@ -78,4 +103,68 @@ TEST(Hash, Murmur3MatchesReferenceImplementation) {
   }
 }
 
-}  // namespace roo_collections
\ No newline at end of file
+// Verifies that the word-at-a-time loads of murmur3_32 see the same bytes as
+// the reference, for every tail length and at unaligned addresses.
+TEST(Hash, Murmur3MatchesReferenceAtAllLengthsAndOffsets) {
+  std::vector<uint8_t> buf = randomBytes(80);
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t len = 0; len <= 64; ++len) {
+      EXPECT_EQ(murmur3_32(&buf[offset], len, 0x92F4E42Bu),
+                referenceMurmur3_32(&buf[offset], len, 0x92F4E42Bu))
+          << "offset=" << offset << " len=" << len;
+    }
+  }
+}
+
+TEST(Hash, Murmur3ConstexprMatchesMurmur3) {
+  static_assert(murmur3_32_constexpr("", 0, 0) == 0, "");
+  std::vector<uint8_t> buf = randomBytes(80);
+  for (size_t len = 0; len <= 64; ++len) {
+    EXPECT_EQ(murmur3_32_constexpr((const char*)&buf[0], len, 0x92F4E42Bu),
+              murmur3_32(&buf[0], len, 0x92F4E42Bu))
+        << "len=" << len;
+  }
+}
+
+TEST(Hash, Crc32cMatchesReferenceImplementation) {
+  EXPECT_EQ(crc32c("123456789", 9, 0), 0xE3069283u);
+  std::vector<uint8_t> buf = randomBytes(80);
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t len = 0; len <= 64; ++len) {
+      EXPECT_EQ(crc32c(&buf[offset], len, 0),
+                referenceCrc32c(&buf[offset], len))
+          << "offset=" << offset << " len=" << len;
+    }
+  }
+}
+
+TEST(Hash, Crc32cCanBeComputedIncrementally) {
+  std::vector<uint8_t> buf = randomBytes(100);
+  EXPECT_EQ(crc32c(&buf[37], 63, crc32c(&buf[0], 37, 0)),
+            crc32c(&buf[0], 100, 0));
+}
+
+// Verifies that wyhash64 depends on the contents, the length, and the seed,
+// but not on the address of the buffer.
+TEST(Hash, WyhashIsDeterministicAndSensitive) {
+  std::vector<uint8_t> buf = randomBytes(300);
+  std::vector<uint8_t> copy(buf.begin() + 1, buf.end());
+  std::set<uint64_t> seen;
+  for (size_t len = 0; len <= 200; ++len) {
+    uint64_t h = wyhash64(&buf[1], len, 7);
+    EXPECT_EQ(h, wyhash64(&copy[0], len, 7)) << "len=" << len;
+    EXPECT_NE(h, wyhash64(&buf[1], len, 8)) << "len=" << len;
+    EXPECT_TRUE(seen.insert(h).second) << "len=" << len;
+  }
+  // Flipping any single bit changes the hash.
+  for (size_t len : {1, 3, 4, 8, 15, 16, 17, 40, 48, 49, 100}) {
+    uint64_t h = wyhash64(&buf[0], len, 0);
+    for (size_t i = 0; i < len * 8; ++i) {
+      buf[i / 8] ^= (1 << (i % 8));
+      EXPECT_NE(h, wyhash64(&buf[0], len, 0)) << "len=" << len << " bit=" << i;
+      buf[i / 8] ^= (1 << (i % 8));
+    }
+  }
+}
+
+}  // namespace roo_collections
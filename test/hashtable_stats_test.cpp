@@ -0,0 +1,119 @@
+// Tag match counters are only collected with this defined.
+#define ROO_COLLECTIONS_HASHTABLE_STATS
+
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+#include "roo_collections/flat_small_hash_map.h"
+#include "roo_collections/flat_small_hash_set.h"
+
+namespace roo_collections {
+
+namespace {
+
+// Makes home slots and tags predictable: with the initial 11 slots, key k
+// lands at slot k % 11, with tag k & 0x7F.
+struct IdentityHash {
+  size_t operator()(int key) const { return key; }
+};
+
+using IdentityMap = FlatSmallHashMap<int, int, IdentityHash>;
+
+size_t histogramTotal(const HashtableStats& stats) {
+  size_t total = 0;
+  for (size_t count : stats.probe_length_histogram) total += count;
+  return total;
+}
+
+}  // namespace
+
+TEST(HashtableStats, Empty) {
+  IdentityMap map;
+  HashtableStats stats = map.stats();
+  EXPECT_EQ(stats.size, 0);
+  EXPECT_EQ(stats.tombstones, 0);
+  EXPECT_EQ(stats.load_factor, 0);
+  EXPECT_EQ(stats.avg_hit_probe_length, 0);
+  EXPECT_EQ(stats.max_hit_probe_length, 0);
+  EXPECT_EQ(stats.avg_miss_probe_length, 1);
+  EXPECT_EQ(stats.max_miss_probe_length, 1);
+  EXPECT_EQ(histogramTotal(stats), 0);
+}
+
+// Keys 0, 11, and 22 share home slot 0, and so take the slots 0, 9, and 5 of
+// its probe sequence, which continues with the empty slot 10.
+TEST(HashtableStats, ProbeLengths) {
+  IdentityMap map{{0, 0}, {11, 1}, {22, 2}};
+  ASSERT_EQ(map.ht_len(), 11);
+  HashtableStats stats = map.stats();
+  EXPECT_EQ(stats.size, 3);
+  EXPECT_EQ(stats.ht_len, 11);
+  EXPECT_FLOAT_EQ(stats.load_factor, 3.0f / 11);
+  EXPECT_FLOAT_EQ(stats.avg_hit_probe_length, 2);
+  EXPECT_EQ(stats.max_hit_probe_length, 3);
+  EXPECT_EQ(stats.probe_length_histogram[0], 1);
+  EXPECT_EQ(stats.probe_length_histogram[1], 1);
+  EXPECT_EQ(stats.probe_length_histogram[2], 1);
+  EXPECT_EQ(histogramTotal(stats), 3);
+  // Misses: 4 probes from slot 0, 2 from slots 9 and 5, and 1 from the other
+  // 8 slots.
+  EXPECT_FLOAT_EQ(stats.avg_miss_probe_length, 16.0f / 11);
+  EXPECT_EQ(stats.max_miss_probe_length, 4);
+}
+
+TEST(HashtableStats, Tombstones) {
+  IdentityMap map{{0, 0}, {11, 1}, {22, 2}};
+  map.erase(11);
+  HashtableStats stats = map.stats();
+  EXPECT_EQ(stats.size, 2);
+  EXPECT_EQ(stats.tombstones, 1);
+  EXPECT_FLOAT_EQ(stats.tombstone_ratio, 1.0f / 11);
+  // Lookups still probe past the tombstone.
+  EXPECT_EQ(stats.max_hit_probe_length, 3);
+  EXPECT_EQ(stats.max_miss_probe_length, 4);
+}
+
+// Keys 0 and 1408 (= 11 * 128) share both the home slot and the tag.
+TEST(HashtableStats, TagFalsePositives) {
+  IdentityMap map{{0, 0}, {1408, 1}};
+  map.reset_stats();
+  EXPECT_TRUE(map.contains(0));
+  EXPECT_EQ(map.stats().tag_matches, 1);
+  EXPECT_EQ(map.stats().tag_false_positives, 0);
+  EXPECT_TRUE(map.contains(1408));
+  EXPECT_EQ(map.stats().tag_matches, 3);
+  EXPECT_EQ(map.stats().tag_false_positives, 1);
+  EXPECT_FALSE(map.contains(2816));
+  EXPECT_EQ(map.stats().tag_matches, 5);
+  EXPECT_EQ(map.stats().tag_false_positives, 3);
+  map.reset_stats();
+  EXPECT_EQ(map.stats().tag_matches, 0);
+}
+
+// Verifies the histogram and averages against a large table, for both
+// single-slot and group probing.
+template <typename Policy>
+void checkConsistency() {
+  FlatSmallHashSet<int, DefaultHashFn<int>, std::equal_to<int>, Policy> set;
+  srand(7);
+  for (int i = 0; i < 20000; ++i) set.insert(rand());
+  for (int i = 0; i < 5000; ++i) set.erase(rand());
+  HashtableStats stats = set.stats();
+  EXPECT_EQ(stats.size, set.size());
+  EXPECT_EQ(stats.tombstones, set.tombstones());
+  EXPECT_EQ(histogramTotal(stats), set.size());
+  EXPECT_GE(stats.avg_hit_probe_length, 1);
+  EXPECT_LE(stats.avg_hit_probe_length, stats.max_hit_probe_length);
+  EXPECT_GE(stats.avg_miss_probe_length, 1);
+  EXPECT_LE(stats.avg_miss_probe_length, stats.max_miss_probe_length);
+  // Misses probe further than hits.
+  EXPECT_GT(stats.avg_miss_probe_length, stats.avg_hit_probe_length);
+}
+
+TEST(HashtableStats, Consistency) {
+  checkConsistency<SmallSizePolicy>();
+  checkConsistency<GroupProbing<LargeSizePolicy>>();
+  checkConsistency<StoredHash<LargeSizePolicy>>();
+}
+
+}  // namespace roo_collections
@@ -0,0 +1,236 @@
+#include "roo_collections/incremental_hash_map.h"
+
+#include <stdlib.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace roo_collections {
+
+namespace {
+
+using IntMap = IncrementalFlatHashMap<int, int>;
+
+// Inserts consecutive keys from `next` until a resize starts.
+void fillUntilResizing(IntMap& map, int& next) {
+  while (!map.resizing()) {
+    map[next] = next;
+    ++next;
+  }
+}
+
+}  // namespace
+
+TEST(IncrementalFlatHashMap, Basic) {
+  IntMap map = {{1, 10}, {2, 20}};
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_EQ(map.at(1), 10);
+  EXPECT_TRUE(map.insert({3, 30}).second);
+  EXPECT_FALSE(map.insert({3, 31}).second);
+  EXPECT_EQ(map[3], 30);
+  EXPECT_TRUE(map.erase(2));
+  EXPECT_FALSE(map.erase(2));
+  EXPECT_FALSE(map.contains(2));
+  EXPECT_EQ(map, IntMap({{1, 10}, {3, 30}}));
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+}
+
+// Verifies that entries stay reachable, through lookups and iteration, while
+// they are being migrated, and that the new table never grows during the
+// migration.
+TEST(IncrementalFlatHashMap, LookupsDuringResize) {
+  IntMap map;
+  int next = 0;
+  fillUntilResizing(map, next);
+  auto capacity = map.capacity();
+  int resizes = 0;
+  while (resizes < 6) {
+    while (map.resizing()) {
+      map[next] = next;
+      ++next;
+      EXPECT_EQ(map.capacity(), capacity);
+      ASSERT_EQ(map.size(), next);
+      for (int i = 0; i < next; ++i) {
+        ASSERT_EQ(map.at(i), i);
+      }
+      int count = 0;
+      for (const auto& e : map) {
+        EXPECT_EQ(e.first, e.second);
+        ++count;
+      }
+      ASSERT_EQ(count, next);
+    }
+    ++resizes;
+    fillUntilResizing(map, next);
+    EXPECT_GT(map.capacity(), capacity);
+    capacity = map.capacity();
+  }
+}
+
+// Verifies that existing keys are found in the old table, rather than
+// inserted again.
+TEST(IncrementalFlatHashMap, InsertExistingDuringResize) {
+  IntMap map;
+  int next = 0;
+  fillUntilResizing(map, next);
+  int size = map.size();
+  for (int i = 0; i < next; ++i) {
+    auto result = map.try_emplace(i, -1);
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ((*result.first).second, i);
+    EXPECT_FALSE(map.insert_or_assign(i, i + 1).second);
+  }
+  EXPECT_EQ(map.size(), size);
+  for (int i = 0; i < next; ++i) {
+    EXPECT_EQ(map.at(i), i + 1);
+  }
+}
+
+TEST(IncrementalFlatHashMap, EraseDuringResize) {
+  IntMap map;
+  int next = 0;
+  fillUntilResizing(map, next);
+  for (int i = next - 1; i >= 0; i -= 2) {
+    EXPECT_TRUE(map.erase(i));
+  }
+  EXPECT_EQ(map.size(), next / 2);
+  for (int i = 0; i < next; ++i) {
+    EXPECT_EQ(map.contains(i), i % 2 != (next - 1) % 2);
+  }
+  while (map.resizing()) map.erase(-1);
+  EXPECT_EQ(map.size(), next / 2);
+}
+
+TEST(IncrementalFlatHashMap, EraseByIteratorDuringResize) {
+  IntMap map;
+  int next = 0;
+  fillUntilResizing(map, next);
+  map[next++] = 0;
+  int erased = 0;
+  for (auto it = map.begin(); it != map.end();) {
+    if ((*it).first % 3 == 0) {
+      it = map.erase(it);
+      ++erased;
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(map.size(), next - erased);
+  for (int i = 0; i < next; ++i) {
+    EXPECT_EQ(map.contains(i), i % 3 != 0);
+  }
+}
+
+TEST(IncrementalFlatHashMap, CopyAndMoveDuringResize) {
+  IntMap map;
+  int next = 0;
+  fillUntilResizing(map, next);
+  IntMap copy = map;
+  EXPECT_TRUE(copy.resizing());
+  EXPECT_EQ(copy, map);
+  IntMap moved = std::move(copy);
+  EXPECT_EQ(moved, map);
+  for (int i = next; i < 4 * next; ++i) moved[i] = i;
+  EXPECT_FALSE(moved.resizing());
+  for (int i = 0; i < 4 * next; ++i) {
+    ASSERT_EQ(moved.at(i), i);
+  }
+  EXPECT_EQ(map.size(), next);
+}
+
+TEST(IncrementalFlatHashMap, HeterogeneousLookup) {
+  IncrementalFlatHashMap<std::string, std::unique_ptr<int>,
+                         TransparentStringHashFn, TransparentEq>
+      map;
+  for (int i = 0; i < 100; ++i) {
+    map.try_emplace(roo::string_view(std::to_string(i)), new int(i));
+  }
+  for (int i = 0; i < 100; ++i) {
+    std::string key = std::to_string(i);
+    EXPECT_EQ(*map.at(key.c_str()), i);
+    EXPECT_TRUE(map.contains(roo::string_view(key)));
+  }
+  EXPECT_TRUE(map.erase("42"));
+  EXPECT_FALSE(map.contains("42"));
+}
+
+TEST(IncrementalFlatHashMap, InsertFailsWhenFullAtMaxCapacity) {
+  IncrementalFlatHashMap<int, int> map;
+  const int n = SmallSizePolicy::kMaxResizeThreshold;
+  int inserted = 0;
+  for (int i = 0; i < n + 6000; ++i) inserted += map.insert({i, i}).second;
+  EXPECT_EQ(inserted, n);
+  EXPECT_EQ(map.size(), n);
+  EXPECT_FALSE(map.resizing());
+  EXPECT_EQ(map.insert({n + 6000, 0}), std::make_pair(map.end(), false));
+  EXPECT_EQ(map.try_emplace(n + 6000, 0), std::make_pair(map.end(), false));
+  EXPECT_EQ(map.insert_or_assign(n + 6000, 0),
+            std::make_pair(map.end(), false));
+  EXPECT_FALSE(map.contains(n + 6000));
+  EXPECT_FALSE(map.insert_or_assign(5, 50).second);
+  EXPECT_EQ(map.at(5), 50);
+  // Erasing leaves tombstones, which are purged in place to make room.
+  int erased = 0;
+  for (int i = 0; i < 100; ++i) erased += map.erase(i);
+  ASSERT_EQ(erased, 100);
+  EXPECT_TRUE(map.insert({n + 6000, 7}).second);
+  EXPECT_FALSE(map.resizing());
+  EXPECT_EQ(map.at(n + 6000), 7);
+  EXPECT_EQ(map.size(), n - 99);
+  for (int i = 100; i < 1000; ++i) ASSERT_EQ(map.at(i), i);
+}
+
+TEST(IncrementalFlatHashMap, Stress) {
+  IncrementalFlatHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>,
+                         GroupProbing<LargeSizePolicy>>
+      test;
+  std::map<int, int> reference;
+  srand(11);
+  for (int i = 0; i < 300; ++i) {
+    // Grow and shrink in waves.
+    int inserts = (i / 50) % 2 == 0 ? 60 : 30;
+    for (int j = 0; j < inserts; ++j) {
+      int k = rand() % 20000;
+      int v = rand();
+      EXPECT_EQ(test.insert({k, v}).second, reference.insert({k, v}).second);
+    }
+    for (int j = 0; j < 45; ++j) {
+      int k = rand() % 20000;
+      EXPECT_EQ(test.erase(k), reference.erase(k) > 0);
+    }
+    ASSERT_EQ(test.size(), reference.size());
+    std::map<int, int> copy(test.begin(), test.end());
+    ASSERT_EQ(copy, reference);
+  }
+}
+
+TEST(IncrementalFlatHashMap, StressStoredHash) {
+  IncrementalFlatHashMap<int, int, DefaultHashFn<int>, std::equal_to<int>,
+                         StoredHash<GroupProbing<LargeSizePolicy>>>
+      test;
+  std::map<int, int> reference;
+  srand(11);
+  for (int i = 0; i < 300; ++i) {
+    // Grow and shrink in waves.
+    int inserts = (i / 50) % 2 == 0 ? 60 : 30;
+    for (int j = 0; j < inserts; ++j) {
+      int k = rand() % 20000;
+      int v = rand();
+      EXPECT_EQ(test.insert({k, v}).second, reference.insert({k, v}).second);
+    }
+    for (int j = 0; j < 45; ++j) {
+      int k = rand() % 20000;
+      EXPECT_EQ(test.erase(k), reference.erase(k) > 0);
+    }
+    ASSERT_EQ(test.size(), reference.size());
+    std::map<int, int> copy(test.begin(), test.end());
+    ASSERT_EQ(copy, reference);
+  }
+}
+
+}  // namespace roo_collections
@@ -0,0 +1,272 @@
+#include "roo_collections/inline_flat_hash_map.h"
+
+#include <stdlib.h>
+
+#include <map>
+#include <new>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Number of calls to the global operator new, so that tests can verify that
+// inline containers don't allocate.
+size_t heap_allocations = 0;
+
+}  // namespace
+
+// Not inlined, so that the compiler sees new paired with delete, rather than
+// with free().
+__attribute__((noinline)) void* operator new(size_t size) {
+  ++heap_allocations;
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+namespace roo_collections {
+
+namespace {
+
+using IntMap = InlineFlatHashMap<int, int, 20>;
+using SpillingIntMap =
+    InlineFlatHashMap<int, int, 20, InlineOverflow::kSpillToHeap>;
+
+// Returns whether the entries of `container` are stored inside of it.
+template <typename Container>
+bool storedInline(const Container& container) {
+  if (container.empty()) return true;
+  const char* entry = (const char*)&*container.begin();
+  const char* self = (const char*)&container;
+  return entry >= self && entry < self + sizeof(container);
+}
+
+}  // namespace
+
+TEST(InlineFlatHashMap, Basic) {
+  IntMap map = {{1, 10}, {2, 20}};
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_EQ(map.at(1), 10);
+  EXPECT_TRUE(map.insert({3, 30}).second);
+  EXPECT_FALSE(map.insert({3, 31}).second);
+  EXPECT_EQ(map[3], 30);
+  EXPECT_TRUE(map.erase(2));
+  EXPECT_FALSE(map.contains(2));
+  EXPECT_TRUE(storedInline(map));
+}
+
+TEST(InlineFlatHashMap, CapacityRoundsUpToRadkePrime) {
+  IntMap map;
+  EXPECT_GE(map.capacity(), 20);
+  EXPECT_LT(map.capacity(), 40);
+  EXPECT_EQ(map.ht_len(), 31);
+}
+
+TEST(InlineFlatHashMap, FailsWhenFull) {
+  IntMap map;
+  int capacity = map.capacity();
+  for (int i = 0; i < capacity; ++i) {
+    ASSERT_TRUE(map.insert({i, i}).second);
+  }
+  auto result = map.insert({capacity, 0});
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(result.first, map.end());
+  EXPECT_FALSE(map.try_emplace(capacity + 1, 0).second);
+  EXPECT_FALSE(map.emplace(capacity + 2, 0).second);
+  // Keys already present are still found.
+  result = map.insert({5, 0});
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ((*result.first).second, 5);
+  EXPECT_EQ(map.size(), capacity);
+  EXPECT_EQ(map.capacity(), capacity);
+  map.erase(7);
+  EXPECT_TRUE(map.insert({capacity, capacity}).second);
+  EXPECT_TRUE(storedInline(map));
+}
+
+// Verifies that a full map can replace its keys indefinitely, purging the
+// tombstones in place.
+TEST(InlineFlatHashMap, ChurnWhenFull) {
+  IntMap map;
+  int capacity = map.capacity();
+  for (int i = 0; i < capacity; ++i) map[i] = i;
+  for (int i = capacity; i < 5000; ++i) {
+    ASSERT_TRUE(map.erase(i - capacity));
+    ASSERT_TRUE(map.insert({i, i}).second);
+    ASSERT_EQ(map.capacity(), capacity);
+  }
+  for (int i = 5000 - capacity; i < 5000; ++i) EXPECT_EQ(map.at(i), i);
+  map.compact();
+  EXPECT_EQ(map.tombstones(), 0);
+  EXPECT_EQ(map.size(), capacity);
+  EXPECT_TRUE(storedInline(map));
+}
+
+// Sizing calls never reallocate a map that can't spill.
+TEST(InlineFlatHashMap, SizingKeepsInlineStorage) {
+  IntMap map;
+  for (int i = 0; i < 20; ++i) map[i] = i;
+  map.reserve(100);
+  map.rehash(100);
+  auto capacity = map.capacity();
+  EXPECT_LT(capacity, 100);
+  // Fills up more of the inline slots.
+  map.max_load_factor(0.9);
+  EXPECT_GT(map.capacity(), capacity);
+  for (int i = 20; i < map.capacity(); ++i) {
+    ASSERT_TRUE(map.insert({i, i}).second);
+  }
+  for (int i = 0; i < 20; i += 2) map.erase(i);
+  map.shrink_to_fit();
+  EXPECT_EQ(map.tombstones(), 0);
+  EXPECT_TRUE(storedInline(map));
+  EXPECT_EQ(map.at(1), 1);
+}
+
+// Merging into a full map leaves the entries that don't fit in the source.
+TEST(InlineFlatHashMap, MergeWhenFull) {
+  IntMap target;
+  IntMap source;
+  for (int i = 0; i < 10; ++i) target[i] = i;
+  for (int i = 100; i < 120; ++i) source[i] = i;
+  target.merge(source);
+  EXPECT_EQ(target.size(), target.capacity());
+  EXPECT_EQ(target.size() + source.size(), 30);
+  EXPECT_TRUE(storedInline(target));
+  for (const auto& e : source) EXPECT_FALSE(target.contains(e.first));
+  IntMap empty;
+  EXPECT_EQ(empty.insert_unique_range(source.begin(), source.end()),
+            source.size());
+}
+
+TEST(InlineFlatHashMap, SpillsToHeap) {
+  SpillingIntMap map;
+  int capacity = map.capacity();
+  for (int i = 0; i < 200; ++i) map[i] = i;
+  EXPECT_GT(map.capacity(), capacity);
+  EXPECT_FALSE(storedInline(map));
+  for (int i = 0; i < 200; ++i) EXPECT_EQ(map.at(i), i);
+  for (int i = 10; i < 200; ++i) map.erase(i);
+  map.compact();
+  EXPECT_EQ(map.size(), 10);
+  EXPECT_TRUE(storedInline(map));
+  for (int i = 0; i < 10; ++i) EXPECT_EQ(map.at(i), i);
+}
+
+TEST(InlineFlatHashMap, CopyAndMove) {
+  InlineFlatHashMap<std::string, int, 8> map = {{"a", 1}, {"b", 2}};
+  auto copy = map;
+  EXPECT_EQ(copy, map);
+  EXPECT_TRUE(storedInline(copy));
+  auto moved = std::move(copy);
+  EXPECT_EQ(moved, map);
+  EXPECT_TRUE(storedInline(moved));
+  EXPECT_TRUE(copy.empty());
+  copy = moved;
+  EXPECT_EQ(copy, map);
+  EXPECT_TRUE(storedInline(copy));
+  copy["c"] = 3;
+  moved = std::move(copy);
+  EXPECT_EQ(moved.size(), 3);
+  EXPECT_TRUE(storedInline(moved));
+  EXPECT_TRUE(copy.empty());
+  copy["d"] = 4;
+  EXPECT_EQ(copy.size(), 1);
+}
+
+TEST(InlineFlatHashMap, CopySpilled) {
+  SpillingIntMap map;
+  for (int i = 0; i < 100; ++i) map[i] = i;
+  SpillingIntMap copy = map;
+  EXPECT_EQ(copy, map);
+  SpillingIntMap small = {{1, 1}};
+  small = map;
+  EXPECT_EQ(small, map);
+  map = SpillingIntMap({{1, 1}});
+  EXPECT_TRUE(storedInline(map));
+}
+
+TEST(InlineFlatHashSet, Basic) {
+  InlineFlatHashSet<int, 4> set = {1, 2, 3};
+  EXPECT_TRUE(set.contains(2));
+  EXPECT_FALSE(set.contains(4));
+  EXPECT_TRUE(storedInline(set));
+  while (set.insert((int)set.size() + 1).second) {
+  }
+  EXPECT_EQ(set.size(), set.capacity());
+}
+
+TEST(InlineFlatHashMap, GroupProbingWithStoredHash) {
+  InlineFlatHashMap<std::string, int, 40, InlineOverflow::kFail,
+                    DefaultHashFn<std::string>, std::equal_to<std::string>,
+                    StoredHash<GroupProbing<SmallSizePolicy>>>
+      map;
+  int capacity = map.capacity();
+  for (int i = 0; i < 1000; ++i) {
+    if (i >= capacity) map.erase(std::to_string(i - capacity));
+    ASSERT_TRUE(map.insert({std::to_string(i), i}).second);
+  }
+  EXPECT_EQ(map.size(), capacity);
+  EXPECT_EQ(map.at("999"), 999);
+  EXPECT_TRUE(storedInline(map));
+}
+
+// Verifies that maps that can't spill make no heap allocations, with every
+// slot layout.
+template <typename Policy>
+void verifyNoHeapAllocations() {
+  using Map = InlineFlatHashMap<int, int, 20, InlineOverflow::kFail,
+                                DefaultHashFn<int>, std::equal_to<int>, Policy>;
+  size_t before = heap_allocations;
+  {
+    Map map;
+    for (int i = 0; i < 100; ++i) {
+      if (i >= 20) map.erase(i - 20);
+      ASSERT_TRUE(map.insert({i, i}).second);
+    }
+    map.compact();
+    Map copy = map;
+    Map moved = std::move(copy);
+    EXPECT_EQ(moved.size(), 20);
+    EXPECT_EQ(moved.at(99), 99);
+  }
+  EXPECT_EQ(heap_allocations, before);
+}
+
+TEST(InlineFlatHashMap, NoHeapAllocations) {
+  verifyNoHeapAllocations<SmallSizePolicy>();
+  verifyNoHeapAllocations<GroupProbing<SmallSizePolicy>>();
+  verifyNoHeapAllocations<StoredHash<GroupProbing<SmallSizePolicy>>>();
+  verifyNoHeapAllocations<SplitKeyValue<SmallSizePolicy>>();
+  verifyNoHeapAllocations<SplitKeyValue<GroupProbing<SmallSizePolicy>>>();
+}
+
+TEST(InlineFlatHashMap, StressAgainstStdMap) {
+  InlineFlatHashMap<int, int, 100> map;
+  std::map<int, int> reference;
+  srand(7);
+  for (int i = 0; i < 100000; ++i) {
+    int key = rand() % 400;
+    if (rand() % 2 == 0) {
+      bool full = reference.size() == map.capacity();
+      bool present = reference.count(key) > 0;
+      auto result = map.insert({key, i});
+      ASSERT_EQ(result.second, !present && !full);
+      if (result.second) reference[key] = i;
+    } else {
+      ASSERT_EQ(map.erase(key), reference.erase(key) > 0);
+    }
+    ASSERT_EQ(map.size(), reference.size());
+  }
+  for (const auto& e : reference) EXPECT_EQ(map.at(e.first), e.second);
+  EXPECT_TRUE(storedInline(map));
+}
+
+}  // namespace roo_collections
@@ -0,0 +1,118 @@
+#include "roo_collections/read_mostly_hash_map.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace roo_collections {
+
+TEST(ReadMostlyFlatHashMap, Basic) {
+  ReadMostlyFlatHashMap<int, int> map;
+  EXPECT_TRUE(map.empty());
+  map.insert_or_assign(1, 10);
+  map.insert_or_assign(2, 20);
+  map.insert_or_assign(1, 11);
+  EXPECT_EQ(map.size(), 2);
+  int value = 0;
+  EXPECT_TRUE(map.get(1, value));
+  EXPECT_EQ(value, 11);
+  EXPECT_FALSE(map.get(3, value));
+  EXPECT_TRUE(map.contains(2));
+  EXPECT_TRUE(map.erase(2));
+  EXPECT_FALSE(map.erase(2));
+  EXPECT_FALSE(map.contains(2));
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(ReadMostlyFlatHashMap, BatchedUpdate) {
+  ReadMostlyFlatHashMap<int, int> map(
+      FlatSmallHashMap<int, int>({{1, 1}, {2, 2}}));
+  map.update([](FlatSmallHashMap<int, int>& m) {
+    for (int i = 3; i < 100; ++i) m[i] = i;
+    m.erase(1);
+  });
+  EXPECT_EQ(map.size(), 98);
+  EXPECT_EQ(map.read([](const FlatSmallHashMap<int, int>& m) {
+    int sum = 0;
+    for (const auto& e : m) sum += e.second;
+    return sum;
+  }),
+            4949);
+}
+
+TEST(ReadMostlyFlatHashMap, HeterogeneousLookup) {
+  ReadMostlyFlatHashMap<std::string, int, TransparentStringHashFn,
+                        TransparentEq>
+      map;
+  map.insert_or_assign("timeout", 30);
+  int value = 0;
+  EXPECT_TRUE(map.get("timeout", value));
+  EXPECT_EQ(value, 30);
+  EXPECT_TRUE(map.contains(roo::string_view("timeout")));
+  EXPECT_FALSE(map.contains("retries"));
+}
+
+// Readers must always see a complete version of the map: one in which all
+// values are equal to the version, while a writer keeps replacing them.
+TEST(ReadMostlyFlatHashMap, ReadersSeeConsistentVersions) {
+  constexpr int kSize = 200;
+  constexpr int kVersions = 50;
+  FlatSmallHashMap<int, int> initial;
+  for (int i = 0; i < kSize; ++i) initial[i] = 0;
+  ReadMostlyFlatHashMap<int, int> map(initial);
+  std::atomic<bool> done(false);
+  std::atomic<int> inconsistencies(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      int last = 0;
+      while (!done.load()) {
+        int version = map.read([&](const FlatSmallHashMap<int, int>& m) {
+          int v = m.at(0);
+          if ((int)m.size() != kSize) ++inconsistencies;
+          for (const auto& e : m) {
+            if (e.second != v) ++inconsistencies;
+          }
+          return v;
+        });
+        // Versions never go back.
+        if (version < last) ++inconsistencies;
+        last = version;
+      }
+    });
+  }
+  for (int version = 1; version <= kVersions; ++version) {
+    map.update([&](FlatSmallHashMap<int, int>& m) {
+      for (auto& e : m) e.second = version;
+    });
+  }
+  done = true;
+  for (auto& t : readers) t.join();
+  EXPECT_EQ(inconsistencies.load(), 0);
+  EXPECT_EQ(map.read([](const FlatSmallHashMap<int, int>& m) {
+    return m.at(kSize - 1);
+  }),
+            kVersions);
+}
+
+// Verifies that a steady stream of readers can't hold off a writer.
+TEST(ReadMostlyFlatHashMap, WriterNotStarved) {
+  ReadMostlyFlatHashMap<int, int> map;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      while (!done.load()) map.contains(1);
+    });
+  }
+  for (int i = 0; i < 100; ++i) map.insert_or_assign(i, i);
+  done = true;
+  for (auto& t : readers) t.join();
+  EXPECT_EQ(map.size(), 100);
+}
+
+}  // namespace roo_collections
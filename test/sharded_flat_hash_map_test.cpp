@@ -0,0 +1,145 @@
+#include "roo_collections/sharded_flat_hash_map.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace roo_collections {
+
+TEST(ShardedFlatHashMap, Basic) {
+  ShardedFlatHashMap<int, int> map;
+  EXPECT_EQ(map.shard_count(), 64);
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.insert({1, 10}));
+  EXPECT_FALSE(map.insert({1, 11}));
+  EXPECT_TRUE(map.try_emplace(2, 20));
+  EXPECT_TRUE(map.insert_or_assign(3, 30));
+  EXPECT_FALSE(map.insert_or_assign(3, 31));
+  EXPECT_EQ(map.size(), 3);
+  int value = 0;
+  EXPECT_TRUE(map.get(1, value));
+  EXPECT_EQ(value, 10);
+  EXPECT_TRUE(map.get(3, value));
+  EXPECT_EQ(value, 31);
+  EXPECT_FALSE(map.get(4, value));
+  EXPECT_TRUE(map.find(2, [](const int& v) { EXPECT_EQ(v, 20); }));
+  EXPECT_TRUE(map.erase(2));
+  EXPECT_FALSE(map.erase(2));
+  EXPECT_FALSE(map.contains(2));
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(ShardedFlatHashMap, RoundsShardCountUp) {
+  EXPECT_EQ((ShardedFlatHashMap<int, int>(1).shard_count()), 1);
+  EXPECT_EQ((ShardedFlatHashMap<int, int>(5).shard_count()), 8);
+  EXPECT_EQ((ShardedFlatHashMap<int, int>(16).shard_count()), 16);
+}
+
+TEST(ShardedFlatHashMap, Update) {
+  ShardedFlatHashMap<int, int> counters(1);
+  counters.update(7, [](int& count) { ++count; });
+  counters.update(7, [](int& count) { ++count; });
+  EXPECT_TRUE(counters.update(7, [](int& count) { count *= 10; }));
+  int value = 0;
+  EXPECT_TRUE(counters.get(7, value));
+  EXPECT_EQ(value, 20);
+}
+
+TEST(ShardedFlatHashMap, FullShardAtMaxCapacity) {
+  ShardedFlatHashMap<int, int> map(1);
+  const int n = SmallSizePolicy::kMaxResizeThreshold;
+  for (int i = 0; i < n; ++i) ASSERT_TRUE(map.insert({i, i}));
+  bool called = false;
+  EXPECT_FALSE(map.update(n, [&](int&) { called = true; }));
+  EXPECT_FALSE(called);
+  EXPECT_FALSE(map.insert_or_assign(n, n));
+  EXPECT_FALSE(map.try_emplace(n, n));
+  EXPECT_FALSE(map.contains(n));
+  EXPECT_EQ(map.size(), n);
+  EXPECT_TRUE(map.update(5, [](int& v) { v = 50; }));
+  EXPECT_FALSE(map.insert_or_assign(6, 60));
+  int value = 0;
+  EXPECT_TRUE(map.get(5, value));
+  EXPECT_EQ(value, 50);
+  EXPECT_TRUE(map.get(6, value));
+  EXPECT_EQ(value, 60);
+}
+
+TEST(ShardedFlatHashMap, MoveOnlyValues) {
+  ShardedFlatHashMap<int, std::unique_ptr<int>> map(2);
+  EXPECT_TRUE(map.insert_or_assign(1, std::unique_ptr<int>(new int(10))));
+  EXPECT_FALSE(map.insert_or_assign(1, std::unique_ptr<int>(new int(20))));
+  EXPECT_TRUE(map.try_emplace(2, new int(30)));
+  int value = 0;
+  EXPECT_TRUE(map.find(1, [&](const std::unique_ptr<int>& v) { value = *v; }));
+  EXPECT_EQ(value, 20);
+  EXPECT_TRUE(map.find(2, [&](const std::unique_ptr<int>& v) { value = *v; }));
+  EXPECT_EQ(value, 30);
+}
+
+TEST(ShardedFlatHashMap, HeterogeneousLookup) {
+  ShardedFlatHashMap<std::string, int, TransparentStringHashFn, TransparentEq>
+      map;
+  EXPECT_TRUE(map.insert_or_assign("alpha", 1));
+  map.update(roo::string_view("beta"), [](int& v) { v = 2; });
+  int value = 0;
+  EXPECT_TRUE(map.get(std::string("beta"), value));
+  EXPECT_EQ(value, 2);
+  EXPECT_TRUE(map.contains("alpha"));
+  EXPECT_TRUE(map.erase(roo::string_view("alpha")));
+  EXPECT_FALSE(map.contains("alpha"));
+}
+
+TEST(ShardedFlatHashMap, ConcurrentCounters) {
+  constexpr int kThreads = 8;
+  constexpr int kKeys = 500;
+  constexpr int kRounds = 20;
+  ShardedFlatHashMap<int, int> counters;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int round = 0; round < kRounds; ++round) {
+        for (int k = 0; k < kKeys; ++k) {
+          counters.update((k * 31 + t) % kKeys, [](int& c) { ++c; });
+        }
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  EXPECT_EQ(counters.size(), kKeys);
+  long total = 0;
+  counters.for_each([&](const std::pair<int, int>& e) {
+    EXPECT_EQ(e.second, kThreads * kRounds);
+    total += e.second;
+  });
+  EXPECT_EQ(total, (long)kThreads * kRounds * kKeys);
+}
+
+TEST(ShardedFlatHashMap, ConcurrentInsertAndErase) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 2000;
+  ShardedFlatHashMap<int, int> map(8);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        int key = t * kPerThread + i;
+        EXPECT_TRUE(map.insert({key, key}));
+        if (i % 2 == 1) {
+          EXPECT_TRUE(map.erase(key - 1));
+        }
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  EXPECT_EQ(map.size(), kThreads * kPerThread / 2);
+  for (int key = 0; key < kThreads * kPerThread; ++key) {
+    ASSERT_EQ(map.contains(key), key % 2 == 1);
+  }
+}
+
+}  // namespace roo_collections
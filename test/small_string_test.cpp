@@ -1,6 +1,7 @@
 #include "roo_collections/small_string.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -75,4 +76,61 @@ TEST(SmallString, StdStringConstructorTruncatesAndNullTerminates) {
               "");
 }
 
+// Verifies that the length is packed into the buffer, without growing it.
+TEST(SmallString, StoresLengthWithoutExtraMemory) {
+  EXPECT_EQ(sizeof(SmallString<1>), 1);
+  EXPECT_EQ(sizeof(SmallString<32>), 32);
+  EXPECT_EQ(sizeof(SmallString<256>), 256);
+}
+
+// Verifies the stored length at every fill level, including a full buffer,
+// and after reassigning a shorter string.
+template <size_t N>
+void verifyLengths() {
+  std::string full(N - 1, 'x');
+  for (size_t len = 0; len < N; ++len) {
+    SmallString<N> value(roo::string_view(full.data(), len));
+    EXPECT_EQ(value.length(), len);
+    EXPECT_EQ(strlen(value.c_str()), len);
+    EXPECT_EQ(value.empty(), len == 0);
+    SmallString<N> copy = value;
+    EXPECT_EQ(copy.length(), len);
+    value = "";
+    EXPECT_EQ(value.length(), 0);
+    EXPECT_TRUE(value.empty());
+    value = roo::string_view(full.data(), len);
+    EXPECT_EQ(value, copy);
+  }
+  SmallString<N> truncated(full + "yz");
+  EXPECT_EQ(truncated.length(), N - 1);
+  EXPECT_EQ(truncated, full);
+}
+
+TEST(SmallString, TracksLength) {
+  verifyLengths<1>();
+  verifyLengths<2>();
+  verifyLengths<16>();
+  verifyLengths<256>();
+  verifyLengths<300>();
+}
+
+TEST(SmallString, HeterogeneousComparison) {
+  SmallString<16> value("abc");
+  EXPECT_TRUE(value == "abc");
+  EXPECT_TRUE("abc" == value);
+  EXPECT_TRUE(value != "ab");
+  EXPECT_TRUE("abcd" != value);
+  EXPECT_TRUE(value == std::string("abc"));
+  EXPECT_TRUE(std::string("abc") == value);
+  EXPECT_TRUE(value != std::string("abd"));
+  EXPECT_TRUE(std::string("") != value);
+  EXPECT_TRUE(value == roo::string_view("abcd", 3));
+  EXPECT_TRUE(roo::string_view("abcd", 3) == value);
+  EXPECT_TRUE(value != roo::string_view("abcd", 4));
+  EXPECT_TRUE(roo::string_view("ab") != value);
+  EXPECT_TRUE(value == SmallString<4>("abc"));
+  EXPECT_TRUE(SmallString<8>("abd") != value);
+  EXPECT_FALSE(value == SmallString<3>("abc"));
+}
+
 }  // namespace roo_collections
\ No newline at end of file